@@ -52,7 +52,7 @@ struct display_cx {
     const struct aa_rx_sg *scenegraph;
     const struct aa_rx_sg_sub *ssg;
     struct aa_rx_wk_opts *wk_opts;
-    const struct aa_rx_wk_lc3_cx *lc3;
+    struct aa_rx_wk_lc3_cx *lc3;
     double E0[7];
     double *q;
     struct aa_dvec *dq_subset;
@@ -51,4 +51,30 @@ AA_API int aa_kin_planar2_ik_theta2( const double l[2],
                                      const double x[2],
                                      double theta_a[2],
                                      double theta_b[2] );
+
+/** IK solution for 2-link planar arm in joint angles.
+ * \f[ x_1 = l_1 \cos(q_1) + l_2 \cos(q_1 + q_2) \f]
+ * \f[ y_1 = l_1 \sin(q_1) + l_2 \sin(q_1 + q_2) \f]
+ *
+ * q_a is the solution with nonnegative q_2, q_b the other elbow.
+ * When x is out of reach, both hold the nearest stretched or folded
+ * configuration.
+ *
+ * @returns 0 if x is reachable, nonzero otherwise
+ */
+AA_API int aa_kin_planar2_ik( const double l[2],
+                              const double x[2],
+                              double q_a[2],
+                              double q_b[2] );
+
+/** IK solution for 3-link planar arm in joint angles.
+ *
+ * x holds the end position and the end angle \f$q_1+q_2+q_3\f$.
+ *
+ * @see aa_kin_planar2_ik
+ */
+AA_API int aa_kin_planar3_ik( const double l[3],
+                              const double x[3],
+                              double q_a[3],
+                              double q_b[3] );
 #endif// AMINO_KIN_H
@@ -133,6 +133,19 @@ aa_opt_set_cstr_gm( struct aa_opt_cx *cx,
                     const double *A, size_t lda,
                     const double *b_min, const double *b_max );
 
+/**
+ * Set the constraint bounds, keeping the constraint matrix.
+ *
+ * The bounds must be finite for the same constraints as when the
+ * matrix was set.
+ *
+ * @return 0 on success, or nonzero if the solver cannot keep its
+ * matrix for these bounds; then set both with aa_opt_set_cstr_gm().
+ */
+AA_API int
+aa_opt_set_cstr_bnd( struct aa_opt_cx *cx, size_t m,
+                     const double *b_min, const double *b_max );
+
 /**
  * Set the quadratic objective function via compressed-row-storage
  * format.
@@ -74,6 +74,12 @@ public:
     mutable std::mutex mutex;
     struct aa_rx_cl *cl;
 
+    /** Kinematics at the last checked state, other configs from set_start() */
+    struct aa_rx_fk *fk;
+
+    /** Whether the next check must update every collision object */
+    mutable bool cl_full;
+
     struct aa_rx_cl_set *collisions;
 };
 
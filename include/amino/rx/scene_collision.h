@@ -116,6 +116,11 @@ aa_rx_cl_set_clear(struct aa_rx_cl_set* cl_set );
  */
 struct aa_rx_cl;
 
+/**
+ * Opaque type for a sub-scenegraph.
+ */
+struct aa_rx_sg_sub;
+
 /**
  * Initialize the collision structures within scene_graph.
  */
@@ -124,6 +129,10 @@ aa_rx_sg_cl_init( struct aa_rx_sg *scene_graph );
 
 /**
  * Create a new collision detection context for scene_graph.
+ *
+ * Objects on frames that no configuration moves are placed by the
+ * first check from forward kinematics and skipped by later ones.
+ * aa_rx_cl_check() compares every transform it is given.
  */
 AA_API struct aa_rx_cl *
 aa_rx_cl_create( const struct aa_rx_sg *scene_graph );
@@ -134,6 +143,21 @@ aa_rx_cl_create( const struct aa_rx_sg *scene_graph );
 AA_API void
 aa_rx_cl_destroy( struct aa_rx_cl *cl );
 
+/**
+ * Set the number of threads for narrowphase collision checks.
+ *
+ * With more than one thread, broadphase candidate pairs are collected
+ * first and then tested concurrently.  Results are identical to the
+ * single-threaded check.  One, the default, checks on the calling
+ * thread only.  Zero uses one thread per online processor.
+ *
+ * The calling thread and n-1 worker threads share each check.  The
+ * workers are created here, wait between checks, and are joined by
+ * aa_rx_cl_destroy() or the next call to aa_rx_cl_set_threads().
+ */
+AA_API void
+aa_rx_cl_set_threads( struct aa_rx_cl *cl, size_t n );
+
 /**
  * Allow (ignore) collisions between frames i and j if allowed is true.
  */
@@ -186,6 +210,51 @@ aa_rx_cl_check_fk( struct aa_rx_cl *cl,
                    struct aa_rx_fk *fk,
                    struct aa_rx_cl_set *cl_set );
 
+/**
+ * Detect collisions after a sub-scenegraph has moved.
+ *
+ * Only collision objects attached to frames moved by ssg (see
+ * aa_rx_sg_sub_moved()) are updated from fk.  All other objects keep
+ * the transforms from the previous check, so the preceding check must
+ * have used an fk that agrees with this one outside the moved frames,
+ * e.g., a full aa_rx_cl_check_fk() at the start configuration.
+ *
+ * @returns 0 if no collisions are detected and non-zero if any collisions are detected.
+ */
+AA_API int
+aa_rx_cl_check_sub( struct aa_rx_cl *cl,
+                    const struct aa_rx_sg_sub *ssg,
+                    struct aa_rx_fk *fk,
+                    struct aa_rx_cl_set *cl_set );
+
+/**
+ * Detect collisions at many configurations.
+ *
+ * Configurations are split across the threads set by
+ * aa_rx_cl_set_threads(), each checking with its own context that
+ * shares the scene graph's collision geometry.  These contexts are
+ * created by the first batch check and kept in cl until it is
+ * destroyed or the thread count is lowered.
+ *
+ * If results is non-NULL, every configuration is checked and
+ * results[i] is set non-zero when configuration i collides.  If
+ * results is NULL, checking stops after the first colliding
+ * configuration, as for path validation.
+ *
+ * @param cl        the collision context
+ * @param n_configs number of configurations
+ * @param Q         configurations of the full scene graph, column i is configuration i
+ * @param results   optional output, size n_configs
+ *
+ * @returns 0 if no configuration collides, i+1 where i is the lowest
+ * colliding index, or a negative value if Q has the wrong size.
+ */
+AA_API int
+aa_rx_cl_check_batch( struct aa_rx_cl *cl,
+                      size_t n_configs,
+                      const struct aa_dmat *Q,
+                      int *results );
+
 /**
  * Allow all collisions at configuration q.
  */
@@ -216,9 +285,14 @@ aa_rx_sg_get_collision(const struct aa_rx_sg* scene_graph, size_t n_q, const dou
  */
 struct aa_rx_cl_dist;
 
-/** Create a collision distance context */
+/**
+ * Create a collision distance context.
+ *
+ * Distance checks update the transforms cached in cl, so cl and its
+ * distance contexts serve one thread at a time.
+ */
 AA_API struct aa_rx_cl_dist *
-aa_rx_cl_dist_create( const struct aa_rx_cl * );
+aa_rx_cl_dist_create( struct aa_rx_cl * );
 
 /** Destroy a collision distance context */
 AA_API void
@@ -245,5 +319,88 @@ aa_rx_cl_dist_get_points( const struct aa_rx_cl_dist *cl_dist,
                           aa_rx_frame_id id0, aa_rx_frame_id id1,
                           double point0[3], double point1[3] );
 
+/**
+ * Detect collisions along a joint-space motion.
+ *
+ * Checks the straight-line motion q(t) = q0 + t*(q1-q0), t in [0,1],
+ * by conservative advancement.  At each step, frame pair distances
+ * and per-frame motion bounds from the kinematic chain give a time
+ * step over which no pair can make contact.  Unlike checking sampled
+ * configurations, thin obstacles are not missed.
+ *
+ * @param cl    the collision context
+ * @param q0    start configuration of the full scene graph
+ * @param q1    end configuration of the full scene graph
+ * @param t_hit if non-NULL and contact is found, set to the first
+ *              time at which frames are within contact tolerance
+ *
+ * @returns 0 if the motion is collision-free, 1 on contact, or a
+ * negative value if q0 or q1 has the wrong size.
+ */
+AA_API int
+aa_rx_cl_check_motion( struct aa_rx_cl *cl,
+                       const struct aa_dvec *q0,
+                       const struct aa_dvec *q1,
+                       double *t_hit );
+
+/*-----------------------------*/
+/* Separation Constraints (IK) */
+/*-----------------------------*/
+
+/**
+ * Opaque type for separation constraints in optimization IK.
+ */
+struct aa_rx_cl_ik;
+
+/**
+ * Opaque type for an IK context.
+ */
+struct aa_rx_ik_cx;
+
+/**
+ * Create minimum-separation constraints for optimization IK.
+ *
+ * Each IK constraint evaluation runs a distance check and constrains
+ * the max_pairs closest frame pairs, among pairs with a frame moved
+ * by ssg, whose separation is within d_min + margin:
+ *
+ * \f[ d_{\rm min} - d_{ij}(q) \leq 0 \f]
+ *
+ * Gradients follow from the closest points and the twist Jacobian.
+ * Evaluations update the transforms of cl, so cl must not be used
+ * concurrently with an IK solve.
+ *
+ * @param cl        collision context for the scenegraph of ssg
+ * @param ssg       sub-scenegraph solved by IK
+ * @param max_pairs number of constraints
+ * @param d_min     minimum separation distance
+ * @param margin    activation margin beyond d_min
+ *
+ * @returns the constraints, or NULL on invalid parameters
+ */
+AA_API struct aa_rx_cl_ik *
+aa_rx_cl_ik_create( struct aa_rx_cl *cl,
+                    const struct aa_rx_sg_sub *ssg,
+                    size_t max_pairs,
+                    double d_min, double margin );
+
+/**
+ * Destroy separation constraints.
+ */
+AA_API void
+aa_rx_cl_ik_destroy( struct aa_rx_cl_ik *clik );
+
+/**
+ * Add separation constraints to SQP solves of an IK context, or
+ * remove them when clik is NULL.
+ *
+ * The context must solve the same sub-scenegraph as clik.
+ *
+ * @sa aa_rx_ik_set_ineqct
+ */
+AA_API void
+aa_rx_cl_ik_attach( struct aa_rx_ik_cx *context,
+                    struct aa_rx_cl_ik *clik,
+                    double tol );
 
 #endif /*AMINO_RX_SCENE_COLLISION_H*/
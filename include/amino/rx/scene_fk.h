@@ -68,7 +68,12 @@ aa_rx_fk_malloc(const struct aa_rx_sg *scene_graph);
 AA_API void
 aa_rx_fk_cpy(struct aa_rx_fk *dst, const struct aa_rx_fk *src);
 
-/** Pointer to FK data */
+/**
+ * Pointer to FK data.
+ *
+ * In collapsed mode, only materialized frames are current; see
+ * aa_rx_fk_set_collapsed().
+ */
 AA_API double *
 aa_rx_fk_data( const struct aa_rx_fk *fk );
 
@@ -88,11 +93,76 @@ aa_rx_fk_destroy(struct aa_rx_fk * fk);
 
 /**
  * Compute the forward kinematics.
+ *
+ * After the first call, only frames below joints whose configuration
+ * changed are recomputed.
  */
 AA_API void
 aa_rx_fk_all( struct aa_rx_fk *fk,
               const struct aa_dvec *q );
 
+/**
+ * Update a single configuration variable in the forward kinematics.
+ *
+ * Only frames below the changed joint are recomputed.  Other
+ * configuration variables keep the last value given to aa_rx_fk_all(),
+ * aa_rx_fk_sub(), or aa_rx_fk_set_config().  Both aa_rx_fk_malloc()
+ * and aa_rx_fk_alloc() start all configuration variables at zero.
+ */
+AA_API void
+aa_rx_fk_set_config( struct aa_rx_fk *fk,
+                     aa_rx_config_id config_id, double value );
+
+/**
+ * Enable or disable collapsed forward kinematics.
+ *
+ * In collapsed mode, each run of fixed frames is folded into a single
+ * precomputed transform.  Only joint frames, frames with geometry,
+ * and frames passed to aa_rx_fk_materialize() are materialized, i.e.,
+ * computed on update.  Other frames are computed only by
+ * aa_rx_fk_derive().  The accessors taking a const fk, such as
+ * aa_rx_fk_ref(), aa_rx_fk_get_abs_qutr(), and aa_rx_fk_data(), never
+ * derive frames, so they return current transforms only for
+ * materialized or derived frames.
+ */
+AA_API void
+aa_rx_fk_set_collapsed( struct aa_rx_fk *fk, int collapsed );
+
+/**
+ * Always compute frame id on update, even in collapsed mode.
+ *
+ * The request persists when collapsed mode is later enabled or
+ * re-enabled.
+ */
+AA_API void
+aa_rx_fk_materialize( struct aa_rx_fk *fk, aa_rx_frame_id id );
+
+/**
+ * Compute frame id for the current configuration if it is stale in
+ * collapsed mode.  Otherwise, do nothing.
+ */
+AA_API void
+aa_rx_fk_derive( struct aa_rx_fk *fk, aa_rx_frame_id id );
+
+/**
+ * Compute the forward kinematics for many configurations at once.
+ *
+ * Results are stored in structure-of-arrays form: component k of the
+ * absolute transform of frame i for configuration j is at
+ * TF[(AA_RX_TF_LEN*i + k)*ldtf + j].
+ *
+ * @param scene_graph the scene graph
+ * @param n           number of configurations
+ * @param Q           configurations, column j is configuration j
+ * @param ldq         leading dimension of Q
+ * @param TF          output transforms, size ldtf * AA_RX_TF_LEN * frame_count
+ * @param ldtf        leading dimension of TF, at least n
+ */
+AA_API void
+aa_rx_fk_batch( const struct aa_rx_sg *scene_graph,
+                size_t n, const double *Q, size_t ldq,
+                double *TF, size_t ldtf );
+
 /**
  * Reference to internal storage for a transform
  */
@@ -81,7 +81,11 @@ enum aa_rx_ik_algo {
     AA_RX_IK_JPINV,
 
     /**
-     * Levenberg-Marquardt (unimplemented)
+     * Levenberg-Marquardt with adaptive damping.
+     *
+     * Converges when all targets are within tol_angle and tol_trans
+     * and fails after max_iterations or when the step vanishes.  The
+     * k_dls parameter scales the initial damping.
      */
     AA_RX_IK_LMA
 
@@ -273,14 +277,336 @@ aa_rx_ik_cx_create(const struct aa_rx_sg_sub *ssg, const struct aa_rx_ik_parm *p
 AA_API void
 aa_rx_ik_cx_destroy(struct aa_rx_ik_cx *cx);
 
+/**
+ * Create a copy of an IK solver context.
+ *
+ * The copy shares the sub-scenegraph and parameters but has its own
+ * start, seed, and forward kinematics, so it may be used from another
+ * thread.
+ */
+AA_API struct aa_rx_ik_cx *
+aa_rx_ik_cx_clone( const struct aa_rx_ik_cx *cx );
+
 /**
  * Run the IK solver.
+ *
+ * TF holds one target pose per column, in the order of the context's
+ * frames.  When the context solves for several end-effectors, all
+ * targets are solved jointly.
  */
 AA_API int
 aa_rx_ik_solve( const struct aa_rx_ik_cx *context,
                 const struct aa_dmat *TF,
                 struct aa_dvec *q );
 
+/**
+ * Run the IK solver for many targets.
+ *
+ * Targets are split into contiguous ranges, one per thread, and each
+ * thread solves its range with a clone of the context.  With warm
+ * starts enabled, each target is seeded from the previous solution in
+ * its range, which suits targets sampled along a path.
+ *
+ * @param context the IK context
+ * @param n_targets number of targets
+ * @param TF target poses, n_frames columns per target
+ * @param Q output configurations, one column per target
+ * @param status output IK result per target, may be NULL
+ *
+ * @returns 0 if all targets were solved, otherwise the bitwise OR of
+ * the per-target results
+ *
+ * @see aa_rx_ik_set_threads()
+ * @see aa_rx_ik_set_warm_start()
+ */
+AA_API int
+aa_rx_ik_solve_batch( const struct aa_rx_ik_cx *context,
+                      size_t n_targets,
+                      const struct aa_dmat *TF,
+                      struct aa_dmat *Q,
+                      int *status );
+
+/**
+ * Run concurrent IK solvers from several seeds and keep the first
+ * solution.
+ *
+ * One solver runs per thread, starting from the context's seed, the
+ * center configuration, and random seeds.  Each solver restarts until
+ * the restart time expires.  The first solution found stops the
+ * others.
+ *
+ * @see aa_rx_ik_set_threads()
+ * @see aa_rx_ik_set_restart_time()
+ */
+AA_API int
+aa_rx_ik_solve_race( const struct aa_rx_ik_cx *context,
+                     const struct aa_dmat *TF,
+                     struct aa_dvec *q );
+
+/**
+ * Run concurrent IK solvers and collect distinct solutions.
+ *
+ * Like aa_rx_ik_solve_race(), but each solver keeps reseeding
+ * randomly until the restart time expires or Q is full.  Solutions
+ * are sorted by distance to the start configuration.
+ *
+ * @param context the IK context
+ * @param TF target poses
+ * @param Q output configurations, one column per solution
+ *
+ * @returns the number of solutions found
+ */
+AA_API size_t
+aa_rx_ik_solve_all( const struct aa_rx_ik_cx *context,
+                    const struct aa_dmat *TF,
+                    struct aa_dmat *Q );
+
+/**
+ * Resumable real-time IK solver, opaque structure.
+ */
+struct aa_rx_ik_rt;
+
+/**
+ * Create a real-time IK solver for the context.
+ *
+ * The solver starts from the context's seed and uses its frames,
+ * weights, and tolerances.  The context must outlive the solver.
+ *
+ * Iterative steps do not allocate memory.  When the context has a
+ * closed-form solver, steps check its branches in the calling
+ * thread's local memory region, which may grow on first use.  Call
+ * aa_rx_ik_prepare() on the stepping thread beforehand so that no
+ * step allocates.
+ */
+AA_API struct aa_rx_ik_rt *
+aa_rx_ik_rt_create( const struct aa_rx_ik_cx *context );
+
+/**
+ * Destroy a real-time IK solver.
+ */
+AA_API void
+aa_rx_ik_rt_destroy( struct aa_rx_ik_rt *rt );
+
+/**
+ * Set the budget of each aa_rx_ik_rt_step().
+ *
+ * @param iterations maximum iterations per step
+ * @param seconds maximum time per step, or 0 for no limit
+ */
+AA_API void
+aa_rx_ik_rt_set_budget( struct aa_rx_ik_rt *rt, size_t iterations, double seconds );
+
+/**
+ * Restart the next step from q, or from the context's seed if NULL.
+ */
+AA_API void
+aa_rx_ik_rt_reset( struct aa_rx_ik_rt *rt, const struct aa_dvec *q );
+
+/**
+ * Continue solving toward TF within the budget.
+ *
+ * Each step resumes from the previous iterate, also when TF changes
+ * between steps.  An iteration starts only if it is predicted to
+ * finish within the time budget.  Iterations never increase the
+ * error, so q is the best configuration found so far.
+ *
+ * @param rt the real-time solver
+ * @param TF target poses
+ * @param q output configuration
+ * @param residual output norm of the weighted pose error, may be NULL
+ *
+ * @returns 0 if within tolerance, AA_RX_NO_SOLUTION | AA_RX_NO_IK if
+ * the budget expired first, the solver stalled, or q violates the
+ * context's inequality constraints
+ */
+AA_API int
+aa_rx_ik_rt_step( struct aa_rx_ik_rt *rt,
+                  const struct aa_dmat *TF,
+                  struct aa_dvec *q,
+                  double *residual );
+
+/**
+ * Geometry of a serial chain of revolute joints at the zero
+ * configuration, in the world frame.
+ */
+struct aa_rx_ik_analytic_geom {
+    size_t n_q;             ///< number of joints
+    const double *axes;     ///< unit joint axes, 3 x n_q, base to tip
+    const double *points;   ///< a point on each axis, 3 x n_q
+    double E_ee[7];         ///< end-effector pose
+};
+
+/**
+ * A closed-form IK solver for a class of kinematic structures.
+ */
+struct aa_rx_ik_analytic_type {
+    /** Name of the structure */
+    const char *name;
+
+    /** Maximum number of solution branches */
+    size_t max_solutions;
+
+    /**
+     * Return a solver for the chain, or NULL if the structure does
+     * not apply.
+     */
+    void *(*create)( const struct aa_rx_ik_analytic_geom *geom );
+
+    /**
+     * Write all solution branches for end-effector pose E into the
+     * columns of Q, n_q x max_solutions, and return their number.
+     */
+    size_t (*solve)( const void *solver, const double E[7], double *Q );
+
+    /** Release a solver */
+    void (*destroy)( void *solver );
+};
+
+/**
+ * 6R arms with a spherical wrist.
+ *
+ * Joint 1 is perpendicular to the parallel joints 2 and 3, and the
+ * last three axes intersect.  Up to eight solutions.
+ */
+AA_EXTERN const struct aa_rx_ik_analytic_type aa_rx_ik_analytic_6r_spherical;
+
+/**
+ * Planar arms with two parallel revolute joints.
+ */
+AA_EXTERN const struct aa_rx_ik_analytic_type aa_rx_ik_analytic_planar2;
+
+/**
+ * Planar arms with three parallel revolute joints.
+ */
+AA_EXTERN const struct aa_rx_ik_analytic_type aa_rx_ik_analytic_planar3;
+
+/**
+ * Register a closed-form solver type.
+ *
+ * IK contexts created afterwards try registered types, most recent
+ * first, before the built-in types.  The type must remain valid.
+ */
+AA_API void
+aa_rx_ik_analytic_register( const struct aa_rx_ik_analytic_type *type );
+
+/**
+ * Return the name of the context's closed-form solver, or NULL if no
+ * solver type applies.
+ */
+AA_API const char *
+aa_rx_ik_get_analytic( const struct aa_rx_ik_cx *context );
+
+/**
+ * Enable or disable the closed-form solver, enabled by default.
+ *
+ * When enabled and a solver type applies, aa_rx_ik_solve() returns
+ * the closed-form solution nearest the seed and uses the numeric
+ * solver only when no branch is within limits.
+ */
+AA_API void
+aa_rx_ik_set_analytic( struct aa_rx_ik_cx *context, int enable );
+
+/**
+ * Compute all closed-form solution branches within limits.
+ *
+ * @param context the IK context
+ * @param TF target pose
+ * @param Q output configurations, one column per solution
+ *
+ * @returns the number of solutions, 0 if none or if no solver applies
+ */
+AA_API size_t
+aa_rx_ik_solve_analytic( const struct aa_rx_ik_cx *context,
+                         const struct aa_dmat *TF,
+                         struct aa_dmat *Q );
+
+/**
+ * IK solution cache, opaque structure.
+ */
+struct aa_rx_ik_cache;
+
+/**
+ * Counters of an IK solution cache.
+ */
+struct aa_rx_ik_cache_stats {
+    size_t lookups;     ///< solves that queried the cache
+    size_t hits;        ///< solves seeded from the cache
+    size_t evictions;   ///< entries replaced when full
+    double time_hit;    ///< total solve time after hits, seconds
+    double time_miss;   ///< total solve time after misses, seconds
+
+    /**
+     * Estimated time saved by hits, from the difference of the mean
+     * solve times after misses and hits, seconds.
+     */
+    double time_saved;
+};
+
+/**
+ * Create an IK solution cache.
+ *
+ * The cache stores target poses with their solutions and indexes
+ * them on a grid over the position of the first target.  Lookups
+ * consider the neighboring cells, and an orientation difference of
+ * one radian counts as one cell length.
+ *
+ * @param n_q configurations of the sub-scenegraph
+ * @param n_frames targets per solve
+ * @param capacity maximum number of entries
+ * @param cell grid cell length
+ *
+ * @returns the cache, or NULL if a parameter is invalid
+ */
+AA_API struct aa_rx_ik_cache *
+aa_rx_ik_cache_create( size_t n_q, size_t n_frames, size_t capacity, double cell );
+
+/**
+ * Destroy an IK solution cache.
+ */
+AA_API void
+aa_rx_ik_cache_destroy( struct aa_rx_ik_cache *cache );
+
+/**
+ * Number of entries in the cache.
+ */
+AA_API size_t
+aa_rx_ik_cache_size( struct aa_rx_ik_cache *cache );
+
+/**
+ * Get the counters of the cache.
+ */
+AA_API void
+aa_rx_ik_cache_get_stats( struct aa_rx_ik_cache *cache,
+                          struct aa_rx_ik_cache_stats *stats );
+
+/**
+ * Write the cache entries to a binary file in host byte order.
+ */
+AA_API int
+aa_rx_ik_cache_save( struct aa_rx_ik_cache *cache, const char *filename );
+
+/**
+ * Add the entries of a file written by aa_rx_ik_cache_save().
+ *
+ * The file must match the cache's configuration and target counts.
+ */
+AA_API int
+aa_rx_ik_cache_load( struct aa_rx_ik_cache *cache, const char *filename );
+
+/**
+ * Attach a solution cache to the IK context, or detach with NULL.
+ *
+ * Each aa_rx_ik_solve() then seeds from the nearest cached solution,
+ * when there is one, instead of the context's seed, and adds its
+ * solution to the cache.  The caller keeps ownership of the cache,
+ * which is shared with clones of the context.
+ *
+ * @returns AA_RX_INVALID_PARAMETER if the cache does not match the
+ * context, 0 otherwise
+ */
+AA_API int
+aa_rx_ik_set_cache( struct aa_rx_ik_cx *context, struct aa_rx_ik_cache *cache );
+
 /**
  * Return reference to the start state used by the IK solver.
  *
@@ -337,6 +663,20 @@ aa_rx_ik_set_restart_time( struct aa_rx_ik_cx *context, double t );
 AA_API double
 aa_rx_ik_get_restart_time( struct aa_rx_ik_cx *context );
 
+/**
+ * Set the number of threads for batch solving.
+ *
+ * Zero, the default, uses one thread per online processor.
+ */
+AA_API void
+aa_rx_ik_set_threads( struct aa_rx_ik_cx *context, size_t n );
+
+/**
+ * Seed each batch target from the previous target's solution.
+ */
+AA_API void
+aa_rx_ik_set_warm_start( struct aa_rx_ik_cx *context, int warm_start );
+
 /**
  * Set the frame to solve for.
  */
@@ -349,6 +689,21 @@ aa_rx_ik_set_frame_name( struct aa_rx_ik_cx *context, const char *name );
 AA_API void
 aa_rx_ik_set_frame_id( struct aa_rx_ik_cx *context, aa_rx_frame_id id );
 
+/**
+ * Set the weight of each target frame.
+ *
+ * Weights scale each target's contribution to the IK error.  The
+ * default weight is one.
+ *
+ * @param context the IK context
+ * @param n number of weights, must equal the number of target frames
+ * @param w the weights
+ *
+ * @returns 0 on success or AA_RX_INVALID_PARAMETER on a size mismatch
+ */
+AA_API int
+aa_rx_ik_set_weights( struct aa_rx_ik_cx *context, size_t n, const double *w );
+
 /**
  * Function type for optimization objectives and contstraints.
  *
@@ -358,6 +713,7 @@ aa_rx_ik_set_frame_id( struct aa_rx_ik_cx *context, aa_rx_frame_id id );
  * @sa aa_rx_ik_opt_err_jcenter
  * @sa aa_rx_ik_opt_err_trans
  * @sa aa_rx_ik_opt_err_trans_fd
+ * @sa aa_rx_ik_opt_check_grad
  */
 typedef double aa_rx_ik_opt_fun(void *cx, const double *q, double *dq);
 
@@ -396,6 +752,46 @@ aa_rx_ik_parm_set_eqct( struct aa_rx_ik_parm *parm,
                           aa_rx_ik_opt_fun *fun,
                           double tol);
 
+/**
+ * Function type for vector inequality constraints c(q) <= 0.
+ *
+ * @param data  user data passed to aa_rx_ik_set_ineqct()
+ * @param ssg   the sub-scenegraph being solved
+ * @param fk    forward kinematics at q, for the full scenegraph
+ * @param c     constraint values, of length m
+ * @param dc    constraint gradients, n_q x m, column k is the
+ *              gradient of c[k]; NULL when not needed
+ */
+typedef void aa_rx_ik_ineqct_fun( void *data,
+                                  const struct aa_rx_sg_sub *ssg,
+                                  const struct aa_rx_fk *fk,
+                                  struct aa_dvec *c,
+                                  struct aa_dmat *dc );
+
+/**
+ * Set inequality constraints for IK.
+ *
+ * SQP solves subject to the constraints.  The other algorithms and
+ * real-time steps ignore them while iterating, but with every
+ * algorithm, solutions violating any constraint by more than tol are
+ * rejected, so restarts continue until a feasible solution is found.
+ * The closed-form solvers are skipped in aa_rx_ik_solve() while
+ * constraints are set.  Clones
+ * of the context share data, so fun must be reentrant when solving
+ * with multiple threads.
+ *
+ * @param context the IK context
+ * @param m       number of constraints
+ * @param fun     constraint function, or NULL to clear
+ * @param data    user data for fun
+ * @param tol     constraint tolerance
+ *
+ * @sa aa_rx_cl_ik_attach
+ */
+AA_API void
+aa_rx_ik_set_ineqct( struct aa_rx_ik_cx *context, size_t m,
+                     aa_rx_ik_ineqct_fun *fun, void *data, double tol );
+
 
 
 /**
@@ -410,7 +806,7 @@ aa_rx_ik_parm_set_eqct( struct aa_rx_ik_parm *parm,
  * @sa aa_rx_ik_parm_set_eqct
  */
 AA_API double
-aa_rx_ik_opt_err_dqln( void *cx, double *q, double *dq );
+aa_rx_ik_opt_err_dqln( void *cx, const double *q, double *dq );
 
 /**
  * IK workspace error (for testing only)
@@ -510,6 +906,31 @@ aa_rx_ik_opt_err_qlnpv_fd( void *cx, const double *q, double *dq );
 AA_API double
 aa_rx_ik_opt_err_jcenter( void *cx, const double *q, double *dq );
 
+/**
+ * Check the gradient of an optimization objective or constraint.
+ *
+ * Evaluates fun at q, summed over the target frames with the context
+ * weights as during SQP IK, and compares its gradient against central
+ * finite differences from aa_de_grad_fd().  User functions composed
+ * from the aa_rx_ik_opt_err_* functions may be checked the same way.
+ *
+ * @param context the IK context
+ * @param fun     objective or constraint to check
+ * @param TF      target poses, one column per target frame
+ * @param q       configuration of the sub-scenegraph
+ * @param eps     finite difference step, or 0 for the default
+ * @param err     largest gradient error, relative to the larger of one
+ *                and the largest finite-difference component
+ *
+ * @returns 0 on success or AA_RX_INVALID_PARAMETER on a size mismatch
+ */
+AA_API int
+aa_rx_ik_opt_check_grad( const struct aa_rx_ik_cx *context,
+                         aa_rx_ik_opt_fun *fun,
+                         const struct aa_dmat *TF,
+                         const struct aa_dvec *q,
+                         double eps, double *err );
+
 
 /**
  * Check an IK solution.
@@ -521,6 +942,28 @@ aa_rx_ik_check( const struct aa_rx_ik_cx *context,
                 const struct aa_dmat *TF,
                 struct aa_dvec *q_sub );
 
+/**
+ * Reserve scratch memory so that later solves do not allocate.
+ *
+ * Runs a trial solve on the calling thread, growing that thread's
+ * memory region to the peak a solve needs.  After preparing,
+ * aa_rx_ik_solve() and aa_rx_ik_check() on the same thread perform no
+ * heap allocation, as long as the context is not reconfigured and the
+ * thread's region is not otherwise left holding allocations.  Forward
+ * kinematics and Jacobian fills into caller storage never allocate.
+ *
+ * Prepared solves cover the Jacobian pseudo-inverse and
+ * Levenberg-Marquardt algorithms and closed-form solvers, without
+ * restarts or a cache.  Optimization IK, batch, concurrent, and
+ * real-time creation allocate regardless.  Call again after changing
+ * the algorithm, frames, or objective.
+ *
+ * @returns 0 on success or AA_RX_INVALID_PARAMETER for optimization
+ * IK, which always allocates
+ */
+AA_API int
+aa_rx_ik_prepare( const struct aa_rx_ik_cx *context );
+
 
 struct aa_rx_ik_jac_cx;
 
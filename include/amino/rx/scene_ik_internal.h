@@ -40,6 +40,9 @@
 #include "scene_wk_internal.h"
 #include "scene_ik.h"
 
+/** Chain-local kinematic instruction, see scene_kin.c */
+struct aa_rx_sg_sub_op;
+
 struct aa_rx_sg_sub
 {
     const struct aa_rx_sg *scenegraph;
@@ -51,6 +54,25 @@ struct aa_rx_sg_sub
 
     size_t ee_count;
     aa_rx_frame_id *ees;
+
+    /** Number of ranges in the moved set */
+    size_t moved_count;
+    /**
+     * Frames moved by the configurations of the sub-scenegraph, as
+     * half-open ranges of frame ids [moved[2*i], moved[2*i+1]).
+     */
+    size_t *moved;
+
+    /** Number of instructions in the chain-local table */
+    size_t op_count;
+    /** Chain-local table, ending with the end-effector */
+    struct aa_rx_sg_sub_op *ops;
+    /** Index in ops of each end-effector, or SIZE_MAX */
+    size_t *ee_ops;
+    /** Start of each end-effector's entries in ee_configs, ee_count+1 */
+    size_t *ee_config_ptr;
+    /** Ascending sub-configurations that move each end-effector */
+    size_t *ee_configs;
 };
 
 
@@ -178,8 +200,76 @@ struct aa_rx_ik_cx
     aa_rx_frame_id *frames;
     size_t n_frames;
 
+    double *weights;
+
+    size_t threads;
+    int warm_start;
+
+    /** Shared state of concurrent starts, or NULL */
+    struct aa_rx_ik_race *race;
+
+    /** Solution cache, not owned, or NULL */
+    struct aa_rx_ik_cache *cache;
+
+    /** Closed-form solver for the chain, or NULL */
+    const struct aa_rx_ik_analytic_type *analytic_type;
+    void *analytic;
+    int analytic_disabled;
+
+    /** Inequality constraints for optimization IK, data not owned */
+    aa_rx_ik_ineqct_fun *ineqct_fun;
+    void *ineqct_data;
+    size_t ineqct_count;
+    double ineqct_tol;
 };
 
+/**
+ * Find a closed-form solver for the context's chain, replacing any
+ * previous one.
+ */
+AA_API void
+aa_rx_ik_analytic_detect( struct aa_rx_ik_cx *cx );
+
+/**
+ * Release the context's closed-form solver.
+ */
+AA_API void
+aa_rx_ik_analytic_destroy( struct aa_rx_ik_cx *cx );
+
+/**
+ * Closed-form solution nearest to q_seed.
+ */
+AA_API int
+aa_rx_ik_analytic_nearest( const struct aa_rx_ik_cx *context,
+                           const struct aa_dmat *TF,
+                           const struct aa_dvec *q_seed,
+                           struct aa_dvec *q );
+
+/**
+ * Seed q from the nearest cached solution to TF.
+ *
+ * @returns 1 on a cache hit, 0 otherwise
+ */
+AA_API int
+aa_rx_ik_cache_seed( struct aa_rx_ik_cache *cache,
+                     const struct aa_dmat *TF,
+                     struct aa_dvec *q );
+
+/**
+ * Add a solution to the cache, evicting the least recently used
+ * entry when full.
+ */
+AA_API void
+aa_rx_ik_cache_insert( struct aa_rx_ik_cache *cache,
+                       const struct aa_dmat *TF,
+                       const struct aa_dvec *q );
+
+/**
+ * Account the time of a solve after a cache lookup.
+ */
+AA_API void
+aa_rx_ik_cache_record( struct aa_rx_ik_cache *cache, int hit, double seconds );
+
 typedef int (*rfx_kin_duqu_fun) ( const void *cx, const double *q, double S[8],  double *J);
 
 struct kin_solve_cx {
@@ -191,6 +281,8 @@ struct kin_solve_cx {
     const struct aa_rx_sg_sub *ssg;
 
     const struct aa_dmat *TF_ref;
+    const struct aa_dmat *TF_all;
+    struct aa_dmat TF_col;
 
     size_t iteration;
 
@@ -201,6 +293,11 @@ struct kin_solve_cx {
 
 
     aa_rx_frame_id frame;
+    size_t i_target;
+
+    size_t n_frames;
+    const aa_rx_frame_id *frames;
+    const double *weights;
 };
 
 
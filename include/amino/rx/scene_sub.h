@@ -126,6 +126,46 @@ aa_rx_sg_sub_frame_ee_count( const struct aa_rx_sg_sub *sg_sub);
 AA_API aa_rx_frame_id*
 aa_rx_sg_sub_frame_ees( const struct aa_rx_sg_sub *sg_sub );
 
+/**
+ * Return the number of frame id ranges moved by the sub-scenegraph.
+ */
+AA_API size_t
+aa_rx_sg_sub_moved_count( const struct aa_rx_sg_sub *ssg );
+
+/**
+ * Return the frame ranges moved by the sub-scenegraph.
+ *
+ * The moved set contains every joint frame of the sub-scenegraph's
+ * configurations and all of their descendants, as half-open ranges
+ * of frame ids [r[2*i], r[2*i+1]) in increasing order.
+ */
+AA_API const size_t *
+aa_rx_sg_sub_moved( const struct aa_rx_sg_sub *ssg );
+
+/**
+ * Return the number of sub-scenegraph configurations that move
+ * end-effector k.
+ */
+AA_API size_t
+aa_rx_sg_sub_ee_config_count( const struct aa_rx_sg_sub *ssg, size_t k );
+
+/**
+ * Return the sub-scenegraph configurations that move end-effector k.
+ *
+ * These are the indices of the ancestor joints of the end-effector
+ * in increasing order, i.e., the nonzero columns of its Jacobian.
+ */
+AA_API const size_t *
+aa_rx_sg_sub_ee_configs( const struct aa_rx_sg_sub *ssg, size_t k );
+
+/**
+ * Return the number of doubles in a packed end-effector Jacobian.
+ *
+ * @see aa_rx_sg_sub_fk_jac_twist_ees_packed()
+ */
+AA_API size_t
+aa_rx_sg_sub_ees_jac_packed_size( const struct aa_rx_sg_sub *ssg );
+
 /**
  * Return the array of full scenegraph config ids contained in the sub-scenegraph.
  */
@@ -171,11 +211,27 @@ aa_rx_sg_sub_config_gather( const struct aa_rx_sg_sub *ssg,
 
 /**
  * Create a sub-scenegraph for the kinematic chain starting at root and ending a tip.
+ *
+ * @return the sub-scenegraph, or NULL if tip is not a frame of the chain
  */
 AA_API struct aa_rx_sg_sub *
 aa_rx_sg_chain_create( const struct aa_rx_sg *sg,
                        aa_rx_frame_id root, aa_rx_frame_id tip );
 
+/**
+ * Create a sub-scenegraph for the tree of chains starting at root and
+ * ending at each of the tips.
+ *
+ * The tips become the end-effectors of the sub-scenegraph.
+ *
+ * @return the sub-scenegraph, or NULL if any tip is not a frame of the
+ *         chains, e.g., a tip equal to root
+ */
+AA_API struct aa_rx_sg_sub *
+aa_rx_sg_multiple_chain_create( const struct aa_rx_sg *sg,
+                                aa_rx_frame_id root, size_t n_tips,
+                                aa_rx_frame_id* tips);
+
 
 /**
  * Fill q with the centered positions of each configuration.
@@ -310,6 +366,197 @@ aa_rx_sg_sub_jac_vel_fill( const struct aa_rx_sg_sub *ssg,
                            const struct aa_rx_fk *fk,
                            struct aa_dmat *J );
 
+/**
+ * Compute the end-effector pose and twist Jacobian in one pass.
+ *
+ * Chain transforms are computed from q_sub using the sub-scenegraph's
+ * chain-local table of folded joint instructions.  Only the
+ * transforms of joints above the chain are read from fk, and fk is
+ * not modified.
+ *
+ * @param[in] ssg the sub-scenegraph
+ * @param[in] fk forward kinematics for frames above the chain
+ * @param[in] q_sub sub-scenegraph configuration
+ * @param[out] E_ee pose of aa_rx_sg_sub_fk_jac_frame(), may be NULL
+ * @param[out] J 6 x n twist Jacobian, or NULL to compute only the pose
+ */
+AA_API void
+aa_rx_sg_sub_fk_jac_twist( const struct aa_rx_sg_sub *ssg,
+                           const struct aa_rx_fk *fk,
+                           const struct aa_dvec *q_sub,
+                           double *E_ee, struct aa_dmat *J );
+
+/**
+ * Compute the end-effector pose and velocity Jacobian in one pass.
+ *
+ * @see aa_rx_sg_sub_fk_jac_twist()
+ */
+AA_API void
+aa_rx_sg_sub_fk_jac_vel( const struct aa_rx_sg_sub *ssg,
+                         const struct aa_rx_fk *fk,
+                         const struct aa_dvec *q_sub,
+                         double *E_ee, struct aa_dmat *J );
+
+/**
+ * Compute end-effector poses and the stacked twist Jacobian for all
+ * end-effectors of the sub-scenegraph in one pass.
+ *
+ * Joint transforms shared by several end-effectors are computed once.
+ * Block k of J (rows 6*k to 6*k+5) is the Jacobian of end-effector k;
+ * columns of joints that are not ancestors of that end-effector are
+ * zero.
+ *
+ * @param[in] ssg the sub-scenegraph
+ * @param[in] fk forward kinematics for frames above the sub-scenegraph
+ * @param[in] q_sub sub-scenegraph configuration
+ * @param[out] E_ees pose of each end-effector, may be NULL
+ * @param[in] ld_E leading dimension of E_ees
+ * @param[out] J 6*k x n stacked Jacobian, or NULL to compute only poses
+ */
+AA_API void
+aa_rx_sg_sub_fk_jac_twist_ees( const struct aa_rx_sg_sub *ssg,
+                               const struct aa_rx_fk *fk,
+                               const struct aa_dvec *q_sub,
+                               double *E_ees, size_t ld_E,
+                               struct aa_dmat *J );
+
+/**
+ * Compute end-effector poses and the stacked velocity Jacobian.
+ *
+ * @see aa_rx_sg_sub_fk_jac_twist_ees()
+ */
+AA_API void
+aa_rx_sg_sub_fk_jac_vel_ees( const struct aa_rx_sg_sub *ssg,
+                             const struct aa_rx_fk *fk,
+                             const struct aa_dvec *q_sub,
+                             double *E_ees, size_t ld_E,
+                             struct aa_dmat *J );
+
+/**
+ * Compute end-effector poses and the packed twist Jacobian.
+ *
+ * The packed Jacobian stores only the structurally nonzero columns.
+ * Block k is a 6 x aa_rx_sg_sub_ee_config_count(ssg,k) column-major
+ * matrix for the columns aa_rx_sg_sub_ee_configs(ssg,k), and the
+ * blocks are stored consecutively.
+ *
+ * @param[out] J packed Jacobian of aa_rx_sg_sub_ees_jac_packed_size()
+ *               doubles, or NULL to compute only poses
+ *
+ * @see aa_rx_sg_sub_fk_jac_twist_ees()
+ */
+AA_API void
+aa_rx_sg_sub_fk_jac_twist_ees_packed( const struct aa_rx_sg_sub *ssg,
+                                      const struct aa_rx_fk *fk,
+                                      const struct aa_dvec *q_sub,
+                                      double *E_ees, size_t ld_E,
+                                      double *J );
+
+/**
+ * Compute end-effector poses and the packed velocity Jacobian.
+ *
+ * @see aa_rx_sg_sub_fk_jac_twist_ees_packed()
+ */
+AA_API void
+aa_rx_sg_sub_fk_jac_vel_ees_packed( const struct aa_rx_sg_sub *ssg,
+                                    const struct aa_rx_fk *fk,
+                                    const struct aa_dvec *q_sub,
+                                    double *E_ees, size_t ld_E,
+                                    double *J );
+
+/**
+ * Compute twist Jacobians for many configurations.
+ *
+ * Each Jacobian is evaluated with the one-pass kernel of
+ * aa_rx_sg_sub_fk_jac_twist() without allocating.  Optionally also
+ * computes manipulability, sqrt(det(J J^T)), and the smallest singular
+ * value of each Jacobian from the eigenvalues of the 6 x 6 (or n x n
+ * for chains with fewer than six joints) Gram matrix.
+ *
+ * @param[in] ssg the sub-scenegraph
+ * @param[in] fk forward kinematics for frames above the chain
+ * @param[in] n number of configurations
+ * @param[in] Q sub-scenegraph configurations, one per column
+ * @param[in] ldq leading dimension of Q
+ * @param[out] J 6 x n_q column-major Jacobians, one per configuration
+ * @param[in] ldj distance between consecutive Jacobians, at least 6*n_q
+ * @param[out] manip manipulability of each Jacobian, may be NULL
+ * @param[out] s_min smallest singular value of each Jacobian, may be NULL
+ */
+AA_API void
+aa_rx_sg_sub_jac_twist_batch( const struct aa_rx_sg_sub *ssg,
+                              const struct aa_rx_fk *fk,
+                              size_t n, const double *Q, size_t ldq,
+                              double *J, size_t ldj,
+                              double *manip, double *s_min );
+
+/**
+ * Compute the time derivative of the twist Jacobian.
+ *
+ * Computed analytically from the twist Jacobian: column j of J_dot is
+ * the Lie bracket of the twist contributed by the ancestors of joint j
+ * with column j.
+ *
+ * @param[in] ssg the sub-scenegraph
+ * @param[in] fk forward kinematics for frames above the chain
+ * @param[in] q_sub sub-scenegraph configuration
+ * @param[in] dq_sub sub-scenegraph joint velocity
+ * @param[out] J 6 x n twist Jacobian, may be NULL
+ * @param[out] J_dot 6 x n time derivative of J
+ */
+AA_API void
+aa_rx_sg_sub_jac_twist_dot( const struct aa_rx_sg_sub *ssg,
+                            const struct aa_rx_fk *fk,
+                            const struct aa_dvec *q_sub, const struct aa_dvec *dq_sub,
+                            struct aa_dmat *J, struct aa_dmat *J_dot );
+
+/**
+ * Compute the time derivative of the velocity Jacobian.
+ *
+ * @see aa_rx_sg_sub_jac_twist_dot()
+ */
+AA_API void
+aa_rx_sg_sub_jac_vel_dot( const struct aa_rx_sg_sub *ssg,
+                          const struct aa_rx_fk *fk,
+                          const struct aa_dvec *q_sub, const struct aa_dvec *dq_sub,
+                          struct aa_dmat *J, struct aa_dmat *J_dot );
+
+/**
+ * Compute the kinematic Hessian of the twist Jacobian.
+ *
+ * H holds n contiguous 6 x n column-major matrices; matrix i is the
+ * partial derivative of the Jacobian with respect to configuration i,
+ * so the derivative of column j is at H + 6*(j + n*i).
+ *
+ * @param[in] ssg the sub-scenegraph
+ * @param[in] fk forward kinematics for frames above the chain
+ * @param[in] q_sub sub-scenegraph configuration
+ * @param[out] H 6 x n x n Hessian
+ */
+AA_API void
+aa_rx_sg_sub_jac_twist_hess( const struct aa_rx_sg_sub *ssg,
+                             const struct aa_rx_fk *fk,
+                             const struct aa_dvec *q_sub,
+                             double *H );
+
+/**
+ * Compute the kinematic Hessian of the velocity Jacobian.
+ *
+ * @see aa_rx_sg_sub_jac_twist_hess()
+ */
+AA_API void
+aa_rx_sg_sub_jac_vel_hess( const struct aa_rx_sg_sub *ssg,
+                           const struct aa_rx_fk *fk,
+                           const struct aa_dvec *q_sub,
+                           double *H );
+
+/**
+ * Return the end-effector frame of the one-pass kernels: the last
+ * frame of the sub-scenegraph.
+ */
+AA_API aa_rx_frame_id
+aa_rx_sg_sub_fk_jac_frame( const struct aa_rx_sg_sub *ssg );
+
 
 
 
@@ -339,6 +586,13 @@ aa_rx_sg_sub_expand_path( const struct aa_rx_sg_sub *ssg, size_t n_pts,
 
 /**
  * Compute the forward kinematics for the sub-scenegraph.
+ *
+ * Only frames in the moved set, see aa_rx_sg_sub_moved(), are
+ * recomputed.  Frames below the sub-scenegraph may also depend on
+ * configurations outside it; those take the value stored in fk, i.e.,
+ * the last value given to aa_rx_fk_all(), aa_rx_fk_sub(), or
+ * aa_rx_fk_set_config(), or zero for a new fk.  Set the full
+ * configuration with aa_rx_fk_all() before the first call.
  */
 AA_API void
 aa_rx_fk_sub( struct aa_rx_fk *fk,
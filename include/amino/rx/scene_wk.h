@@ -117,6 +117,97 @@ aa_rx_wk_dx2dq_np( const struct aa_rx_sg_sub *ssg,
                    const struct aa_dvec *dx, const struct aa_dvec *dq_r,
                    struct aa_dvec *dq );
 
+/**
+ * Convert workspace (Cartesian) velocity to joint velocity, given
+ * the velocity Jacobian.
+ *
+ * @see aa_rx_sg_sub_fk_jac_vel()
+ *
+ * @param[in] opts workspace control options
+ * @param[in] J velocity Jacobian
+ * @param[in] dx reference workspace velocity
+ * @param[in] dq_r reference joint velocity (nullspace projected), or NULL
+ * @param[out] dq computed reference joint velocity
+ */
+AA_API int
+aa_rx_wk_jdx2dq( const struct aa_rx_wk_opts * opts,
+                 const struct aa_dmat *J,
+                 const struct aa_dvec *dx, const struct aa_dvec *dq_r,
+                 struct aa_dvec *dq );
+
+/**
+ * Convert stacked end-effector velocities to joint velocity, given
+ * the packed Jacobian.
+ *
+ * Equivalent to aa_rx_wk_jdx2dq() on the dense stacked Jacobian, but
+ * skips the structural zeros of branching sub-scenegraphs.
+ *
+ * @see aa_rx_sg_sub_fk_jac_vel_ees_packed()
+ *
+ * @param[in] ssg the sub-scenegraph
+ * @param[in] opts workspace control options
+ * @param[in] J packed velocity Jacobian
+ * @param[in] dx stacked reference workspace velocities
+ * @param[in] dq_r reference joint velocity (nullspace projected), or NULL
+ * @param[out] dq computed reference joint velocity
+ */
+AA_API int
+aa_rx_wk_jdx2dq_ees( const struct aa_rx_sg_sub *ssg,
+                     const struct aa_rx_wk_opts * opts,
+                     const double *J,
+                     const struct aa_dvec *dx, const struct aa_dvec *dq_r,
+                     struct aa_dvec *dq );
+
+/**
+ * @struct aa_rx_wk_prio_cx;
+ *
+ * Opaque context struct for task-priority control.
+ */
+struct aa_rx_wk_prio_cx;
+
+/**
+ * Create a task-priority control context.
+ *
+ * Workspace for all priority levels is allocated here.
+ *
+ * @param opts workspace control options, copied
+ * @param n_q number of joints
+ * @param n_tasks number of priority levels
+ * @param rows rows of each level's Jacobian, highest priority first
+ */
+AA_API struct aa_rx_wk_prio_cx *
+aa_rx_wk_prio_create( const struct aa_rx_wk_opts *opts,
+                      size_t n_q, size_t n_tasks, const size_t *rows );
+
+/**
+ * Destroy a task-priority control context.
+ */
+AA_API void
+aa_rx_wk_prio_destroy( struct aa_rx_wk_prio_cx *cx );
+
+/**
+ * Convert prioritized task velocities to joint velocity.
+ *
+ * Each level is solved in the null space of all higher levels, using
+ * one SVD per level for both the damped pseudo-inverse and the
+ * null-space update.  Finally, dq_r is projected into the null space
+ * of all levels.  With one level, this is equivalent to
+ * aa_rx_wk_jdx2dq().
+ *
+ * @param[in,out] cx task-priority context, whose workspace this call
+ *                   overwrites; use one context per thread
+ * @param[in] J stacked task Jacobians, highest priority first
+ * @param[in] dx stacked task velocities
+ * @param[in] dq_r reference joint velocity (nullspace projected), or NULL
+ * @param[out] dq computed reference joint velocity
+ *
+ * @returns 0 on success, nonzero if a decomposition failed
+ */
+AA_API int
+aa_rx_wk_jdx2dq_prio( struct aa_rx_wk_prio_cx *cx,
+                      const struct aa_dmat *J,
+                      const struct aa_dvec *dx, const struct aa_dvec *dq_r,
+                      struct aa_dvec *dq );
 
 /**
  * @struct aa_rx_wk_lc3_cx;
@@ -131,13 +222,50 @@ aa_rx_wk_dx2dq_np( const struct aa_rx_sg_sub *ssg,
  */
 struct aa_rx_wk_lc3_cx;
 
+/**
+ * Create an LC3 context.
+ *
+ * The context keeps its LP solver between calls to
+ * aa_rx_wk_dx2dq_lc3(), so each call updates only the parts of the LP
+ * that changed and re-solves from the previous basis.
+ */
 AA_API  struct aa_rx_wk_lc3_cx *
 aa_rx_wk_lc3_create ( const struct aa_rx_sg_sub *ssg,
                       const struct aa_rx_wk_opts * opts );
 
+/**
+ * Destroy an LC3 context.
+ */
+AA_API void
+aa_rx_wk_lc3_destroy( struct aa_rx_wk_lc3_cx *lc3 );
+
+/**
+ * Counters and timing of an LC3 context.
+ */
+struct aa_rx_wk_lc3_stats {
+    size_t ticks;           ///< calls to aa_rx_wk_dx2dq_lc3()
+    size_t matrix_updates;  ///< ticks that changed the constraint matrix
+    double time_tick;       ///< time of the last tick, seconds
+    double time_solve;      ///< LP solve time of the last tick, seconds
+    double time_tick_max;   ///< longest tick, seconds
+};
+
+/**
+ * Get the counters and timing of an LC3 context.
+ */
+AA_API void
+aa_rx_wk_lc3_get_stats( const struct aa_rx_wk_lc3_cx *lc3,
+                        struct aa_rx_wk_lc3_stats *stats );
 
+/**
+ * Compute joint velocity using LC3.
+ *
+ * The Jacobian is computed from q_a; fk supplies only the transforms
+ * of frames above the sub-scenegraph.  Each call updates the LP and
+ * statistics held in lc3, so a context serves one thread at a time.
+ */
 AA_API int
-aa_rx_wk_dx2dq_lc3( const struct aa_rx_wk_lc3_cx *lc3,
+aa_rx_wk_dx2dq_lc3( struct aa_rx_wk_lc3_cx *lc3,
                     double dt,
                     const struct aa_rx_fk *fk,
                     const struct aa_dvec *dx_r,
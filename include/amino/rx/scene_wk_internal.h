@@ -61,17 +61,12 @@ struct aa_rx_wk_opts {
 };
 
 static inline int
-aa_rx_wk_get_js( const struct aa_rx_sg_sub *ssg,
-                 const struct aa_rx_wk_opts * opts,
-                 //const struct aa_dmat *TF_abs,
-                 const struct aa_rx_fk *fk,
-                 struct aa_dmat *J,
-                 struct aa_dmat *Jstar )
+aa_rx_wk_get_jstar( const struct aa_rx_wk_opts * opts,
+                    const struct aa_dmat *J,
+                    struct aa_dmat *Jstar )
 {
     int r = -1;
 
-    aa_rx_sg_sub_jac_vel_fill(ssg,fk,J);
-
     // Compute a damped pseudo inverse
     // TODO: Try DGECON to avoid damping when possible without taking the SVD
     if( opts->s2min > 0 ) {
@@ -86,6 +81,18 @@ aa_rx_wk_get_js( const struct aa_rx_sg_sub *ssg,
     return r;
 }
 
+static inline int
+aa_rx_wk_get_js( const struct aa_rx_sg_sub *ssg,
+                 const struct aa_rx_wk_opts * opts,
+                 //const struct aa_dmat *TF_abs,
+                 const struct aa_rx_fk *fk,
+                 struct aa_dmat *J,
+                 struct aa_dmat *Jstar )
+{
+    aa_rx_sg_sub_jac_vel_fill(ssg,fk,J);
+    return aa_rx_wk_get_jstar(opts, J, Jstar);
+}
+
 static inline int
 aa_rx_wk_get_n( const struct aa_rx_sg_sub *ssg,
                 const struct aa_rx_wk_opts * opts,
@@ -68,12 +68,169 @@ struct aa_rx_inertial {
 struct aa_rx_fk {
     const struct aa_rx_sg *sg;
     double *TF_abs;
+    double *q;          ///< configuration of TF_abs
+    aa_bits *dirty;     ///< frames pending recomputation
+    aa_bits *lazy;      ///< frames derived on request (collapsed mode)
+    aa_bits *stale;     ///< lazy frames not yet derived
+    aa_bits *materialized; ///< frames passed to aa_rx_fk_materialize()
     int in_heap;
+    int q_valid;        ///< whether TF_abs is current for q
+    int collapsed;      ///< whether to use the folded kinematic program
 };
 
+/**
+ * Raw reference to the transform of frame id.
+ *
+ * In collapsed mode, this is only current for frames that are not stale.
+ */
 #define AA_RX_FK_REF(fk, id)                    \
     ( (fk)->TF_abs + (AA_RX_FK_LD * (id)) )
 
+
+/**
+ * Opcodes for the compiled kinematic program.
+ */
+enum aa_rx_kin_opcode {
+    AA_RX_KIN_FIXED,        ///< fixed relative transform
+    AA_RX_KIN_REVOLUTE_X,   ///< revolute about the (signed) x axis
+    AA_RX_KIN_REVOLUTE_Y,   ///< revolute about the (signed) y axis
+    AA_RX_KIN_REVOLUTE_Z,   ///< revolute about the (signed) z axis
+    AA_RX_KIN_REVOLUTE,     ///< revolute about an arbitrary axis
+    AA_RX_KIN_PRISMATIC     ///< prismatic along an arbitrary axis
+};
+
+/**
+ * One instruction of the compiled kinematic program.
+ *
+ * The program holds one instruction per frame, indexed by frame id,
+ * so parents always precede their children.
+ */
+struct aa_rx_kin_op {
+    double E[AA_RX_TF_LEN];     ///< fixed part of the relative transform
+    double axis[3];             ///< joint axis, in the joint frame
+    double axis_v[3];           ///< prismatic axis, in the parent frame
+    double offset;              ///< joint offset
+    size_t config;              ///< configuration index of the joint
+    aa_rx_frame_id parent;      ///< parent frame id
+    enum aa_rx_kin_opcode code; ///< instruction type
+};
+
+/**
+ * Return the compiled kinematic program for the scene graph.
+ */
+AA_API const struct aa_rx_kin_op *
+aa_rx_sg_kin_prog( const struct aa_rx_sg *scene_graph );
+
+/**
+ * Return the folded kinematic program for the scene graph.
+ *
+ * Runs of fixed frames are folded into their descendants, so the
+ * parent of each instruction is a joint frame or the root.
+ */
+AA_API const struct aa_rx_kin_op *
+aa_rx_sg_kin_fold( const struct aa_rx_sg *scene_graph );
+
+/**
+ * Sine and cosine of the half angle of a specialized revolute
+ * instruction, with the sign of the axis folded into the sine.
+ */
+static inline void
+aa_rx_kin_op_sc( const struct aa_rx_kin_op *op, const double *q,
+                 size_t axis, double *s, double *c )
+{
+    double qo = (q[op->config] + op->offset) / 2;
+    *s = op->axis[axis] * sin(qo);
+    *c = cos(qo);
+}
+
+/**
+ * Compute the relative transform for a kinematic instruction.
+ */
+static inline void
+aa_rx_kin_op_rel( const struct aa_rx_kin_op *op, const double *q,
+                  double E_rel[AA_RX_TF_LEN] )
+{
+    const double *a = op->E + AA_TF_QUTR_Q;
+    double *r = E_rel + AA_TF_QUTR_Q;
+    double s, c;
+
+    switch( op->code ) {
+    case AA_RX_KIN_FIXED:
+        AA_MEM_CPY( E_rel, op->E, AA_RX_TF_LEN );
+        return;
+    case AA_RX_KIN_PRISMATIC: {
+        double qo = q[op->config] + op->offset;
+        AA_MEM_CPY( r, a, 4 );
+        for( size_t i = 0; i < 3; i ++ ) {
+            E_rel[AA_TF_QUTR_V+i] = op->E[AA_TF_QUTR_V+i] + qo*op->axis_v[i];
+        }
+        return;
+    }
+    case AA_RX_KIN_REVOLUTE_X:
+        aa_rx_kin_op_sc( op, q, 0, &s, &c );
+        r[AA_TF_QUAT_X] = a[AA_TF_QUAT_W]*s + a[AA_TF_QUAT_X]*c;
+        r[AA_TF_QUAT_Y] = a[AA_TF_QUAT_Y]*c + a[AA_TF_QUAT_Z]*s;
+        r[AA_TF_QUAT_Z] = a[AA_TF_QUAT_Z]*c - a[AA_TF_QUAT_Y]*s;
+        r[AA_TF_QUAT_W] = a[AA_TF_QUAT_W]*c - a[AA_TF_QUAT_X]*s;
+        break;
+    case AA_RX_KIN_REVOLUTE_Y:
+        aa_rx_kin_op_sc( op, q, 1, &s, &c );
+        r[AA_TF_QUAT_X] = a[AA_TF_QUAT_X]*c - a[AA_TF_QUAT_Z]*s;
+        r[AA_TF_QUAT_Y] = a[AA_TF_QUAT_W]*s + a[AA_TF_QUAT_Y]*c;
+        r[AA_TF_QUAT_Z] = a[AA_TF_QUAT_Z]*c + a[AA_TF_QUAT_X]*s;
+        r[AA_TF_QUAT_W] = a[AA_TF_QUAT_W]*c - a[AA_TF_QUAT_Y]*s;
+        break;
+    case AA_RX_KIN_REVOLUTE_Z:
+        aa_rx_kin_op_sc( op, q, 2, &s, &c );
+        r[AA_TF_QUAT_X] = a[AA_TF_QUAT_X]*c + a[AA_TF_QUAT_Y]*s;
+        r[AA_TF_QUAT_Y] = a[AA_TF_QUAT_Y]*c - a[AA_TF_QUAT_X]*s;
+        r[AA_TF_QUAT_Z] = a[AA_TF_QUAT_W]*s + a[AA_TF_QUAT_Z]*c;
+        r[AA_TF_QUAT_W] = a[AA_TF_QUAT_W]*c - a[AA_TF_QUAT_Z]*s;
+        break;
+    case AA_RX_KIN_REVOLUTE: {
+        double h[4];
+        aa_tf_axang2quat2( op->axis, q[op->config] + op->offset, h );
+        aa_tf_qmul( a, h, r );
+        break;
+    }
+    }
+    /* revolute: translation is fixed */
+    AA_MEM_CPY( E_rel+AA_TF_QUTR_V, op->E+AA_TF_QUTR_V, 3 );
+}
+
+/**
+ * Chain a relative transform onto its parent's absolute transform.
+ */
+static inline void
+aa_rx_kin_op_abs( const struct aa_rx_kin_op *op,
+                  const double *TF_abs, size_t ld_abs,
+                  const double E_rel[AA_RX_TF_LEN], double E_abs[AA_RX_TF_LEN] )
+{
+    if( op->parent < 0 ) {
+        AA_MEM_CPY( E_abs, E_rel, AA_RX_TF_LEN );
+    } else {
+        aa_tf_qutr_mul( TF_abs + ld_abs*(size_t)op->parent, E_rel, E_abs );
+    }
+}
+
+/**
+ * Recompute the frames in the half-open ranges [ranges[2*i], ranges[2*i+1]).
+ *
+ * The ranges must be in increasing order and closed under descendants.
+ * If fk is not yet valid, all frames are recomputed.
+ */
+AA_API void
+aa_rx_fk_update_ranges( struct aa_rx_fk *fk,
+                        size_t n_ranges, const size_t *ranges );
+
+/**
+ * Run the compiled kinematic program for frames [0,n).
+ */
+AA_API void
+aa_rx_kin_prog_fk( const struct aa_rx_kin_op *prog, size_t n,
+                   const double *q,
+                   double *TF_abs, size_t ld_abs );
+
 #ifdef __cplusplus
 
 #include <vector>
@@ -207,6 +364,16 @@ struct SceneGraph  {
     std::vector<size_t> allowed_indices1;
     std::vector<size_t> allowed_indices2;
 
+    /** Compiled kinematic program, one instruction per frame */
+    std::vector<struct aa_rx_kin_op> kin_prog;
+
+    /**
+     * Kinematic program with runs of fixed frames folded into a
+     * single transform.  Each instruction's parent is a joint frame
+     * or the root.
+     */
+    std::vector<struct aa_rx_kin_op> kin_fold;
+
     void (*destructor)(void *);
     void *destructor_context;
 
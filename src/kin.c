@@ -66,3 +66,45 @@ AA_API int aa_kin_planar2_ik_theta2( const double l[2],
              aa_feq( l1*cos(theta_b[0]) + l2*cos(theta_b[1]), x1, .001 ) &&
              aa_feq( l1*sin(theta_b[0]) + l2*sin(theta_b[1]), x2, .001 ) );
 }
+
+AA_API int aa_kin_planar2_ik( const double l[2],
+                              const double x[2],
+                              double q_a[2],
+                              double q_b[2] ) {
+    const double l1=l[0], l2=l[1];
+    if( !(l1 > 0 && l2 > 0) ) return -1;
+
+    // law of cosines for the elbow
+    double c = (x[0]*x[0] + x[1]*x[1] - l1*l1 - l2*l2) / (2*l1*l2);
+    int r = 0;
+    if( c > 1 ) {
+        c = 1;
+        r = -1;
+    } else if( c < -1 ) {
+        c = -1;
+        r = -1;
+    }
+    double s = sqrt(1 - c*c);
+    double phi = atan2(x[1], x[0]);
+    double beta = atan2(l2*s, l1 + l2*c);
+
+    q_a[0] = phi - beta;
+    q_a[1] = atan2(s, c);
+    q_b[0] = phi + beta;
+    q_b[1] = -q_a[1];
+
+    return r;
+}
+
+AA_API int aa_kin_planar3_ik( const double l[3],
+                              const double x[3],
+                              double q_a[3],
+                              double q_b[3] ) {
+    // wrist point
+    double w[2] = {x[0] - l[2]*cos(x[2]),
+                   x[1] - l[2]*sin(x[2])};
+    int r = aa_kin_planar2_ik( l, w, q_a, q_b );
+    q_a[2] = x[2] - q_a[0] - q_a[1];
+    q_b[2] = x[2] - q_b[0] - q_b[1];
+    return r;
+}
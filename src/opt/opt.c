@@ -99,6 +99,13 @@ aa_opt_set_cstr_gm( struct aa_opt_cx *cx,
                                   b_min, b_max );
 }
 
+AA_API int
+aa_opt_set_cstr_bnd( struct aa_opt_cx *cx, size_t m,
+                     const double *b_min, const double *b_max )
+{
+    return cx->vtab->set_cstr_bnd( cx, m, b_min, b_max );
+}
+
 AA_API struct aa_opt_cx* aa_opt_gmcreate (
     enum aa_opt_lp_solver solver,
     size_t m, size_t n,
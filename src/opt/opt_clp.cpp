@@ -54,8 +54,9 @@ int s_solve( struct aa_opt_cx *cx, size_t n, double *x )
     int r;
 
 
+    /* Re-solves start from the previous basis */
     try {
-        r = M->initialSolve();
+        r = M->statusExists() ? M->dual() : M->initialSolve();
     } catch (CoinError e) {
         e.print();
         return -1;
@@ -218,7 +219,8 @@ static struct aa_opt_vtab s_vtab = {
     .set_type = s_set_type,
     .set_obj = s_set_obj,
     .set_bnd = s_set_bnd,
-    .set_cstr_gm = s_set_cstr_gm
+    .set_cstr_gm = s_set_cstr_gm,
+    .set_cstr_bnd = s_set_cstr_bnd
 };
 
 
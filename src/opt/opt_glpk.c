@@ -257,7 +257,8 @@ static struct aa_opt_vtab s_vtab = {
     .set_type = s_set_type,
     .set_obj = s_set_obj,
     .set_bnd = s_set_bnd,
-    .set_cstr_gm = s_set_cstr_gm
+    .set_cstr_gm = s_set_cstr_gm,
+    .set_cstr_bnd = s_set_cstr_bnd
 };
 
 AA_API struct aa_opt_cx *
@@ -128,6 +128,10 @@ struct aa_opt_vtab {
                     const double *A, size_t lda,
                     const double *b_min, const double *b_max );
 
+    int
+    (*set_cstr_bnd)( struct aa_opt_cx *cx, size_t m,
+                     const double *b_min, const double *b_max );
+
 };
 
 struct aa_opt_cx {
@@ -224,6 +224,8 @@ s_set_cstr_gm( struct aa_opt_cx *cx,
     lprec *lp = (lprec*)cx->data;
     int row_count = s_count_rows(m, b_lower, b_upper);
 
+    /* Without a matrix, only the right-hand sides and types are set */
+    if( NULL == A && 0 != n ) return -1;
 
     int ilp = 1;
     for( size_t i = 0; i < m; i ++ ) {
@@ -249,7 +251,7 @@ s_set_cstr_gm( struct aa_opt_cx *cx,
                 } else if (aa_opt_is_bound(lb,ub) ) {
                     // leq
                     if( ! s_set_row( lp, LE,
-                                     n, A+i, ldA,
+                                     n, A ? A+i : NULL, ldA,
                                      ilp, u ) ) {
                         goto ERROR;
                     }
@@ -264,7 +266,7 @@ s_set_cstr_gm( struct aa_opt_cx *cx,
             }
         }
         if( ! s_set_row( lp, con_type,
-                         n, A+i, ldA,
+                         n, A ? A+i : NULL, ldA,
                          ilp, rh ) ) {
             goto ERROR;
         }
@@ -278,6 +280,19 @@ ERROR:
     return -1;
 }
 
+/*
+ * Two-sided constraints take two rows, so the matrix stays valid only
+ * while the row layout is unchanged.
+ */
+static int
+s_set_cstr_bnd( struct aa_opt_cx *cx, size_t m,
+                const double *b_lower, const double *b_upper )
+{
+    lprec *lp = (lprec*)cx->data;
+    if( s_count_rows(m, b_lower, b_upper) != get_Nrows(lp) ) return -1;
+    return s_set_cstr_gm( cx, m, 0, NULL, 0, b_lower, b_upper );
+}
+
 
 static struct aa_opt_vtab vtab = {
     .solve = s_solve,
@@ -287,7 +302,8 @@ static struct aa_opt_vtab vtab = {
     .set_type = s_set_type,
     .set_obj = s_set_obj,
     .set_bnd = s_set_bnd,
-    .set_cstr_gm = s_set_cstr_gm
+    .set_cstr_gm = s_set_cstr_gm,
+    .set_cstr_bnd = s_set_cstr_bnd
 };
 
 static struct aa_opt_cx*
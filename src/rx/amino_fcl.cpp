@@ -38,6 +38,7 @@
 #include "config.h"
 
 #include "amino.h"
+#include "amino/rx/rxerr.h"
 #include "amino/rx/rxtype.h"
 #include "amino/rx/rxtype_internal.h"
 
@@ -45,6 +46,8 @@
 #include "amino/rx/scenegraph_internal.h"
 
 #include "amino/rx/scene_geom.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/scene_ik.h"
 
 
 #include "amino/rx/scene_collision.h"
@@ -52,6 +55,12 @@
 
 #include <fcl/fcl.h>
 
+#include <atomic>
+#include <vector>
+#include <pthread.h>
+#include <sys/types.h>
+#include <unistd.h>
+
 #include "amino/rx/scene_collision_internal.h"
 #include "amino/rx/scene_fcl.h"
 
@@ -238,14 +247,80 @@ void aa_rx_sg_cl_init( struct aa_rx_sg *scene_graph )
 }
 
 
+struct cl_pair {
+    ::amino::fcl::CollisionObject *o1;
+    ::amino::fcl::CollisionObject *o2;
+};
+
+/*
+ * Narrowphase workers, created by aa_rx_cl_set_threads() and woken
+ * for each check.  The pair and hit vectors keep their capacity
+ * between checks.
+ */
+struct cl_pool {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_work;   ///< signaled when a check starts or on quit
+    pthread_cond_t cond_done;   ///< signaled when the last worker finishes
+    unsigned long generation;   ///< incremented for each check
+    size_t busy;                ///< workers still on the current check
+    bool quit;
+    std::vector<pthread_t> thread;
+
+    /* The current check */
+    std::vector<struct cl_pair> pairs;
+    std::vector<char> hit;
+    std::atomic<size_t> next;
+    std::atomic<bool> stop;
+    bool short_circuit;
+};
+
+static struct cl_pool *
+s_cl_pool_create( size_t n_workers );
+
+static void
+s_cl_pool_destroy( struct cl_pool *pool );
+
 struct aa_rx_cl
 {
     const struct aa_rx_sg *sg;
+
+    // Objects moved by some configuration
     ::amino::fcl::BroadPhaseCollisionManager *manager;
+
+    // Objects on frames fixed to the root, only updated when their
+    // transforms change
+    ::amino::fcl::BroadPhaseCollisionManager *static_manager;
+
     std::vector<::amino::fcl::CollisionObject*> *objects;
 
+    // Per frame, nonzero when no configuration moves the frame
+    std::vector<uint8_t> *frame_static;
+
+    // Per object, last transform set, 7 each
+    std::vector<double> *tf;
+
+    // Colliding, non-allowed pairs of static objects
+    std::vector<struct cl_pair> *static_hits;
+
+    // Changes when static transforms or allowed collisions change
+    unsigned long static_version;
+
+    // Whether static objects are placed from the scene graph, after
+    // which checks from forward kinematics skip them
+    bool static_placed;
+    unsigned long static_hits_version;
+
     // A bit-matrix of allowable collisions
     struct aa_rx_cl_set *allowed;
+
+    // Threads for narrowphase checks
+    size_t threads;
+    struct cl_pool *pool;   ///< NULL when checking on the calling thread
+
+    // Serial contexts for aa_rx_cl_check_batch(), created on first use
+    std::vector<struct aa_rx_cl*> *clones;
+    unsigned long clones_version;   ///< static_version last copied to clones
+    std::vector<struct aa_rx_fk*> *batch_fk;
 };
 
 static void cl_create_helper( void *cx_, aa_rx_frame_id frame_id, struct aa_rx_geom *geom )
@@ -259,7 +334,11 @@ static void cl_create_helper( void *cx_, aa_rx_frame_id frame_id, struct aa_rx_g
 
     ::amino::fcl::CollisionObject *obj = new ::amino::fcl::CollisionObject( cl_geom->ptr );
     obj->setUserData( (void*) ((intptr_t) frame_id) );
-    cx->manager->registerObject(obj);
+    if( (*cx->frame_static)[(size_t)frame_id] ) {
+        cx->static_manager->registerObject(obj);
+    } else {
+        cx->manager->registerObject(obj);
+    }
     cx->objects->push_back( obj );
 }
 
@@ -272,13 +351,37 @@ aa_rx_cl_create( const struct aa_rx_sg *scene_graph )
     cl->sg = scene_graph;
     cl->objects = new ::std::vector<::amino::fcl::CollisionObject*>;
     cl->manager = new ::amino::fcl::DynamicAABBTreeCollisionManager();
+    cl->static_manager = new ::amino::fcl::DynamicAABBTreeCollisionManager();
+    cl->static_hits = new ::std::vector<struct cl_pair>;
+    cl->static_version = 1;
+    cl->static_placed = false;
+    cl->static_hits_version = 0;
+    cl->threads = 1;
+    cl->pool = NULL;
+    cl->clones = new ::std::vector<struct aa_rx_cl*>;
+    cl->clones_version = 0;
+    cl->batch_fk = new ::std::vector<struct aa_rx_fk*>;
+
+    /* Frames are sorted, so parents are classified before children */
+    size_t n_f = aa_rx_sg_frame_count(scene_graph);
+    cl->frame_static = new ::std::vector<uint8_t>(n_f);
+    for( size_t i = 0; i < n_f; i ++ ) {
+        aa_rx_frame_id parent = aa_rx_sg_frame_parent(scene_graph, (aa_rx_frame_id)i);
+        (*cl->frame_static)[i] =
+            AA_RX_FRAME_FIXED == aa_rx_sg_frame_type(scene_graph, (aa_rx_frame_id)i)
+            && ( AA_RX_FRAME_ROOT == parent || (*cl->frame_static)[(size_t)parent] );
+    }
 
     cl->allowed = aa_rx_cl_set_create(scene_graph);
     aa_rx_sg_cl_set_copy(scene_graph, cl->allowed);
 
     aa_rx_sg_map_geom( scene_graph, &cl_create_helper, cl );
 
+    /* NaN never compares equal, so the first check sets every object */
+    cl->tf = new ::std::vector<double>( 7*cl->objects->size(), nan("") );
+
     cl->manager->setup();
+    cl->static_manager->setup();
 
     return cl;
 }
@@ -291,11 +394,49 @@ aa_rx_cl_destroy( struct aa_rx_cl *cl )
     }
 
     delete cl->manager;
+    delete cl->static_manager;
     delete cl->objects;
+    delete cl->frame_static;
+    delete cl->tf;
+    delete cl->static_hits;
+    for( struct aa_rx_cl *c : *cl->clones ) aa_rx_cl_destroy(c);
+    delete cl->clones;
+    for( struct aa_rx_fk *fk : *cl->batch_fk ) aa_rx_fk_destroy(fk);
+    delete cl->batch_fk;
     aa_rx_cl_set_destroy( cl->allowed );
+    if( cl->pool ) s_cl_pool_destroy( cl->pool );
     delete cl;
 }
 
+AA_API void
+aa_rx_cl_set_threads( struct aa_rx_cl *cl, size_t n )
+{
+    cl->threads = n;
+
+    /* The calling thread is also a narrowphase worker */
+    size_t n_t = n;
+    if( 0 == n_t ) {
+        long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+        n_t = (n_cpu > 0) ? (size_t)n_cpu : 1;
+    }
+    size_t n_workers = n_t - 1;
+    size_t n_old = cl->pool ? cl->pool->thread.size() : 0;
+    if( n_workers != n_old ) {
+        if( cl->pool ) s_cl_pool_destroy( cl->pool );
+        cl->pool = n_workers ? s_cl_pool_create( n_workers ) : NULL;
+    }
+
+    /* Drop batch contexts beyond the new thread count */
+    while( n > 0 && cl->clones->size() > n ) {
+        aa_rx_cl_destroy( cl->clones->back() );
+        cl->clones->pop_back();
+    }
+    while( n > 0 && cl->batch_fk->size() > n ) {
+        aa_rx_fk_destroy( cl->batch_fk->back() );
+        cl->batch_fk->pop_back();
+    }
+}
+
 AA_API void
 aa_rx_cl_allow( struct aa_rx_cl *cl,
                 aa_rx_frame_id id0,
@@ -303,6 +444,7 @@ aa_rx_cl_allow( struct aa_rx_cl *cl,
                 int allowed )
 {
     aa_rx_cl_set_set( cl->allowed, id0, id1, allowed );
+    cl->static_version++;
 }
 
 AA_API void
@@ -310,6 +452,7 @@ aa_rx_cl_allow_set( struct aa_rx_cl *cl,
                     const struct aa_rx_cl_set *set )
 {
     aa_rx_cl_set_fill( cl->allowed, set );
+    cl->static_version++;
 }
 
 
@@ -376,60 +519,384 @@ cl_check_callback( ::amino::fcl::CollisionObject *o1,
 }
 
 
+/*
+ * Parallel narrowphase.
+ *
+ * The broadphase runs on the calling thread and collects candidate
+ * pairs.  Workers then take pairs in order from a shared counter so
+ * that a few expensive mesh pairs do not stall one thread.  Hits are
+ * flagged per pair and merged into cl_set after the workers finish,
+ * in broadphase order, so the result does not depend on scheduling.
+ */
+struct cl_pairs_data {
+    struct aa_rx_cl *cl;
+    std::vector<struct cl_pair> *pairs;
+};
+
+static bool
+cl_pairs_callback( ::amino::fcl::CollisionObject *o1,
+                   ::amino::fcl::CollisionObject *o2,
+                   void *data_ )
+{
+    struct cl_pairs_data *data = (struct cl_pairs_data*)data_;
+    aa_rx_frame_id id1 = (intptr_t) o1->getUserData();
+    aa_rx_frame_id id2 = (intptr_t) o2->getUserData();
+
+    if( id1 != id2 && ! aa_rx_cl_set_get(data->cl->allowed,id1,id2) ) {
+        struct cl_pair p = {o1, o2};
+        data->pairs->push_back(p);
+    }
+
+    return false;
+}
+
+static bool
+s_cl_narrow( ::amino::fcl::CollisionObject *o1,
+             ::amino::fcl::CollisionObject *o2 )
+{
+    ::amino::fcl::CollisionRequest request;
+    ::amino::fcl::CollisionResult result;
+    ::fcl::collide(o1, o2, request, result);
+
+    return !request.enable_cost && (result.isCollision()) && (result.numContacts() >= request.num_max_contacts);
+}
+
+/* Take pairs of the current check until none remain */
 static void
-s_update_tf( const struct aa_rx_cl *cl,
+cl_narrow_worker( struct cl_pool *pool )
+{
+    size_t n = pool->pairs.size();
+
+    while( ! pool->stop.load(std::memory_order_relaxed) ) {
+        size_t i = pool->next.fetch_add(1, std::memory_order_relaxed);
+        if( i >= n ) break;
+
+        const struct cl_pair *p = &pool->pairs[i];
+        if( s_cl_narrow(p->o1, p->o2) ) {
+            pool->hit[i] = 1;
+            if( pool->short_circuit ) {
+                pool->stop.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+static void *
+s_cl_pool_thread( void *vpool )
+{
+    struct cl_pool *pool = (struct cl_pool*)vpool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock( &pool->mutex );
+    for(;;) {
+        while( ! pool->quit && seen == pool->generation ) {
+            pthread_cond_wait( &pool->cond_work, &pool->mutex );
+        }
+        if( pool->quit ) break;
+        seen = pool->generation;
+        pthread_mutex_unlock( &pool->mutex );
+
+        cl_narrow_worker( pool );
+
+        pthread_mutex_lock( &pool->mutex );
+        if( 0 == --pool->busy ) {
+            pthread_cond_signal( &pool->cond_done );
+        }
+    }
+    pthread_mutex_unlock( &pool->mutex );
+
+    return NULL;
+}
+
+static struct cl_pool *
+s_cl_pool_create( size_t n_workers )
+{
+    struct cl_pool *pool = new cl_pool;
+    pthread_mutex_init( &pool->mutex, NULL );
+    pthread_cond_init( &pool->cond_work, NULL );
+    pthread_cond_init( &pool->cond_done, NULL );
+    pool->generation = 0;
+    pool->busy = 0;
+    pool->quit = false;
+    pool->next.store(0);
+    pool->stop.store(false);
+    pool->short_circuit = false;
+
+    for( size_t j = 0; j < n_workers; j ++ ) {
+        pthread_t t;
+        if( 0 != pthread_create( &t, NULL, s_cl_pool_thread, pool ) ) break;
+        pool->thread.push_back(t);
+    }
+    return pool;
+}
+
+static void
+s_cl_pool_destroy( struct cl_pool *pool )
+{
+    pthread_mutex_lock( &pool->mutex );
+    pool->quit = true;
+    pthread_cond_broadcast( &pool->cond_work );
+    pthread_mutex_unlock( &pool->mutex );
+
+    for( pthread_t t : pool->thread ) {
+        pthread_join( t, NULL );
+    }
+
+    pthread_cond_destroy( &pool->cond_done );
+    pthread_cond_destroy( &pool->cond_work );
+    pthread_mutex_destroy( &pool->mutex );
+    delete pool;
+}
+
+/* Test pool->pairs on the workers and the calling thread */
+static void
+s_cl_pool_run( struct cl_pool *pool, bool short_circuit )
+{
+    pool->hit.assign( pool->pairs.size(), 0 );
+    pool->next.store(0);
+    pool->stop.store(false);
+    pool->short_circuit = short_circuit;
+
+    pthread_mutex_lock( &pool->mutex );
+    pool->busy = pool->thread.size();
+    pool->generation++;
+    pthread_cond_broadcast( &pool->cond_work );
+    pthread_mutex_unlock( &pool->mutex );
+
+    cl_narrow_worker( pool );
+
+    pthread_mutex_lock( &pool->mutex );
+    while( pool->busy > 0 ) {
+        pthread_cond_wait( &pool->cond_done, &pool->mutex );
+    }
+    pthread_mutex_unlock( &pool->mutex );
+}
+
+/* Static objects collide with each other only when moved or allowed
+ * collisions change, so keep the colliding pairs between checks. */
+static int
+s_cl_static_collide( struct aa_rx_cl *cl, struct aa_rx_cl_set *cl_set )
+{
+    if( cl->static_hits_version != cl->static_version ) {
+        std::vector<struct cl_pair> pairs;
+        struct cl_pairs_data pd;
+        pd.cl = cl;
+        pd.pairs = &pairs;
+        cl->static_manager->collide( &pd, cl_pairs_callback );
+
+        cl->static_hits->clear();
+        for( const struct cl_pair &p : pairs ) {
+            if( s_cl_narrow(p.o1, p.o2) ) {
+                cl->static_hits->push_back(p);
+            }
+        }
+        cl->static_hits_version = cl->static_version;
+    }
+
+    int r = 0;
+    for( const struct cl_pair &p : *cl->static_hits ) {
+        r = 1;
+        if( NULL == cl_set ) break;
+        aa_rx_cl_set_set( cl_set,
+                          (intptr_t) p.o1->getUserData(),
+                          (intptr_t) p.o2->getUserData(),
+                          1 );
+    }
+    return r;
+}
+
+static int
+s_cl_collide( struct aa_rx_cl *cl, struct aa_rx_cl_set *cl_set )
+{
+    int r = s_cl_static_collide(cl, cl_set);
+    if( r && NULL == cl_set ) return r;
+
+    struct cl_pool *pool = cl->pool;
+    if( NULL == pool || pool->thread.empty() ) {
+        struct cl_check_data data;
+        data.result = r;
+        data.cl = cl;
+        data.cl_set = cl_set;
+
+        cl->manager->collide( &data, cl_check_callback );
+        if( ! data.result || cl_set ) {
+            cl->manager->collide( cl->static_manager, &data, cl_check_callback );
+        }
+        return data.result;
+    }
+
+    /* Broadphase */
+    struct cl_pairs_data pd;
+    pd.cl = cl;
+    pd.pairs = &pool->pairs;
+    pool->pairs.clear();
+    cl->manager->collide( &pd, cl_pairs_callback );
+    cl->manager->collide( cl->static_manager, &pd, cl_pairs_callback );
+
+    size_t n_pairs = pool->pairs.size();
+    if( 0 == n_pairs ) return r;
+
+    /* Narrowphase */
+    s_cl_pool_run( pool, NULL == cl_set );
+
+    /* Merge */
+    for( size_t i = 0; i < n_pairs; i ++ ) {
+        if( pool->hit[i] ) {
+            r = 1;
+            if( NULL == cl_set ) break;
+            aa_rx_cl_set_set( cl_set,
+                              (intptr_t) pool->pairs[i].o1->getUserData(),
+                              (intptr_t) pool->pairs[i].o2->getUserData(),
+                              1 );
+        }
+    }
+
+    return r;
+}
+
+
+/* Set the transform of object k, returning false if it is unchanged */
+static bool
+s_update_obj( struct aa_rx_cl *cl, size_t k,
+              void (*f)(const void *cx, aa_rx_frame_id id, double E[7]),
+              const void *cx )
+{
+    ::amino::fcl::CollisionObject *obj = (*cl->objects)[k];
+    aa_rx_frame_id id = (intptr_t) obj->getUserData();
+    double TF_obj[7];
+    f(cx,id,TF_obj);
+
+    double *TF_last = cl->tf->data() + 7*k;
+    if( 0 == memcmp(TF_obj, TF_last, sizeof(TF_obj)) ) {
+        return false;
+    }
+    AA_MEM_CPY(TF_last, TF_obj, 7);
+
+    enum aa_rx_geom_shape shape_type;
+    struct aa_rx_geom *geom = (struct aa_rx_geom*)obj->collisionGeometry()->getUserData();
+    void *shape_ = aa_rx_geom_shape( geom, &shape_type);
+
+    /* Special case cylinders.
+     * Amino cylinders extend in +Z
+     * FCL cylinders extend in both +/- Z.
+     */
+    if( AA_RX_CYLINDER == shape_type ) {
+        struct aa_rx_shape_cylinder *shape = (struct aa_rx_shape_cylinder *)  shape_;
+        double E[7] = {0,0,0,1, 0,0, shape->height/2};
+        double E1[7];
+        aa_tf_qutr_mul(TF_obj, E, E1);
+        obj->setTransform(amino::fcl::qutr2fcltf(E1));
+    } else {
+        obj->setTransform( amino::fcl::qutr2fcltf(TF_obj) );
+    }
+    /* The broadphase managers refit from the world AABB */
+    obj->computeAABB();
+    return true;
+}
+
+/* Refit the managers for objects whose transforms changed */
+static void
+s_update_managers( struct aa_rx_cl *cl,
+                   const std::vector<::amino::fcl::CollisionObject*> &updated,
+                   const std::vector<::amino::fcl::CollisionObject*> &updated_static,
+                   bool from_fk )
+{
+    if( ! updated.empty() ) {
+        cl->manager->update(updated);
+    }
+    if( ! updated_static.empty() ) {
+        cl->static_manager->update(updated_static);
+        cl->static_version++;
+    }
+    /* Caller transforms may place static objects anywhere, so only FK
+     * updates leave them placed. */
+    if( from_fk ) {
+        cl->static_placed = true;
+    } else if( ! updated_static.empty() ) {
+        cl->static_placed = false;
+    }
+}
+
+/*
+ * Update all objects.  From forward kinematics, where no
+ * configuration moves them, static objects are skipped once placed.
+ */
+static void
+s_update_tf( struct aa_rx_cl *cl,
             void (*f)(const void *cx, aa_rx_frame_id id, double E[7]),
-            const void *cx )
+            const void *cx, bool from_fk )
 {
     /* Update Transforms */
-    for( auto itr = cl->objects->begin();
-         itr != cl->objects->end();
-         itr++ )
-    {
-        ::amino::fcl::CollisionObject *obj = *itr;
-        aa_rx_frame_id id = (intptr_t) obj->getUserData();
-        double TF_obj[7];
-        f(cx,id,TF_obj);
+    bool skip_static = from_fk && cl->static_placed;
+    std::vector<::amino::fcl::CollisionObject*> updated, updated_static;
+    for( size_t k = 0; k < cl->objects->size(); k ++ ) {
+        ::amino::fcl::CollisionObject *obj = (*cl->objects)[k];
+        size_t id = (size_t)(intptr_t) obj->getUserData();
+        bool is_static = (*cl->frame_static)[id];
+        if( is_static && skip_static ) continue;
+        if( s_update_obj(cl, k, f, cx) ) {
+            if( is_static ) updated_static.push_back(obj);
+            else updated.push_back(obj);
+        }
+    }
+    s_update_managers(cl, updated, updated_static, from_fk);
+}
 
-        enum aa_rx_geom_shape shape_type;
-        struct aa_rx_geom *geom = (struct aa_rx_geom*)obj->collisionGeometry()->getUserData();
-        void *shape_ = aa_rx_geom_shape( geom, &shape_type);
+/*
+ * Whether id lies in one of the sorted, disjoint ranges [r[2*i], r[2*i+1]).
+ */
+static int
+s_in_ranges( size_t id, size_t n_ranges, const size_t *ranges )
+{
+    size_t lo = 0, hi = n_ranges;
+    while( lo < hi ) {
+        size_t mid = (lo + hi) / 2;
+        if( ranges[2*mid+1] <= id ) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < n_ranges && ranges[2*lo] <= id;
+}
 
-        /* Special case cylinders.
-         * Amino cylinders extend in +Z
-         * FCL cylinders extend in both +/- Z.
-         */
-        if( AA_RX_CYLINDER == shape_type ) {
-            struct aa_rx_shape_cylinder *shape = (struct aa_rx_shape_cylinder *)  shape_;
-            double E[7] = {0,0,0,1, 0,0, shape->height/2};
-            double E1[7];
-            aa_tf_qutr_mul(TF_obj, E, E1);
-            obj->setTransform(amino::fcl::qutr2fcltf(E1));
-        } else {
-            obj->setTransform( amino::fcl::qutr2fcltf(TF_obj) );
+/*
+ * Update only objects in the frame ranges [ranges[2*i], ranges[2*i+1]),
+ * plus static objects if they have not yet been placed, from forward
+ * kinematics.
+ */
+static void
+s_update_tf_ranges( struct aa_rx_cl *cl,
+                    void (*f)(const void *cx, aa_rx_frame_id id, double E[7]),
+                    const void *cx,
+                    size_t n_ranges, const size_t *ranges )
+{
+    std::vector<::amino::fcl::CollisionObject*> updated, updated_static;
+    for( size_t k = 0; k < cl->objects->size(); k ++ ) {
+        ::amino::fcl::CollisionObject *obj = (*cl->objects)[k];
+        size_t id = (size_t)(intptr_t) obj->getUserData();
+        bool is_static = (*cl->frame_static)[id];
+        if( is_static ) {
+            if( cl->static_placed ) continue;
+        } else if( ! s_in_ranges(id, n_ranges, ranges) ) {
+            continue;
+        }
+        if( s_update_obj(cl, k, f, cx) ) {
+            if( is_static ) updated_static.push_back(obj);
+            else updated.push_back(obj);
         }
     }
-    cl->manager->update();
-
+    s_update_managers(cl, updated, updated_static, true);
 }
 
 
 static int
 s_cl_check( struct aa_rx_cl *cl,
             void (*f)(const void *cx, aa_rx_frame_id id, double E[7]),
-            const void *cx,
+            const void *cx, bool from_fk,
             struct aa_rx_cl_set *cl_set )
 {
-    s_update_tf(cl,f,cx);
+    s_update_tf(cl,f,cx,from_fk);
 
     /* Check Collision */
-    struct cl_check_data data;
-    data.result = 0;
-    data.cl = cl;
-    data.cl_set = cl_set;
-
-    cl->manager->collide( &data, cl_check_callback );
-    return data.result;
+    return s_cl_collide(cl, cl_set);
 }
 
 struct check_cx_array {
@@ -453,7 +920,7 @@ aa_rx_cl_check( struct aa_rx_cl *cl,
     struct check_cx_array cx;
     cx.TF = TF;
     cx.ldTF = ldTF;
-    return s_cl_check(cl, check_helper_array, &cx, cl_set);
+    return s_cl_check(cl, check_helper_array, &cx, false, cl_set);
 }
 
 
@@ -466,7 +933,140 @@ AA_API int
 aa_rx_cl_check_fk( struct aa_rx_cl *cl,
                    struct aa_rx_fk *fk,
                    struct aa_rx_cl_set *cl_set ) {
-    return s_cl_check(cl, check_helper_fk, fk, cl_set);
+    return s_cl_check(cl, check_helper_fk, fk, true, cl_set);
+}
+
+AA_API int
+aa_rx_cl_check_sub( struct aa_rx_cl *cl,
+                    const struct aa_rx_sg_sub *ssg,
+                    struct aa_rx_fk *fk,
+                    struct aa_rx_cl_set *cl_set )
+{
+    s_update_tf_ranges( cl, check_helper_fk, fk,
+                        aa_rx_sg_sub_moved_count(ssg),
+                        aa_rx_sg_sub_moved(ssg) );
+
+    return s_cl_collide(cl, cl_set);
+}
+
+/*
+ * Ensure n serial contexts and FK structs for batch checks.  Clones
+ * share the scene graph's collision geometry and persist between
+ * batches, so only the allowed pairs are copied when they change.
+ */
+static void
+s_cl_batch_reserve( struct aa_rx_cl *cl, size_t n )
+{
+    while( cl->batch_fk->size() < n ) {
+        cl->batch_fk->push_back( aa_rx_fk_malloc(cl->sg) );
+    }
+    if( n < 2 ) return;
+
+    while( cl->clones->size() < n ) {
+        struct aa_rx_cl *c = aa_rx_cl_create(cl->sg);
+        aa_rx_cl_set_fill( c->allowed, cl->allowed );
+        cl->clones->push_back( c );
+    }
+    if( cl->clones_version != cl->static_version ) {
+        for( struct aa_rx_cl *c : *cl->clones ) {
+            aa_rx_cl_set_fill( c->allowed, cl->allowed );
+            c->static_version++;
+        }
+        cl->clones_version = cl->static_version;
+    }
+}
+
+struct cl_batch_cx {
+    const struct aa_dmat *Q;
+    int *results;
+    size_t n_configs;
+    std::atomic<size_t> next;
+    /* lowest colliding index found so far */
+    std::atomic<size_t> first;
+};
+
+struct cl_batch_worker_cx {
+    struct cl_batch_cx *b;
+    struct aa_rx_cl *cl;
+    struct aa_rx_fk *fk;
+};
+
+/* Check configurations in index order until past the first collision */
+static void *
+s_cl_batch_worker( void *vcx )
+{
+    struct cl_batch_worker_cx *w = (struct cl_batch_worker_cx*)vcx;
+    struct cl_batch_cx *b = w->b;
+
+    for(;;) {
+        size_t i = b->next.fetch_add(1);
+        if( i >= b->n_configs ) break;
+        if( NULL == b->results && i >= b->first.load() ) break;
+
+        struct aa_dvec q_i = AA_DVEC_INIT( b->Q->rows, &AA_DMAT_REF(b->Q,0,i), 1 );
+        aa_rx_fk_all( w->fk, &q_i );
+        int r = s_cl_check( w->cl, check_helper_fk, w->fk, true, NULL );
+
+        if( b->results ) b->results[i] = r;
+        if( r ) {
+            size_t f = b->first.load();
+            while( i < f && ! b->first.compare_exchange_weak(f, i) );
+        }
+    }
+
+    return NULL;
+}
+
+AA_API int
+aa_rx_cl_check_batch( struct aa_rx_cl *cl,
+                      size_t n_configs,
+                      const struct aa_dmat *Q,
+                      int *results )
+{
+    if( aa_rx_sg_config_count(cl->sg) != Q->rows
+        || n_configs != Q->cols )
+    {
+        return -AA_RX_INVALID_PARAMETER;
+    }
+    if( 0 == n_configs ) return 0;
+
+    size_t n_t = cl->threads;
+    if( 0 == n_t ) {
+        long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+        n_t = (n_cpu > 0) ? (size_t)n_cpu : 1;
+    }
+    n_t = AA_MIN(n_t, n_configs);
+
+    struct cl_batch_cx b;
+    b.Q = Q;
+    b.results = results;
+    b.n_configs = n_configs;
+    b.next.store(0);
+    b.first.store(n_configs);
+
+    /* One worker checks with cl itself, keeping its narrowphase
+     * threads.  Several workers each check serially with a clone,
+     * since each already has its own thread. */
+    s_cl_batch_reserve( cl, n_t );
+    std::vector<struct cl_batch_worker_cx> w(n_t);
+    for( size_t j = 0; j < n_t; j ++ ) {
+        w[j].b = &b;
+        w[j].fk = (*cl->batch_fk)[j];
+        w[j].cl = (n_t > 1) ? (*cl->clones)[j] : cl;
+    }
+
+    std::vector<pthread_t> thread(n_t);
+    std::vector<int> started(n_t);
+    for( size_t j = 1; j < n_t; j ++ ) {
+        started[j] = (0 == pthread_create( &thread[j], NULL, s_cl_batch_worker, &w[j] ));
+    }
+    s_cl_batch_worker(&w[0]);
+    for( size_t j = 1; j < n_t; j ++ ) {
+        if( started[j] ) pthread_join( thread[j], NULL );
+    }
+
+    size_t first = b.first.load();
+    return (first < n_configs) ? (int)(first + 1) : 0;
 }
 
 AA_API void
@@ -534,10 +1134,14 @@ struct dist_ent {
 };
 
 struct aa_rx_cl_dist {
-    const struct aa_rx_cl *cl;
+    struct aa_rx_cl *cl;
 
     int in_collision;
 
+    // Static pair entries are kept while this matches the context
+    unsigned long static_version;
+    int static_in_collision;
+
     // frame_cnt x frame_cnt
     struct dist_ent *data;
 };
@@ -553,12 +1157,14 @@ s_get_dist_ent( const struct aa_rx_cl_dist *cl_dist,
 }
 
 AA_API struct aa_rx_cl_dist *
-aa_rx_cl_dist_create( const struct aa_rx_cl * cl )
+aa_rx_cl_dist_create( struct aa_rx_cl * cl )
 {
     aa_rx_sg_ensure_clean_frames( cl->sg );
 
     struct aa_rx_cl_dist *r = AA_NEW(struct aa_rx_cl_dist);
     r->cl = cl;
+    r->static_version = 0;
+    r->static_in_collision = 0;
 
     size_t n = aa_rx_sg_frame_count(cl->sg);
     r->data = AA_NEW0_AR(struct dist_ent, n*n);
@@ -578,11 +1184,14 @@ aa_rx_cl_dist_check( struct aa_rx_cl_dist *cl_dist,
                      const struct aa_rx_fk *fk )
 {
     /* Set Transforms*/
-    s_update_tf(cl_dist->cl, check_helper_fk, fk);
+    s_update_tf(cl_dist->cl, check_helper_fk, fk, true);
 
     /* Initialize */
+    const struct aa_rx_cl *cl = cl_dist->cl;
+    const std::vector<uint8_t> &frame_static = *cl->frame_static;
+    bool static_valid = (cl_dist->static_version == cl->static_version);
     cl_dist->in_collision = 0;
-    size_t n = aa_rx_sg_frame_count(cl_dist->cl->sg);
+    size_t n = aa_rx_sg_frame_count(cl->sg);
     for (size_t j = 0; j < n; j ++ ) {
         /* zero diagaonal (frame collision with itself) */
         struct dist_ent * ent_diag = s_get_dist_ent(cl_dist, j, j);
@@ -592,13 +1201,21 @@ aa_rx_cl_dist_check( struct aa_rx_cl_dist *cl_dist,
         // Set non-diagonal distances entries to a big number
         // (entries stored as lower triangular matrix)
         for (size_t i = j + 1; i < n; i ++ ) {
+            if( static_valid && frame_static[i] && frame_static[j] ) continue;
             struct dist_ent * ent = s_get_dist_ent(cl_dist, i, j);
             ent->dist = DBL_MAX;
         }
     }
 
     /* Check Distance */
-    cl_dist->cl->manager->distance( cl_dist, cl_dist_callback );
+    if( ! static_valid ) {
+        cl->static_manager->distance( cl_dist, cl_dist_callback );
+        cl_dist->static_in_collision = cl_dist->in_collision;
+        cl_dist->static_version = cl->static_version;
+    }
+    cl_dist->in_collision = cl_dist->static_in_collision;
+    cl->manager->distance( cl_dist, cl_dist_callback );
+    cl->manager->distance( cl->static_manager, cl_dist, cl_dist_callback );
 
     /* Result */
     return cl_dist->in_collision;
@@ -778,3 +1395,368 @@ aa_rx_cl_dist_get_points( const struct aa_rx_cl_dist *cl_dist,
     AA_MEM_CPY(p1, ent->point1, 3);
     return ent->dist;
 }
+
+
+/*--------------------*/
+/* Continuous Motions */
+/*--------------------*/
+
+/* Distance at which the motion check reports contact */
+#define CL_MOTION_TOL 1e-4
+
+/*
+ * Bound how far any point of each frame's geometry can move along
+ * q(t) = q0 + t*(q1-q0).
+ *
+ * For each frame f and each joint configuration c above it, reach[f*n_q+c]
+ * bounds the displacement of f's geometry per unit change in q_c: the
+ * distance from the joint origin to f's geometry for revolute joints,
+ * and the axis length for prismatic joints.  Distances from the joint
+ * origin sum the relative translations down the chain, at their larger
+ * endpoint value, plus a bounding radius of f's collision objects.
+ */
+static void
+s_cl_motion_reach( const struct aa_rx_cl *cl,
+                   const struct aa_rx_fk *fk0, const struct aa_rx_fk *fk1,
+                   double *reach, uint8_t *moves )
+{
+    const struct aa_rx_sg *sg = cl->sg;
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+
+    std::vector<double> rad(n_f, 0.0);
+    std::vector<double> trans(n_f);
+
+    for( ::amino::fcl::CollisionObject *obj : *cl->objects ) {
+        size_t id = (size_t)(intptr_t) obj->getUserData();
+        const ::amino::fcl::CollisionGeometry *g = obj->collisionGeometry().get();
+        double r = g->aabb_center.norm() + g->aabb_radius;
+
+        enum aa_rx_geom_shape shape_type;
+        void *shape_ = aa_rx_geom_shape( (struct aa_rx_geom*)g->getUserData(), &shape_type );
+        if( AA_RX_CYLINDER == shape_type ) {
+            r += ((struct aa_rx_shape_cylinder *)shape_)->height / 2;
+        }
+        rad[id] = AA_MAX(rad[id], r);
+    }
+
+    for( size_t f = 0; f < n_f; f ++ ) {
+        aa_rx_frame_id parent = aa_rx_sg_frame_parent(sg, (aa_rx_frame_id)f);
+        double E0[7], E1[7];
+        aa_rx_fk_get_rel_qutr( fk0, parent, (aa_rx_frame_id)f, E0 );
+        aa_rx_fk_get_rel_qutr( fk1, parent, (aa_rx_frame_id)f, E1 );
+        trans[f] = AA_MAX( aa_tf_vnorm(E0+AA_TF_QUTR_V),
+                           aa_tf_vnorm(E1+AA_TF_QUTR_V) );
+    }
+
+    AA_MEM_ZERO(reach, n_f*n_q);
+    AA_MEM_ZERO(moves, n_f*n_q);
+    for( size_t f = 0; f < n_f; f ++ ) {
+        double r = rad[f];
+        for( aa_rx_frame_id k = (aa_rx_frame_id)f;
+             AA_RX_FRAME_ROOT != k;
+             k = aa_rx_sg_frame_parent(sg, k) )
+        {
+            aa_rx_config_id c = aa_rx_sg_frame_config(sg, k);
+            if( AA_RX_CONFIG_NONE != c ) {
+                moves[f*n_q + (size_t)c] = 1;
+                switch( aa_rx_sg_frame_type(sg, k) ) {
+                case AA_RX_FRAME_REVOLUTE:
+                    reach[f*n_q + (size_t)c] = r;
+                    break;
+                case AA_RX_FRAME_PRISMATIC:
+                    reach[f*n_q + (size_t)c] = aa_tf_vnorm(aa_rx_sg_frame_axis(sg, k));
+                    break;
+                case AA_RX_FRAME_FIXED:
+                    break;
+                }
+            }
+            r += trans[k];
+        }
+    }
+}
+
+AA_API int
+aa_rx_cl_check_motion( struct aa_rx_cl *cl,
+                       const struct aa_dvec *q0,
+                       const struct aa_dvec *q1,
+                       double *t_hit )
+{
+    const struct aa_rx_sg *sg = cl->sg;
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    if( n_q != q0->len || n_q != q1->len ) {
+        return -AA_RX_INVALID_PARAMETER;
+    }
+
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    struct aa_rx_cl_dist *dist = aa_rx_cl_dist_create(cl);
+    double *reach = AA_NEW_AR(double, n_f*n_q);
+    uint8_t *moves = AA_NEW_AR(uint8_t, n_f*n_q);
+    std::vector<double> dq(n_q);
+    std::vector<double> q_data(n_q);
+    struct aa_dvec q = AA_DVEC_INIT(n_q, q_data.data(), 1);
+
+    {
+        struct aa_rx_fk *fk1 = aa_rx_fk_malloc(sg);
+        aa_rx_fk_all( fk, q0 );
+        aa_rx_fk_all( fk1, q1 );
+        s_cl_motion_reach( cl, fk, fk1, reach, moves );
+        aa_rx_fk_destroy(fk1);
+    }
+    for( size_t c = 0; c < n_q; c ++ ) {
+        dq[c] = AA_DVEC_REF(q1,c) - AA_DVEC_REF(q0,c);
+    }
+
+    /* Conservative advancement: no pair can close its current
+     * separation d in less than d over the pair's motion bound.
+     * Joints above both frames move them rigidly together, so only
+     * joints above exactly one of the frames count. */
+    int r = 0;
+    double t = 0;
+    for(;;) {
+        for( size_t c = 0; c < n_q; c ++ ) {
+            q_data[c] = AA_DVEC_REF(q0,c) + t*dq[c];
+        }
+        aa_rx_fk_all( fk, &q );
+        if( aa_rx_cl_dist_check(dist, fk) ) {
+            r = 1;
+            break;
+        }
+
+        double step = 1 - t;
+        for( size_t i = 0; i < n_f && ! r; i ++ ) {
+            for( size_t j = 0; j < i; j ++ ) {
+                double d = aa_rx_cl_dist_get_dist(dist, (aa_rx_frame_id)i, (aa_rx_frame_id)j);
+                if( DBL_MAX == d ) continue;
+                if( d < CL_MOTION_TOL ) {
+                    r = 1;
+                    break;
+                }
+                double mu = 0;
+                for( size_t c = 0; c < n_q; c ++ ) {
+                    if( moves[i*n_q+c] != moves[j*n_q+c] ) {
+                        mu += fabs(dq[c]) * (reach[i*n_q+c] + reach[j*n_q+c]);
+                    }
+                }
+                if( mu > 0 ) step = AA_MIN(step, d / mu);
+            }
+        }
+        if( r || t + step >= 1 ) break;
+        t += step;
+    }
+
+    if( r && t_hit ) *t_hit = t;
+
+    free(moves);
+    free(reach);
+    aa_rx_cl_dist_destroy(dist);
+    aa_rx_fk_destroy(fk);
+    return r;
+}
+
+/*-----------------------------*/
+/* Separation Constraints (IK) */
+/*-----------------------------*/
+
+struct aa_rx_cl_ik {
+    const struct aa_rx_sg_sub *ssg;
+    struct aa_rx_cl_dist *dist;
+
+    size_t max_pairs;
+    double d_min;
+    double margin;
+
+    size_t n_q;
+    size_t n_frames;
+
+    // n_frames x n_q, nonzero when config j moves frame f
+    uint8_t *moves;
+    // n_frames, nonzero when any config moves frame f
+    uint8_t *moved;
+
+    pthread_mutex_t mutex;
+};
+
+struct cl_ik_pair {
+    double dist;
+    aa_rx_frame_id id0;
+    aa_rx_frame_id id1;
+};
+
+AA_API struct aa_rx_cl_ik *
+aa_rx_cl_ik_create( struct aa_rx_cl *cl,
+                    const struct aa_rx_sg_sub *ssg,
+                    size_t max_pairs,
+                    double d_min, double margin )
+{
+    const struct aa_rx_sg *sg = cl->sg;
+    if( aa_rx_sg_sub_sg(ssg) != sg || 0 == max_pairs || margin < 0 ) {
+        return NULL;
+    }
+
+    struct aa_rx_cl_ik *r = AA_NEW(struct aa_rx_cl_ik);
+    r->ssg = ssg;
+    r->dist = aa_rx_cl_dist_create(cl);
+    r->max_pairs = max_pairs;
+    r->d_min = d_min;
+    r->margin = margin;
+    r->n_q = aa_rx_sg_sub_config_count(ssg);
+    r->n_frames = aa_rx_sg_frame_count(sg);
+    r->moves = AA_NEW0_AR(uint8_t, r->n_q * r->n_frames);
+    r->moved = AA_NEW0_AR(uint8_t, r->n_frames);
+    pthread_mutex_init(&r->mutex, NULL);
+
+    /* Map scenegraph configs to sub-scenegraph configs */
+    size_t n_all = aa_rx_sg_config_count(sg);
+    std::vector<ssize_t> idx(n_all, -1);
+    for( size_t j = 0; j < r->n_q; j ++ ) {
+        idx[aa_rx_sg_sub_config(ssg,j)] = (ssize_t)j;
+    }
+
+    /* A config moves every descendant of its joint frame */
+    for( size_t f = 0; f < r->n_frames; f ++ ) {
+        for( aa_rx_frame_id a = (aa_rx_frame_id)f;
+             a >= 0;
+             a = aa_rx_sg_frame_parent(sg, a) )
+        {
+            aa_rx_config_id c = aa_rx_sg_frame_config(sg, a);
+            if( c >= 0 && (size_t)c < n_all && idx[c] >= 0 ) {
+                r->moves[ (size_t)idx[c]*r->n_frames + f ] = 1;
+                r->moved[f] = 1;
+            }
+        }
+    }
+
+    return r;
+}
+
+AA_API void
+aa_rx_cl_ik_destroy( struct aa_rx_cl_ik *clik )
+{
+    aa_rx_cl_dist_destroy( clik->dist );
+    pthread_mutex_destroy( &clik->mutex );
+    free( clik->moves );
+    free( clik->moved );
+    free( clik );
+}
+
+/* Keep the n closest pairs, sorted by distance */
+static size_t
+s_cl_ik_insert( struct cl_ik_pair *pairs, size_t n, size_t max,
+                double dist, aa_rx_frame_id id0, aa_rx_frame_id id1 )
+{
+    if( n == max && dist >= pairs[n-1].dist ) return n;
+    size_t i = (n < max) ? n++ : n-1;
+    for( ; i > 0 && pairs[i-1].dist > dist; i -- ) {
+        pairs[i] = pairs[i-1];
+    }
+    pairs[i].dist = dist;
+    pairs[i].id0 = id0;
+    pairs[i].id1 = id1;
+    return n;
+}
+
+/* Gradient of the separation: n' * (v_1(p_1) - v_0(p_0)) */
+static void
+s_cl_ik_grad( const struct aa_rx_cl_ik *clik, const struct aa_dmat *J,
+              aa_rx_frame_id id0, const double p0[3],
+              aa_rx_frame_id id1, const double p1[3],
+              double *dd )
+{
+    double n[3];
+    for( size_t i = 0; i < 3; i ++ ) n[i] = p1[i] - p0[i];
+    double nn = aa_tf_vnorm(n);
+    if( nn < DBL_EPSILON ) {
+        AA_MEM_ZERO(dd, clik->n_q);
+        return;
+    }
+    for( size_t i = 0; i < 3; i ++ ) n[i] /= nn;
+
+    for( size_t j = 0; j < clik->n_q; j ++ ) {
+        const double *w = &AA_DMAT_REF(J, AA_TF_DX_W, j);
+        const double *v = &AA_DMAT_REF(J, AA_TF_DX_V, j);
+        const uint8_t *m = clik->moves + j*clik->n_frames;
+        double u[3] = {0, 0, 0}, a[3];
+        if( m[id1] ) {
+            aa_tf_cross(w, p1, a);
+            for( size_t i = 0; i < 3; i ++ ) u[i] += v[i] + a[i];
+        }
+        if( m[id0] ) {
+            aa_tf_cross(w, p0, a);
+            for( size_t i = 0; i < 3; i ++ ) u[i] -= v[i] + a[i];
+        }
+        dd[j] = aa_tf_vdot(n, u);
+    }
+}
+
+static void
+s_cl_ik_ineqct( void *data,
+                const struct aa_rx_sg_sub *ssg,
+                const struct aa_rx_fk *fk,
+                struct aa_dvec *c,
+                struct aa_dmat *dc )
+{
+    struct aa_rx_cl_ik *clik = (struct aa_rx_cl_ik *)data;
+    (void)ssg;
+    assert( ssg == clik->ssg );
+    assert( c->len == clik->max_pairs );
+    size_t m = clik->max_pairs;
+    double d_act = clik->d_min + clik->margin;
+
+    struct aa_mem_region *reg = aa_mem_region_local_get();
+    struct cl_ik_pair *pairs = AA_MEM_REGION_NEW_N(reg, struct cl_ik_pair, m);
+
+    pthread_mutex_lock( &clik->mutex );
+    aa_rx_cl_dist_check( clik->dist, fk );
+
+    /* Pairs inside the activation margin with at least one moved frame */
+    size_t n_pairs = 0;
+    for( size_t f0 = 0; f0 < clik->n_frames; f0 ++ ) {
+        aa_rx_frame_id id0 = (aa_rx_frame_id)f0;
+        for( size_t f1 = 0; f1 < f0; f1 ++ ) {
+            aa_rx_frame_id id1 = (aa_rx_frame_id)f1;
+            if( !clik->moved[f0] && !clik->moved[f1] ) continue;
+            double d = aa_rx_cl_dist_get_dist( clik->dist, id0, id1 );
+            if( d < d_act ) {
+                n_pairs = s_cl_ik_insert( pairs, n_pairs, m, d, id0, id1 );
+            }
+        }
+    }
+
+    /* Active pairs: c = d_min - d.  Remaining slots are inactive. */
+    struct aa_dmat *J = NULL;
+    if( dc ) {
+        J = aa_dmat_alloc( reg, 6, clik->n_q );
+        aa_rx_sg_sub_jac_twist_fill( clik->ssg, fk, J );
+    }
+    for( size_t k = 0; k < m; k ++ ) {
+        double *dd = dc ? &AA_DMAT_REF(dc, 0, k) : NULL;
+        if( k < n_pairs ) {
+            double p0[3], p1[3];
+            aa_rx_cl_dist_get_points( clik->dist, pairs[k].id0, pairs[k].id1, p0, p1 );
+            AA_DVEC_REF(c,k) = clik->d_min - pairs[k].dist;
+            if( dd ) {
+                s_cl_ik_grad( clik, J, pairs[k].id0, p0, pairs[k].id1, p1, dd );
+                for( size_t j = 0; j < clik->n_q; j ++ ) dd[j] *= -1;
+            }
+        } else {
+            AA_DVEC_REF(c,k) = -clik->margin;
+            if( dd ) AA_MEM_ZERO( dd, clik->n_q );
+        }
+    }
+    pthread_mutex_unlock( &clik->mutex );
+    aa_mem_region_pop( reg, pairs );
+}
+
+AA_API void
+aa_rx_cl_ik_attach( struct aa_rx_ik_cx *context,
+                    struct aa_rx_cl_ik *clik,
+                    double tol )
+{
+    if( clik ) {
+        aa_rx_ik_set_ineqct( context, clik->max_pairs, s_cl_ik_ineqct, clik, tol );
+    } else {
+        aa_rx_ik_set_ineqct( context, 0, NULL, NULL, tol );
+    }
+}
@@ -0,0 +1,690 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * Copyright (c) 2015, Rice University
+ * Copyright (c) 2019, Colorado School of Mines
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   * Neither the name of the Rice University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include "config.h"
+
+#include <pthread.h>
+
+#include "amino.h"
+#include "amino/kin.h"
+#include "amino/rx/rxtype.h"
+#include "amino/rx/rxerr.h"
+#include "amino/rx/scenegraph.h"
+#include "amino/rx/scene_fk.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/scene_ik.h"
+#include "amino/rx/scene_ik_internal.h"
+
+/*
+ * Closed-form IK.
+ *
+ * Solvers see the chain as a product of exponentials: unit axes and
+ * points on the axes at the zero configuration, in the world frame.
+ * Each solver type detects whether it applies to that geometry and
+ * returns every solution branch.
+ */
+
+static const double s_tol = 1e-9;
+
+/* Registry, most recently registered first */
+static pthread_mutex_t s_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static const struct aa_rx_ik_analytic_type **s_registry = NULL;
+static size_t s_registry_n = 0;
+
+AA_API void
+aa_rx_ik_analytic_register( const struct aa_rx_ik_analytic_type *type )
+{
+    pthread_mutex_lock( &s_registry_mutex );
+    s_registry = (const struct aa_rx_ik_analytic_type **)
+        realloc( s_registry, (s_registry_n+1) * sizeof(*s_registry) );
+    s_registry[s_registry_n++] = type;
+    pthread_mutex_unlock( &s_registry_mutex );
+}
+
+static int
+s_parallel( const double a[3], const double b[3] )
+{
+    double c[3];
+    aa_tf_cross( a, b, c );
+    return aa_tf_vnorm(c) < s_tol;
+}
+
+/* Rotation angle about unit axis w taking u to v, projected */
+static double
+s_subproblem1( const double w[3], const double u[3], const double v[3] )
+{
+    double up[3], vp[3], c[3];
+    double wu = aa_tf_vdot(w,u), wv = aa_tf_vdot(w,v);
+    for( size_t i = 0; i < 3; i ++ ) {
+        up[i] = u[i] - w[i]*wu;
+        vp[i] = v[i] - w[i]*wv;
+    }
+    aa_tf_cross( up, vp, c );
+    return atan2( aa_tf_vdot(w,c), aa_tf_vdot(up,vp) );
+}
+
+/*
+ * Angles with R(w1,t1)*R(w2,t2)*p = q for unit axes through the
+ * origin.  Returns the number of solutions, 0 to 2.
+ */
+static size_t
+s_subproblem2( const double w1[3], const double w2[3],
+               const double p[3], const double q[3],
+               double t1[2], double t2[2] )
+{
+    double w12 = aa_tf_vdot(w1,w2);
+    double den = w12*w12 - 1;
+    double a = (w12*aa_tf_vdot(w2,p) - aa_tf_vdot(w1,q)) / den;
+    double b = (w12*aa_tf_vdot(w1,q) - aa_tf_vdot(w2,p)) / den;
+    double c[3];
+    aa_tf_cross( w1, w2, c );
+    double g2 = ( aa_tf_vdot(p,p) - a*a - b*b - 2*a*b*w12 ) / aa_tf_vdot(c,c);
+    if( g2 < -s_tol ) return 0;
+    double g = sqrt( AA_MAX(g2, 0) );
+
+    size_t n = (g > s_tol) ? 2 : 1;
+    for( size_t k = 0; k < n; k ++ ) {
+        double gk = k ? -g : g;
+        double z[3];
+        for( size_t i = 0; i < 3; i ++ ) z[i] = a*w1[i] + b*w2[i] + gk*c[i];
+        t2[k] = s_subproblem1( w2, p, z );
+        t1[k] = -s_subproblem1( w1, q, z );
+    }
+    return n;
+}
+
+/* Orthonormal basis (e1, e2) of the plane normal to unit n, e1 along v if possible */
+static void
+s_plane( const double n[3], const double v[3], double e1[3], double e2[3] )
+{
+    double d = aa_tf_vdot(n,v);
+    for( size_t i = 0; i < 3; i ++ ) e1[i] = v[i] - d*n[i];
+    if( aa_tf_vnorm(e1) < s_tol ) {
+        const double *x = (fabs(n[0]) < .9) ? aa_tf_vec_x : aa_tf_vec_y;
+        d = aa_tf_vdot(n,x);
+        for( size_t i = 0; i < 3; i ++ ) e1[i] = x[i] - d*n[i];
+    }
+    aa_tf_vnormalize(e1);
+    aa_tf_cross( n, e1, e2 );
+}
+
+static void
+s_proj( const double e1[3], const double e2[3], const double o[3],
+        const double p[3], double x[2] )
+{
+    double d[3] = {p[0]-o[0], p[1]-o[1], p[2]-o[2]};
+    x[0] = aa_tf_vdot(e1,d);
+    x[1] = aa_tf_vdot(e2,d);
+}
+
+/*
+ * Planar 2R geometry: links from the first axis to the second and
+ * from the second to a point, as lengths and zero angles in a plane.
+ */
+struct planar2_geom {
+    double l[2];
+    double alpha[2];
+    double s[2];                /* axis direction relative to the normal */
+};
+
+static int
+s_planar2_init( struct planar2_geom *g, const double e1[3], const double e2[3],
+                const double *p0, const double *p1, const double *p2,
+                double s0, double s1 )
+{
+    double x1[2], x2[2];
+    s_proj( e1, e2, p0, p1, x1 );
+    s_proj( e1, e2, p0, p2, x2 );
+    double v2[2] = {x2[0]-x1[0], x2[1]-x1[1]};
+    g->l[0] = sqrt(x1[0]*x1[0] + x1[1]*x1[1]);
+    g->l[1] = sqrt(v2[0]*v2[0] + v2[1]*v2[1]);
+    g->alpha[0] = atan2(x1[1], x1[0]);
+    g->alpha[1] = atan2(v2[1], v2[0]);
+    g->s[0] = s0;
+    g->s[1] = s1;
+    return g->l[0] > s_tol && g->l[1] > s_tol;
+}
+
+/* Joint angles for point x in the plane, absolute link angles in psi */
+static int
+s_planar2_solve( const struct planar2_geom *g, const double x[2],
+                 double theta[2][2], double psi[2][2] )
+{
+    double qa[2], qb[2];
+    if( aa_kin_planar2_ik( g->l, x, qa, qb ) ) return -1;
+    const double *qs[2] = {qa, qb};
+    for( size_t k = 0; k < 2; k ++ ) {
+        psi[k][0] = qs[k][0];
+        psi[k][1] = qs[k][0] + qs[k][1];
+        double r0 = psi[k][0] - g->alpha[0];
+        double r1 = psi[k][1] - g->alpha[1];
+        theta[k][0] = g->s[0] * r0;
+        theta[k][1] = g->s[1] * (r1 - r0);
+    }
+    return 0;
+}
+
+
+/*-- Planar 2R and 3R: parallel axes --*/
+
+struct planar_solver {
+    size_t n_q;
+    double e1[3], e2[3], n[3], o[3];
+    struct planar2_geom g;
+    double l3, alpha3, s3;
+    double q_ee[4];
+};
+
+static void *
+s_planar_create( const struct aa_rx_ik_analytic_geom *geom, size_t n_q )
+{
+    if( n_q != geom->n_q ) return NULL;
+    const double *a = geom->axes, *p = geom->points;
+    for( size_t i = 1; i < n_q; i ++ ) {
+        if( ! s_parallel(a, a+3*i) ) return NULL;
+    }
+
+    struct planar_solver *s = AA_NEW0(struct planar_solver);
+    s->n_q = n_q;
+    AA_MEM_CPY( s->n, a, 3 );
+    AA_MEM_CPY( s->o, p, 3 );
+    double v[3] = {p[3]-p[0], p[4]-p[1], p[5]-p[2]};
+    s_plane( s->n, v, s->e1, s->e2 );
+
+    const double *x_ee = geom->E_ee + AA_TF_QUTR_T;
+    const double *p_last = (3 == n_q) ? p+6 : x_ee;
+    int ok = s_planar2_init( &s->g, s->e1, s->e2, p, p+3, p_last,
+                             copysign(1, aa_tf_vdot(a,s->n)),
+                             copysign(1, aa_tf_vdot(a+3,s->n)) );
+    if( ok && 3 == n_q ) {
+        double x3[2], xe[2];
+        s_proj( s->e1, s->e2, s->o, p+6, x3 );
+        s_proj( s->e1, s->e2, s->o, x_ee, xe );
+        s->l3 = sqrt( (xe[0]-x3[0])*(xe[0]-x3[0]) + (xe[1]-x3[1])*(xe[1]-x3[1]) );
+        s->alpha3 = atan2( xe[1]-x3[1], xe[0]-x3[0] );
+        s->s3 = copysign(1, aa_tf_vdot(a+6,s->n));
+    }
+    AA_MEM_CPY( s->q_ee, geom->E_ee + AA_TF_QUTR_Q, 4 );
+
+    if( !ok ) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void *
+s_planar2_create( const struct aa_rx_ik_analytic_geom *geom )
+{
+    return s_planar_create( geom, 2 );
+}
+
+static void *
+s_planar3_create( const struct aa_rx_ik_analytic_geom *geom )
+{
+    return s_planar_create( geom, 3 );
+}
+
+static size_t
+s_planar_solve( const void *vs, const double E[7], double *Q )
+{
+    const struct planar_solver *s = (const struct planar_solver*)vs;
+    double x[2];
+    s_proj( s->e1, s->e2, s->o, E + AA_TF_QUTR_T, x );
+
+    double phi = 0;
+    if( 3 == s->n_q ) {
+        // rotation about the normal from the zero pose
+        double q_rel[4], u[3];
+        aa_tf_qmulc( E + AA_TF_QUTR_Q, s->q_ee, q_rel );
+        aa_tf_qrot( q_rel, s->e1, u );
+        phi = atan2( aa_tf_vdot(s->e2,u), aa_tf_vdot(s->e1,u) );
+        // wrist point
+        x[0] -= s->l3 * cos(s->alpha3 + phi);
+        x[1] -= s->l3 * sin(s->alpha3 + phi);
+    }
+
+    double theta[2][2], psi[2][2];
+    if( s_planar2_solve( &s->g, x, theta, psi ) ) return 0;
+
+    for( size_t k = 0; k < 2; k ++ ) {
+        double *q = Q + s->n_q*k;
+        q[0] = theta[k][0];
+        q[1] = theta[k][1];
+        if( 3 == s->n_q ) {
+            q[2] = s->s3 * ( phi - (psi[k][1] - s->g.alpha[1]) );
+        }
+    }
+    return 2;
+}
+
+const struct aa_rx_ik_analytic_type aa_rx_ik_analytic_planar2 = {
+    .name = "planar-2r",
+    .max_solutions = 2,
+    .create = s_planar2_create,
+    .solve = s_planar_solve,
+    .destroy = free
+};
+
+const struct aa_rx_ik_analytic_type aa_rx_ik_analytic_planar3 = {
+    .name = "planar-3r",
+    .max_solutions = 2,
+    .create = s_planar3_create,
+    .solve = s_planar_solve,
+    .destroy = free
+};
+
+
+/*-- 6R with a spherical wrist --*/
+
+/*
+ * Joint 1 is perpendicular to the parallel joints 2 and 3, which move
+ * the wrist center in a plane.  The last three axes intersect at the
+ * wrist center.
+ */
+struct wrist_solver {
+    double a[6][3];
+    double p1[3], p2[3];
+    double w0[3];               /* wrist center */
+    double x_ee[3], q_ee[4];
+
+    double e1[3], e2[3];        /* plane of joint 1 */
+    double d;                   /* wrist offset along axis 2 */
+
+    double f1[3], f2[3];        /* plane of joints 2 and 3 */
+    struct planar2_geom g;
+};
+
+/* Closest point on line (p,a) to line (q,b), or 0 if parallel */
+static int
+s_line_closest( const double p[3], const double a[3],
+                const double q[3], const double b[3], double x[3] )
+{
+    double ab = aa_tf_vdot(a,b);
+    double den = 1 - ab*ab;
+    if( den < s_tol ) return 0;
+    double r[3] = {q[0]-p[0], q[1]-p[1], q[2]-p[2]};
+    double t = (aa_tf_vdot(a,r) - ab*aa_tf_vdot(b,r)) / den;
+    for( size_t i = 0; i < 3; i ++ ) x[i] = p[i] + t*a[i];
+    return 1;
+}
+
+static double
+s_line_dist( const double p[3], const double a[3], const double x[3] )
+{
+    double r[3] = {x[0]-p[0], x[1]-p[1], x[2]-p[2]}, c[3];
+    aa_tf_cross( a, r, c );
+    return aa_tf_vnorm(c);
+}
+
+static void *
+s_wrist_create( const struct aa_rx_ik_analytic_geom *geom )
+{
+    if( 6 != geom->n_q ) return NULL;
+    const double *a = geom->axes, *p = geom->points;
+
+    /* wrist axes meet at one point */
+    double w0[3];
+    if( !s_line_closest( p+9, a+9, p+12, a+12, w0 ) ||
+        s_line_dist( p+9, a+9, w0 ) > s_tol ||
+        s_line_dist( p+12, a+12, w0 ) > s_tol ||
+        s_line_dist( p+15, a+15, w0 ) > s_tol ||
+        s_parallel( a+12, a+15 ) )
+    {
+        return NULL;
+    }
+    /* shoulder and elbow */
+    if( !s_parallel( a+3, a+6 ) ||
+        fabs(aa_tf_vdot( a, a+3 )) > s_tol )
+    {
+        return NULL;
+    }
+
+    struct wrist_solver *s = AA_NEW0(struct wrist_solver);
+    AA_MEM_CPY( &s->a[0][0], a, 18 );
+    AA_MEM_CPY( s->p1, p, 3 );
+    AA_MEM_CPY( s->p2, p+3, 3 );
+    AA_MEM_CPY( s->w0, w0, 3 );
+    AA_MEM_CPY( s->x_ee, geom->E_ee + AA_TF_QUTR_T, 3 );
+    AA_MEM_CPY( s->q_ee, geom->E_ee + AA_TF_QUTR_Q, 4 );
+
+    /* joint 1 plane, e1 along axis 2 */
+    AA_MEM_CPY( s->e1, a+3, 3 );
+    aa_tf_cross( a, s->e1, s->e2 );
+    double r[3] = {w0[0]-p[0], w0[1]-p[1], w0[2]-p[2]};
+    s->d = aa_tf_vdot( r, s->e1 );
+
+    /* joints 2 and 3 plane, normal along axis 2 */
+    AA_MEM_CPY( s->f1, a, 3 );
+    aa_tf_cross( a+3, s->f1, s->f2 );
+    if( !s_planar2_init( &s->g, s->f1, s->f2, s->p2, p+6, w0,
+                         1, copysign(1, aa_tf_vdot(a+6,a+3)) ) )
+    {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static size_t
+s_wrist_solve( const void *vs, const double E[7], double *Q )
+{
+    const struct wrist_solver *s = (const struct wrist_solver*)vs;
+
+    /* target wrist center */
+    double q_w[4], wc[3], r[3];
+    aa_tf_qmulc( E + AA_TF_QUTR_Q, s->q_ee, q_w );
+    for( size_t i = 0; i < 3; i ++ ) r[i] = s->w0[i] - s->x_ee[i];
+    aa_tf_qrot( q_w, r, wc );
+    for( size_t i = 0; i < 3; i ++ ) wc[i] += E[AA_TF_QUTR_T+i];
+
+    /* joint 1 keeps the wrist at offset d along axis 2 */
+    double x[2];
+    s_proj( s->e1, s->e2, s->p1, wc, x );
+    double rho = sqrt(x[0]*x[0] + x[1]*x[1]);
+    if( rho < fabs(s->d) || rho < s_tol ) return 0;
+    double beta = atan2(x[1], x[0]);
+    double gamma = acos(s->d / rho);
+    double t1[2] = {beta - gamma, beta + gamma};
+
+    size_t n = 0;
+    for( size_t i = 0; i < 2; i ++ ) {
+        /* undo joint 1, then solve joints 2 and 3 in their plane */
+        double q1[4], w23[3];
+        aa_tf_axang2quat2( s->a[0], -t1[i], q1 );
+        for( size_t j = 0; j < 3; j ++ ) r[j] = wc[j] - s->p1[j];
+        aa_tf_qrot( q1, r, w23 );
+        for( size_t j = 0; j < 3; j ++ ) w23[j] += s->p1[j];
+
+        double y[2], theta[2][2], psi[2][2];
+        s_proj( s->f1, s->f2, s->p2, w23, y );
+        if( s_planar2_solve( &s->g, y, theta, psi ) ) continue;
+
+        for( size_t k = 0; k < 2; k ++ ) {
+            /* wrist rotation R4*R5*R6 = (R1*R2*R3)^T * R * R_ee^T */
+            double qa[4], qb[4], q123[4], q456[4];
+            aa_tf_axang2quat2( s->a[0], t1[i], qa );
+            aa_tf_axang2quat2( s->a[1], theta[k][0], qb );
+            aa_tf_qmul( qa, qb, q123 );
+            aa_tf_axang2quat2( s->a[2], theta[k][1], qa );
+            aa_tf_qmul( q123, qa, qb );
+            aa_tf_qcmul( qb, q_w, q456 );
+
+            double v[3], t4[2], t5[2];
+            aa_tf_qrot( q456, s->a[5], v );
+            size_t n45 = s_subproblem2( s->a[3], s->a[4], s->a[5], v, t4, t5 );
+            for( size_t m = 0; m < n45; m ++ ) {
+                double q4[4], q5[4], q45[4], q6[4], u[3], u6[3];
+                aa_tf_axang2quat2( s->a[3], t4[m], q4 );
+                aa_tf_axang2quat2( s->a[4], t5[m], q5 );
+                aa_tf_qmul( q4, q5, q45 );
+                aa_tf_qcmul( q45, q456, q6 );
+                /* joint 6 from any vector normal to its axis */
+                s_plane( s->a[5], s->a[4], u, v );
+                aa_tf_qrot( q6, u, u6 );
+
+                double *q = Q + 6*n++;
+                q[0] = t1[i];
+                q[1] = theta[k][0];
+                q[2] = theta[k][1];
+                q[3] = t4[m];
+                q[4] = t5[m];
+                q[5] = s_subproblem1( s->a[5], u, u6 );
+            }
+        }
+    }
+    return n;
+}
+
+const struct aa_rx_ik_analytic_type aa_rx_ik_analytic_6r_spherical = {
+    .name = "6r-spherical-wrist",
+    .max_solutions = 8,
+    .create = s_wrist_create,
+    .solve = s_wrist_solve,
+    .destroy = free
+};
+
+
+/*-- Dispatch --*/
+
+static const struct aa_rx_ik_analytic_type *s_builtin[] = {
+    &aa_rx_ik_analytic_6r_spherical,
+    &aa_rx_ik_analytic_planar3,
+    &aa_rx_ik_analytic_planar2
+};
+
+/*
+ * Zero-configuration geometry of the serial chain to the target
+ * frame, in the order of the sub-scenegraph configurations.  Fails
+ * unless every configuration is a revolute joint on that chain.
+ */
+static int
+s_chain_geom( const struct aa_rx_ik_cx *cx, double *axes, double *points, double E_ee[7] )
+{
+    const struct aa_rx_sg_sub *ssg = cx->ssg;
+    const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    if( 1 != cx->n_frames ) return -1;
+
+    /* sub-scenegraph config frames, from the tip up */
+    aa_rx_frame_id frames[n_q];
+    size_t n_found = 0;
+    for( aa_rx_frame_id f = cx->frames[0]; f >= 0; f = aa_rx_sg_frame_parent(sg, f) ) {
+        aa_rx_config_id c = aa_rx_sg_frame_config(sg, f);
+        if( AA_RX_CONFIG_NONE == c ) continue;
+        for( size_t i = 0; i < n_q; i ++ ) {
+            if( c == aa_rx_sg_sub_config(ssg, i) ) {
+                if( AA_RX_FRAME_REVOLUTE != aa_rx_sg_frame_type(sg, f) ) return -1;
+                frames[i] = f;
+                n_found++;
+            }
+        }
+    }
+    if( n_found != n_q ) return -1;
+    /* product of exponentials order */
+    for( size_t i = 1; i < n_q; i ++ ) {
+        aa_rx_frame_id f = frames[i];
+        for( ; f >= 0 && f != frames[i-1]; f = aa_rx_sg_frame_parent(sg, f) );
+        if( f < 0 ) return -1;
+    }
+
+    struct aa_mem_region *reg = aa_mem_region_local_get();
+    struct aa_dvec *q_all = aa_dvec_dup( reg, cx->q_start );
+    for( size_t i = 0; i < n_q; i ++ ) {
+        AA_DVEC_REF( q_all, aa_rx_sg_sub_config(ssg, i) ) = 0;
+    }
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    aa_rx_fk_all( fk, q_all );
+    for( size_t i = 0; i < n_q; i ++ ) {
+        const double *E = aa_rx_fk_ref( fk, frames[i] );
+        aa_tf_qrot( E + AA_TF_QUTR_Q, aa_rx_sg_frame_axis(sg, frames[i]), axes + 3*i );
+        aa_tf_vnormalize( axes + 3*i );
+        AA_MEM_CPY( points + 3*i, E + AA_TF_QUTR_T, 3 );
+    }
+    AA_MEM_CPY( E_ee, aa_rx_fk_ref(fk, cx->frames[0]), AA_RX_TF_LEN );
+    aa_rx_fk_destroy(fk);
+    aa_mem_region_pop( reg, q_all );
+    return 0;
+}
+
+static int
+s_try_type( struct aa_rx_ik_cx *cx, const struct aa_rx_ik_analytic_type *type,
+            const struct aa_rx_ik_analytic_geom *geom )
+{
+    void *solver = type->create( geom );
+    if( NULL == solver ) return 0;
+    cx->analytic_type = type;
+    cx->analytic = solver;
+    return 1;
+}
+
+AA_API void
+aa_rx_ik_analytic_destroy( struct aa_rx_ik_cx *cx )
+{
+    if( cx->analytic ) {
+        cx->analytic_type->destroy( cx->analytic );
+    }
+    cx->analytic = NULL;
+    cx->analytic_type = NULL;
+}
+
+AA_API void
+aa_rx_ik_analytic_detect( struct aa_rx_ik_cx *cx )
+{
+    aa_rx_ik_analytic_destroy( cx );
+    if( cx->analytic_disabled ) return;
+
+    size_t n_q = aa_rx_sg_sub_config_count(cx->ssg);
+    double axes[3*n_q], points[3*n_q];
+    struct aa_rx_ik_analytic_geom geom;
+    geom.n_q = n_q;
+    geom.axes = axes;
+    geom.points = points;
+    if( s_chain_geom( cx, axes, points, geom.E_ee ) ) return;
+
+    int found = 0;
+    pthread_mutex_lock( &s_registry_mutex );
+    for( size_t i = s_registry_n; !found && i > 0; i -- ) {
+        found = s_try_type( cx, s_registry[i-1], &geom );
+    }
+    pthread_mutex_unlock( &s_registry_mutex );
+    for( size_t i = 0; !found && i < sizeof(s_builtin)/sizeof(s_builtin[0]); i ++ ) {
+        found = s_try_type( cx, s_builtin[i], &geom );
+    }
+}
+
+AA_API const char *
+aa_rx_ik_get_analytic( const struct aa_rx_ik_cx *context )
+{
+    return context->analytic ? context->analytic_type->name : NULL;
+}
+
+AA_API void
+aa_rx_ik_set_analytic( struct aa_rx_ik_cx *context, int enable )
+{
+    context->analytic_disabled = !enable;
+    aa_rx_ik_analytic_detect( context );
+}
+
+/* Shift revolute angles by whole turns into the position limits */
+static int
+s_fit_limits( const struct aa_rx_sg_sub *ssg, double *q )
+{
+    const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
+    for( size_t i = 0; i < aa_rx_sg_sub_config_count(ssg); i ++ ) {
+        double min, max;
+        q[i] = aa_ang_norm_pi( q[i] );
+        if( aa_rx_sg_get_limit_pos(sg, aa_rx_sg_sub_config(ssg,i), &min, &max) ) continue;
+        if( q[i] < min ) q[i] += 2*M_PI;
+        else if( q[i] > max ) q[i] -= 2*M_PI;
+        if( q[i] < min || q[i] > max ) return -1;
+    }
+    return 0;
+}
+
+AA_API size_t
+aa_rx_ik_solve_analytic( const struct aa_rx_ik_cx *context,
+                         const struct aa_dmat *TF,
+                         struct aa_dmat *Q )
+{
+    size_t n_q = aa_rx_sg_sub_config_count(context->ssg);
+    if( NULL == context->analytic ||
+        1 != TF->cols || AA_RX_TF_LEN != TF->rows || n_q != Q->rows )
+    {
+        return 0;
+    }
+
+    /* targets are in the world frame like the chain geometry */
+    size_t m = context->analytic_type->max_solutions;
+    double Qa[n_q*m];
+    size_t n_a = context->analytic_type->solve( context->analytic, TF->data, Qa );
+
+    size_t n = 0;
+    for( size_t j = 0; j < n_a && n < Q->cols; j ++ ) {
+        double *q = Qa + n_q*j;
+        struct aa_dvec v = AA_DVEC_INIT(n_q, q, 1);
+        if( s_fit_limits(context->ssg, q) ||
+            aa_rx_ik_check(context, TF, &v) )
+        {
+            continue;
+        }
+        struct aa_dvec q_n = AA_DVEC_INIT(n_q, &AA_DMAT_REF(Q,0,n), 1);
+        aa_dvec_copy( &v, &q_n );
+        n++;
+    }
+    return n;
+}
+
+AA_API int
+aa_rx_ik_analytic_nearest( const struct aa_rx_ik_cx *context,
+                           const struct aa_dmat *TF,
+                           const struct aa_dvec *q_seed,
+                           struct aa_dvec *q )
+{
+    size_t n_q = q_seed->len;
+    size_t m = context->analytic_type->max_solutions;
+    double Qd[n_q*m];
+    struct aa_dmat Q = AA_DMAT_INIT(n_q, m, Qd, n_q);
+    size_t n = aa_rx_ik_solve_analytic( context, TF, &Q );
+    if( 0 == n ) return AA_RX_NO_SOLUTION | AA_RX_NO_IK;
+
+    size_t j_min = 0;
+    double d_min = DBL_MAX;
+    for( size_t j = 0; j < n; j ++ ) {
+        struct aa_dvec q_j = AA_DVEC_INIT(n_q, Qd + n_q*j, 1);
+        double d = aa_dvec_ssd( q_seed, &q_j );
+        if( d < d_min ) {
+            d_min = d;
+            j_min = j;
+        }
+    }
+    struct aa_dvec q_j = AA_DVEC_INIT(n_q, Qd + n_q*j_min, 1);
+    aa_dvec_copy( &q_j, q );
+    return 0;
+}
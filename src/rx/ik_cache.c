@@ -0,0 +1,432 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * Copyright (c) 2015, Rice University
+ * Copyright (c) 2019, Colorado School of Mines
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   * Neither the name of the Rice University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "amino.h"
+#include "amino/rx/rxtype.h"
+#include "amino/rx/rxerr.h"
+#include "amino/rx/scenegraph.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/scene_ik.h"
+#include "amino/rx/scene_ik_internal.h"
+
+/*
+ * Solution cache.
+ *
+ * Entries are hashed on the grid cell containing the position of the
+ * first target.  Lookups scan the 27 cells around the query, so
+ * seeds come from targets within about one cell.  Entries form a
+ * doubly linked LRU list, and a full cache replaces its least
+ * recently used entry.
+ */
+
+#define CACHE_NONE SIZE_MAX
+
+static const char s_cache_magic[8] = {'A','A','I','K','C','A','C','1'};
+
+struct ik_cache_entry {
+    long cell[3];
+    size_t next;                /* bucket chain */
+    size_t lru_prev, lru_next;  /* towards the head is more recent */
+};
+
+struct aa_rx_ik_cache {
+    pthread_mutex_t mutex;
+
+    size_t n_q;
+    size_t n_frames;
+    size_t capacity;
+    double cell;
+
+    size_t n_buckets;
+    size_t *buckets;
+
+    struct ik_cache_entry *entries;
+    double *data;               /* poses then configuration per entry */
+    size_t size;
+    size_t lru_head, lru_tail;
+
+    struct aa_rx_ik_cache_stats stats;
+};
+
+static size_t
+s_stride( const struct aa_rx_ik_cache *cache )
+{
+    return AA_RX_TF_LEN * cache->n_frames + cache->n_q;
+}
+
+static double *
+s_entry_tf( const struct aa_rx_ik_cache *cache, size_t i )
+{
+    return cache->data + i * s_stride(cache);
+}
+
+static double *
+s_entry_q( const struct aa_rx_ik_cache *cache, size_t i )
+{
+    return s_entry_tf(cache, i) + AA_RX_TF_LEN * cache->n_frames;
+}
+
+static void
+s_cell( const struct aa_rx_ik_cache *cache, const double *E, long c[3] )
+{
+    for( size_t i = 0; i < 3; i ++ ) {
+        c[i] = (long)floor( E[AA_TF_QUTR_T+i] / cache->cell );
+    }
+}
+
+static size_t
+s_bucket( const struct aa_rx_ik_cache *cache, const long c[3] )
+{
+    unsigned long h = ( (unsigned long)c[0] * 73856093UL )
+        ^ ( (unsigned long)c[1] * 19349663UL )
+        ^ ( (unsigned long)c[2] * 83492791UL );
+    return h & (cache->n_buckets - 1);
+}
+
+/* Squared distance, an angle of one radian counting as one cell */
+static double
+s_dist( const struct aa_rx_ik_cache *cache, const double *E, const struct aa_dmat *TF )
+{
+    double d = 0;
+    for( size_t k = 0; k < cache->n_frames; k ++ ) {
+        const double *E_k = E + AA_RX_TF_LEN*k;
+        const double *E_r = &AA_DMAT_REF(TF,0,k);
+        double q_rel[4];
+        aa_tf_qcmul( E_k+AA_TF_QUTR_Q, E_r+AA_TF_QUTR_Q, q_rel );
+        aa_tf_qminimize( q_rel );
+        double a = cache->cell * aa_tf_qangle( q_rel );
+        double dp[3];
+        for( size_t i = 0; i < 3; i ++ ) {
+            dp[i] = E_k[AA_TF_QUTR_T+i] - E_r[AA_TF_QUTR_T+i];
+        }
+        d += aa_tf_vdot( dp, dp ) + a*a;
+    }
+    return d;
+}
+
+static void
+s_lru_unlink( struct aa_rx_ik_cache *cache, size_t i )
+{
+    struct ik_cache_entry *e = cache->entries + i;
+    if( CACHE_NONE == e->lru_prev ) cache->lru_head = e->lru_next;
+    else cache->entries[e->lru_prev].lru_next = e->lru_next;
+    if( CACHE_NONE == e->lru_next ) cache->lru_tail = e->lru_prev;
+    else cache->entries[e->lru_next].lru_prev = e->lru_prev;
+}
+
+static void
+s_lru_push( struct aa_rx_ik_cache *cache, size_t i )
+{
+    struct ik_cache_entry *e = cache->entries + i;
+    e->lru_prev = CACHE_NONE;
+    e->lru_next = cache->lru_head;
+    if( CACHE_NONE == cache->lru_head ) cache->lru_tail = i;
+    else cache->entries[cache->lru_head].lru_prev = i;
+    cache->lru_head = i;
+}
+
+static void
+s_bucket_unlink( struct aa_rx_ik_cache *cache, size_t i )
+{
+    size_t *p = cache->buckets + s_bucket(cache, cache->entries[i].cell);
+    while( *p != i ) p = &cache->entries[*p].next;
+    *p = cache->entries[i].next;
+}
+
+/* Nearest entry in the cells around TF, or CACHE_NONE */
+static size_t
+s_nearest( const struct aa_rx_ik_cache *cache, const struct aa_dmat *TF, double *d_min )
+{
+    long c0[3], c[3];
+    s_cell( cache, TF->data, c0 );
+    size_t best = CACHE_NONE;
+    *d_min = DBL_MAX;
+    for( long dx = -1; dx <= 1; dx ++ ) {
+        for( long dy = -1; dy <= 1; dy ++ ) {
+            for( long dz = -1; dz <= 1; dz ++ ) {
+                c[0] = c0[0] + dx;
+                c[1] = c0[1] + dy;
+                c[2] = c0[2] + dz;
+                size_t i = cache->buckets[s_bucket(cache,c)];
+                for( ; CACHE_NONE != i; i = cache->entries[i].next ) {
+                    const long *ci = cache->entries[i].cell;
+                    if( ci[0] != c[0] || ci[1] != c[1] || ci[2] != c[2] ) continue;
+                    double d = s_dist( cache, s_entry_tf(cache,i), TF );
+                    if( d < *d_min ) {
+                        *d_min = d;
+                        best = i;
+                    }
+                }
+            }
+        }
+    }
+    return best;
+}
+
+static void
+s_insert( struct aa_rx_ik_cache *cache, const double *TF, size_t ld_TF, const double *q )
+{
+    size_t i;
+    if( cache->size < cache->capacity ) {
+        i = cache->size++;
+    } else {
+        i = cache->lru_tail;
+        s_lru_unlink( cache, i );
+        s_bucket_unlink( cache, i );
+        cache->stats.evictions++;
+    }
+
+    double *E = s_entry_tf(cache, i);
+    for( size_t k = 0; k < cache->n_frames; k ++ ) {
+        AA_MEM_CPY( E + AA_RX_TF_LEN*k, TF + ld_TF*k, AA_RX_TF_LEN );
+    }
+    AA_MEM_CPY( s_entry_q(cache, i), q, cache->n_q );
+
+    struct ik_cache_entry *e = cache->entries + i;
+    s_cell( cache, E, e->cell );
+    size_t *b = cache->buckets + s_bucket(cache, e->cell);
+    e->next = *b;
+    *b = i;
+    s_lru_push( cache, i );
+}
+
+AA_API struct aa_rx_ik_cache *
+aa_rx_ik_cache_create( size_t n_q, size_t n_frames, size_t capacity, double cell )
+{
+    if( 0 == capacity || 0 == n_frames || !(cell > 0) ) return NULL;
+
+    struct aa_rx_ik_cache *cache = AA_NEW0(struct aa_rx_ik_cache);
+    pthread_mutex_init( &cache->mutex, NULL );
+    cache->n_q = n_q;
+    cache->n_frames = n_frames;
+    cache->capacity = capacity;
+    cache->cell = cell;
+
+    /* power of two with a load factor of at most 1/2 */
+    cache->n_buckets = 1;
+    while( cache->n_buckets < 2*capacity ) cache->n_buckets *= 2;
+    cache->buckets = AA_NEW_AR(size_t, cache->n_buckets);
+    for( size_t i = 0; i < cache->n_buckets; i ++ ) cache->buckets[i] = CACHE_NONE;
+
+    cache->entries = AA_NEW_AR(struct ik_cache_entry, capacity);
+    cache->data = AA_NEW_AR(double, capacity * s_stride(cache));
+    cache->size = 0;
+    cache->lru_head = cache->lru_tail = CACHE_NONE;
+
+    return cache;
+}
+
+AA_API void
+aa_rx_ik_cache_destroy( struct aa_rx_ik_cache *cache )
+{
+    pthread_mutex_destroy( &cache->mutex );
+    free(cache->buckets);
+    free(cache->entries);
+    free(cache->data);
+    free(cache);
+}
+
+AA_API size_t
+aa_rx_ik_cache_size( struct aa_rx_ik_cache *cache )
+{
+    pthread_mutex_lock( &cache->mutex );
+    size_t n = cache->size;
+    pthread_mutex_unlock( &cache->mutex );
+    return n;
+}
+
+AA_API void
+aa_rx_ik_cache_get_stats( struct aa_rx_ik_cache *cache,
+                          struct aa_rx_ik_cache_stats *stats )
+{
+    pthread_mutex_lock( &cache->mutex );
+    *stats = cache->stats;
+    pthread_mutex_unlock( &cache->mutex );
+
+    size_t misses = stats->lookups - stats->hits;
+    if( stats->hits > 0 && misses > 0 ) {
+        double t_hit = stats->time_hit / (double)stats->hits;
+        double t_miss = stats->time_miss / (double)misses;
+        stats->time_saved = (double)stats->hits * (t_miss - t_hit);
+    } else {
+        stats->time_saved = 0;
+    }
+}
+
+AA_API int
+aa_rx_ik_cache_seed( struct aa_rx_ik_cache *cache,
+                     const struct aa_dmat *TF,
+                     struct aa_dvec *q )
+{
+    pthread_mutex_lock( &cache->mutex );
+    cache->stats.lookups++;
+    double d;
+    size_t i = s_nearest( cache, TF, &d );
+    if( CACHE_NONE != i ) {
+        struct aa_dvec v = AA_DVEC_INIT(cache->n_q, s_entry_q(cache,i), 1);
+        aa_dvec_copy( &v, q );
+        s_lru_unlink( cache, i );
+        s_lru_push( cache, i );
+        cache->stats.hits++;
+    }
+    pthread_mutex_unlock( &cache->mutex );
+    return CACHE_NONE != i;
+}
+
+AA_API void
+aa_rx_ik_cache_insert( struct aa_rx_ik_cache *cache,
+                       const struct aa_dmat *TF,
+                       const struct aa_dvec *q )
+{
+    double q_d[cache->n_q];
+    struct aa_dvec v = AA_DVEC_INIT(cache->n_q, q_d, 1);
+    aa_dvec_copy( q, &v );
+
+    pthread_mutex_lock( &cache->mutex );
+    double d;
+    size_t i = s_nearest( cache, TF, &d );
+    if( CACHE_NONE != i && d < DBL_EPSILON ) {
+        /* same target, keep the newer solution */
+        AA_MEM_CPY( s_entry_q(cache,i), q_d, cache->n_q );
+        s_lru_unlink( cache, i );
+        s_lru_push( cache, i );
+    } else {
+        s_insert( cache, TF->data, TF->ld, q_d );
+    }
+    pthread_mutex_unlock( &cache->mutex );
+}
+
+AA_API void
+aa_rx_ik_cache_record( struct aa_rx_ik_cache *cache, int hit, double seconds )
+{
+    pthread_mutex_lock( &cache->mutex );
+    if( hit ) cache->stats.time_hit += seconds;
+    else cache->stats.time_miss += seconds;
+    pthread_mutex_unlock( &cache->mutex );
+}
+
+/*
+ * File format, in host byte order: the magic bytes, then n_q,
+ * n_frames, and the entry count as uint64_t, then each entry's poses
+ * and configuration from least to most recently used.
+ */
+
+AA_API int
+aa_rx_ik_cache_save( struct aa_rx_ik_cache *cache, const char *filename )
+{
+    FILE *f = fopen(filename, "wb");
+    if( NULL == f ) return AA_RX_INVALID_PARAMETER;
+
+    pthread_mutex_lock( &cache->mutex );
+    uint64_t hdr[3] = {cache->n_q, cache->n_frames, cache->size};
+    size_t stride = s_stride(cache);
+    int ok = ( 1 == fwrite(s_cache_magic, sizeof(s_cache_magic), 1, f) &&
+               1 == fwrite(hdr, sizeof(hdr), 1, f) );
+    for( size_t i = cache->lru_tail; ok && CACHE_NONE != i;
+         i = cache->entries[i].lru_prev )
+    {
+        ok = ( stride == fwrite(s_entry_tf(cache,i), sizeof(double), stride, f) );
+    }
+    pthread_mutex_unlock( &cache->mutex );
+
+    if( fclose(f) ) ok = 0;
+    return ok ? 0 : AA_RX_INVALID_STATE;
+}
+
+AA_API int
+aa_rx_ik_cache_load( struct aa_rx_ik_cache *cache, const char *filename )
+{
+    FILE *f = fopen(filename, "rb");
+    if( NULL == f ) return AA_RX_INVALID_PARAMETER;
+
+    char magic[sizeof(s_cache_magic)];
+    uint64_t hdr[3];
+    int r = 0;
+    if( 1 != fread(magic, sizeof(magic), 1, f) ||
+        1 != fread(hdr, sizeof(hdr), 1, f) ||
+        0 != memcmp(magic, s_cache_magic, sizeof(magic)) ||
+        hdr[0] != cache->n_q || hdr[1] != cache->n_frames )
+    {
+        r = AA_RX_INVALID_PARAMETER;
+    }
+
+    size_t stride = s_stride(cache);
+    double E[stride];
+    pthread_mutex_lock( &cache->mutex );
+    for( uint64_t j = 0; 0 == r && j < hdr[2]; j ++ ) {
+        if( stride != fread(E, sizeof(double), stride, f) ) {
+            r = AA_RX_INVALID_STATE;
+        } else {
+            /* later entries are more recent, so they survive eviction */
+            s_insert( cache, E, AA_RX_TF_LEN, E + AA_RX_TF_LEN*cache->n_frames );
+        }
+    }
+    pthread_mutex_unlock( &cache->mutex );
+
+    fclose(f);
+    return r;
+}
+
+AA_API int
+aa_rx_ik_set_cache( struct aa_rx_ik_cx *context, struct aa_rx_ik_cache *cache )
+{
+    if( cache &&
+        ( cache->n_q != aa_rx_sg_sub_config_count(context->ssg) ||
+          cache->n_frames != context->n_frames ) )
+    {
+        return AA_RX_INVALID_PARAMETER;
+    }
+    context->cache = cache;
+    return 0;
+}
@@ -56,9 +56,6 @@ static void kin_solve_sys( const void *vcx,
 
     const struct aa_rx_sg_sub *ssg = cx->ssg;
     size_t n_qs = aa_rx_sg_sub_config_count(ssg);
-    struct aa_dvec vq = AA_DVEC_INIT(cx->q_sub->len,(double*)q,1);
-
-    aa_rx_fk_sub(cx->fk, cx->ssg, &vq);
 
     struct aa_dvec v_dq;
     aa_dvec_view(&v_dq, n_qs, dq, 1);
@@ -90,16 +87,23 @@ static int kin_solve_check( void *vcx, double t, double *AA_RESTRICT x, double *
     /* Check term */
     double dq_norm = aa_la_dot( cx->q_sub->len, y, y );
 
-    struct aa_dvec vq = AA_DVEC_INIT(cx->q_sub->len,x,1);
-    aa_rx_fk_sub(cx->fk, cx->ssg, &vq);
-    double *E_act = aa_rx_fk_ref(cx->fk, cx->frame);
-
-    double theta_err, x_err;
-    s_err2( E_act, cx->TF_ref->data, &theta_err, &x_err );
+    double E_act[AA_RX_TF_LEN*cx->n_frames];
+    s_ksol_fk_jac( cx, x, E_act, NULL );
+
+    /* Every target must be within tolerance */
+    int in_tol = 1;
+    for( size_t k = 0; in_tol && k < cx->n_frames; k ++ ) {
+        double theta_err, x_err;
+        s_err2( E_act + AA_RX_TF_LEN*k, &AA_DMAT_REF(cx->TF_all,0,k),
+                &theta_err, &x_err );
+        in_tol = (theta_err < cx->opts->tol_angle) &&
+            (x_err < cx->opts->tol_trans);
+    }
 
     cx->iteration++;
-    if( (theta_err < cx->opts->tol_angle) &&
-        (x_err < cx->opts->tol_trans) &&
+    if( s_ik_cancelled(cx->ik_cx) ) {
+        return -1;
+    } else if( in_tol &&
         (dq_norm < cx->opts->tol_dq) )
     {
         return 1;
@@ -0,0 +1,287 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * Copyright (c) 2015, Rice University
+ * Copyright (c) 2019, Colorado School of Mines
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   * Neither the name of the Rice University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * Levenberg-Marquardt IK.
+ *
+ * Minimizes F(q) = 1/2 * sum_k |w_k * e_k(q)|^2, where e_k is the pose
+ * error of target k as a spatial velocity, with the velocity Jacobian
+ * as the derivative of e_k.  The damping adapts to the gain ratio of
+ * each step (Nielsen's rule) and every step is projected onto the
+ * position limits.  Scratch space is on the stack.
+ */
+
+/* Weighted error at E_act, returns whether all targets are in tolerance */
+static int
+s_lma_err( const struct kin_solve_cx *cx, const double *E_act,
+           double *e, double *F )
+{
+    int in_tol = 1;
+    double ssq = 0;
+    for( size_t k = 0; k < cx->n_frames; k ++ ) {
+        const double *E_k = E_act + AA_RX_TF_LEN*k;
+        const double *E_ref = &AA_DMAT_REF(cx->TF_all,0,k);
+        struct aa_dvec e_k = AA_DVEC_INIT(6, e + 6*k, 1);
+        aa_dvec_zero( &e_k );
+        aa_rx_wk_dx_pos( &cx->opts->wk_opts, E_k, E_ref, &e_k );
+        aa_dvec_scal( cx->weights[k], &e_k );
+        ssq += aa_dvec_dot( &e_k, &e_k );
+
+        double theta, x;
+        s_err2( E_k, E_ref, &theta, &x );
+        in_tol = in_tol &&
+            (theta < cx->opts->tol_angle) && (x < cx->opts->tol_trans);
+    }
+    *F = ssq / 2;
+    return in_tol;
+}
+
+/* Poses and weighted Jacobian at q */
+static void
+s_lma_fk_jac( const struct kin_solve_cx *cx, const double *q,
+              double *E_act, struct aa_dmat *J )
+{
+    s_ksol_fk_jac( cx, q, E_act, J );
+    for( size_t k = 0; k < cx->n_frames; k ++ ) {
+        if( 1 != cx->weights[k] ) {
+            struct aa_dmat J_k;
+            aa_dmat_view_block( &J_k, J, 6*k, 0, 6, J->cols );
+            aa_dmat_scal( &J_k, cx->weights[k] );
+        }
+    }
+}
+
+/* Solve (J^T*J + mu*I) * h = J^T*e, using the smaller normal system */
+static int
+s_lma_step( size_t m, size_t n, const double *J, double mu,
+            const double *e, double *h )
+{
+    size_t p = AA_MIN(m,n);
+    double A[p*p], y[m];
+    int r;
+    if( m < n ) {
+        // (J*J^T + mu*I) * y = e, h = J^T*y
+        for( size_t j = 0; j < m; j ++ ) {
+            for( size_t i = 0; i <= j; i ++ ) {
+                double s = 0;
+                for( size_t c = 0; c < n; c ++ ) s += J[i+c*m] * J[j+c*m];
+                A[i+j*m] = s;
+            }
+            A[j+j*m] += mu;
+        }
+        AA_MEM_CPY( y, e, m );
+        r = aa_cla_dposv( 'U', (int)m, 1, A, (int)m, y, (int)m );
+        for( size_t c = 0; c < n; c ++ ) {
+            h[c] = aa_la_dot( m, J + c*m, y );
+        }
+    } else {
+        for( size_t j = 0; j < n; j ++ ) {
+            for( size_t i = 0; i <= j; i ++ ) {
+                A[i+j*n] = aa_la_dot( m, J + i*m, J + j*m );
+            }
+            A[j+j*n] += mu;
+            h[j] = aa_la_dot( m, J + j*m, e );
+        }
+        r = aa_cla_dposv( 'U', (int)n, 1, A, (int)n, h, (int)n );
+    }
+    return r;
+}
+
+/* Iterate and scratch of the solver, resumable between calls */
+struct lma_state {
+    size_t n, m;
+    double *x, *x_t, *h, *min, *max;
+    double *E, *e, *e_t, *Jh;
+    struct aa_dmat J, J_t;
+    double F, mu, nu;
+    int in_tol;
+};
+
+static size_t
+s_lma_size( size_t n, size_t n_frames )
+{
+    size_t m = 6*n_frames;
+    return 5*n + AA_RX_TF_LEN*n_frames + 3*m + 2*m*n;
+}
+
+/* Lay out the state over buf of s_lma_size() doubles */
+static void
+s_lma_bind( struct lma_state *s, size_t n, size_t n_frames, double *buf )
+{
+    size_t m = 6*n_frames;
+    s->n = n;
+    s->m = m;
+    s->x = buf;
+    s->x_t = s->x + n;
+    s->h = s->x_t + n;
+    s->min = s->h + n;
+    s->max = s->min + n;
+    s->E = s->max + n;
+    s->e = s->E + AA_RX_TF_LEN*n_frames;
+    s->e_t = s->e + m;
+    s->Jh = s->e_t + m;
+    aa_dmat_view( &s->J, m, n, s->Jh + m, m );
+    aa_dmat_view( &s->J_t, m, n, s->J.data + m*n, m );
+}
+
+/* Start from q: limits, error, Jacobian, and initial damping */
+static void
+s_lma_init( struct kin_solve_cx *cx, struct lma_state *s, const double *q )
+{
+    const struct aa_rx_sg_sub *ssg = cx->ssg;
+    size_t n = s->n, m = s->m;
+    for( size_t i = 0; i < n; i ++ ) {
+        aa_rx_config_id id = aa_rx_sg_sub_config(ssg,i);
+        if( aa_rx_sg_get_limit_pos(ssg->scenegraph, id, &s->min[i], &s->max[i]) ) {
+            s->min[i] = -DBL_MAX;
+            s->max[i] = DBL_MAX;
+        }
+        s->x[i] = aa_fclamp( q[i], s->min[i], s->max[i] );
+    }
+
+    s_lma_fk_jac( cx, s->x, s->E, &s->J );
+    s->in_tol = s_lma_err( cx, s->E, s->e, &s->F );
+
+    /* initial damping scales with the largest diagonal of J^T*J */
+    s->mu = 0;
+    s->nu = 2;
+    for( size_t j = 0; j < n; j ++ ) {
+        s->mu = AA_MAX( s->mu, aa_la_dot(m, s->J.data + j*m, s->J.data + j*m) );
+    }
+    s->mu *= cx->opts->wk_opts.k_dls;
+    if( s->mu <= 0 ) s->mu = DBL_EPSILON;
+}
+
+/*
+ * One damped step, accepted only if it decreases the error, so the
+ * iterate is always the best so far.  Returns nonzero when stalled.
+ */
+static int
+s_lma_iterate( struct kin_solve_cx *cx, struct lma_state *s )
+{
+    size_t n = s->n, m = s->m;
+    double *x = s->x, *x_t = s->x_t, *h = s->h;
+
+    if( s_lma_step( m, n, s->J.data, s->mu, s->e, h ) ) {
+        s->mu *= s->nu;
+        s->nu *= 2;
+        return 0;
+    }
+
+    /* project onto limits */
+    double h_ssq = 0, x_ssq = 0;
+    for( size_t i = 0; i < n; i ++ ) {
+        x_t[i] = aa_fclamp( x[i] + h[i], s->min[i], s->max[i] );
+        h[i] = x_t[i] - x[i];
+        h_ssq += h[i]*h[i];
+        x_ssq += x[i]*x[i];
+    }
+    /* stalled at a local minimum or against the limits */
+    const double eps = 1e-12;
+    if( sqrt(h_ssq) <= eps*(sqrt(x_ssq) + eps) ) {
+        return 1;
+    }
+
+    /* gain ratio against the linear model decrease */
+    aa_la_mvmul( m, n, s->J.data, h, s->Jh );
+    double pred = aa_la_dot(m, s->Jh, s->e) - aa_la_dot(m, s->Jh, s->Jh) / 2;
+
+    double F_t;
+    s_lma_fk_jac( cx, x_t, s->E, &s->J_t );
+    int in_tol_t = s_lma_err( cx, s->E, s->e_t, &F_t );
+    double rho = (pred > 0) ? (s->F - F_t) / pred : -1;
+
+    if( rho > 0 ) {
+        AA_MEM_CPY( x, x_t, n );
+        AA_MEM_CPY( s->e, s->e_t, m );
+        AA_MEM_CPY( s->J.data, s->J_t.data, m*n );
+        s->F = F_t;
+        s->in_tol = in_tol_t;
+        double a = 2*rho - 1;
+        s->mu *= AA_MAX( 1.0/3, 1 - a*a*a );
+        s->nu = 2;
+    } else {
+        s->mu *= s->nu;
+        s->nu *= 2;
+    }
+    return 0;
+}
+
+static int
+s_ik_lma( struct kin_solve_cx *cx,
+          struct aa_dvec *q )
+{
+    size_t n = cx->q_sub->len;
+    if( 1 != cx->q_sub->inc || n != q->len ) {
+        return AA_RX_INVALID_PARAMETER;
+    }
+
+    double buf[s_lma_size(n, cx->n_frames)];
+    struct lma_state s;
+    s_lma_bind( &s, n, cx->n_frames, buf );
+    s_lma_init( cx, &s, cx->q_sub->data );
+
+    int r = AA_RX_NO_SOLUTION | AA_RX_NO_IK;
+    for( ;; cx->iteration ++ ) {
+        if( s.in_tol ) {
+            r = 0;
+            break;
+        }
+        if( cx->iteration >= cx->opts->max_iterations ||
+            s_ik_cancelled(cx->ik_cx) ||
+            s_lma_iterate( cx, &s ) )
+        {
+            break;
+        }
+    }
+
+    struct aa_dvec v_x = AA_DVEC_INIT(n, s.x, 1);
+    aa_dvec_copy( &v_x, q );
+    return r;
+}
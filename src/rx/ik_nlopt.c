@@ -76,6 +76,31 @@
 
 /* } */
 
+/*
+ * Jacobian of the current target frame.  With several targets, take
+ * the target's block of the stacked Jacobian.
+ */
+static struct aa_dmat *
+s_ksol_jac_get( const struct kin_solve_cx *cx, const struct aa_dvec *q, int vel )
+{
+    if( 1 == cx->n_frames ) {
+        return vel ?
+            aa_rx_sg_sub_jac_vel_get(cx->ssg, cx->reg, cx->fk) :
+            aa_rx_sg_sub_jac_twist_get(cx->ssg, cx->reg, cx->fk);
+    }
+
+    size_t n_q = q->len;
+    struct aa_dmat *J = aa_dmat_alloc(cx->reg, 6*cx->n_frames, n_q);
+    if( vel ) {
+        aa_rx_sg_sub_fk_jac_vel_ees( cx->ssg, cx->fk, q, NULL, 0, J );
+    } else {
+        aa_rx_sg_sub_fk_jac_twist_ees( cx->ssg, cx->fk, q, NULL, 0, J );
+    }
+    struct aa_dmat *J_k = AA_MEM_REGION_NEW(cx->reg, struct aa_dmat);
+    aa_dmat_view_block( J_k, J, 6*cx->i_target, 0, 6, n_q );
+    return J_k;
+}
+
 static double s_nlobj_dq_fd_helper( void *vcx, const struct aa_dvec *x)
 {
     struct kin_solve_cx *cx = (struct kin_solve_cx*)vcx;
@@ -138,7 +163,7 @@ duqu_rmul_helper( const double *Sr, const double *x, double *y )
 
 
 AA_API double
-aa_rx_ik_opt_err_dqln( void *vcx, double *q, double *dq ) {
+aa_rx_ik_opt_err_dqln( void *vcx, const double *q, double *dq ) {
     struct kin_solve_cx *cx = (struct kin_solve_cx*)vcx;
     void *ptrtop = aa_mem_region_ptr(cx->reg);
 
@@ -221,7 +246,7 @@ aa_rx_ik_opt_err_dqln( void *vcx, double *q, double *dq ) {
             struct aa_dvec vc = AA_DVEC_INIT(6,c,1);
             // Using Twist Jacobian
             aa_tf_duqu2pure(a,c);
-            struct aa_dmat *Jtw = aa_rx_sg_sub_jac_twist_get(cx->ssg, cx->reg, cx->fk);
+            struct aa_dmat *Jtw = s_ksol_jac_get(cx, &vq, 0);
             aa_dmat_gemv( CblasTrans, 1, Jtw, &vc, 0, &v_dq );
 
             // Using Velocity Jacobian
@@ -385,7 +410,7 @@ aa_rx_ik_opt_err_trans( void *vcx, const double *q, double *dq )
 
         struct aa_dvec v_dq = AA_DVEC_INIT(n,dq,1);
 
-        struct aa_dmat *Jvel = aa_rx_sg_sub_jac_vel_get(cx->ssg, cx->reg, cx->fk);
+        struct aa_dmat *Jvel = s_ksol_jac_get(cx, &vq, 1);
         struct aa_dmat Jr, Jv;
         aa_dmat_view_block(&Jv, Jvel, AA_TF_DX_V, 0, 3, Jvel->cols);
         aa_dmat_view_block(&Jr, Jvel, AA_TF_DX_W, 0, 3, Jvel->cols);
@@ -453,7 +478,7 @@ aa_rx_ik_opt_err_qlnpv( void *vcx, const double *q, double *dq )
 
         struct aa_dvec v_dq = AA_DVEC_INIT(n,dq,1);
 
-        struct aa_dmat *Jvel = aa_rx_sg_sub_jac_vel_get(cx->ssg, cx->reg, cx->fk);
+        struct aa_dmat *Jvel = s_ksol_jac_get(cx, &vq, 1);
         struct aa_dmat Jr, Jv;
         aa_dmat_view_block(&Jv, Jvel, AA_TF_DX_V, 0, 3, Jvel->cols);
         aa_dmat_view_block(&Jr, Jvel, AA_TF_DX_W, 0, 3, Jvel->cols);
@@ -557,14 +582,87 @@ aa_rx_ik_opt_err_jcenter( void *vcx, const double *q, double *dq )
 struct err_cx {
     void *cx;
     aa_rx_ik_opt_fun *fun;
+    nlopt_opt opt;
 };
 
 static double
 s_err_cx_dispatch(unsigned n, const double *q, double *dq, void *vcx)
 {
-    (void)n;
     struct err_cx *cx = (struct err_cx *)vcx;
-    return cx->fun(cx->cx, q, dq);
+    struct kin_solve_cx *kcx = (struct kin_solve_cx *)cx->cx;
+    if( cx->opt && s_ik_cancelled(kcx->ik_cx) ) {
+        nlopt_force_stop(cx->opt);
+    }
+    if( 1 == kcx->n_frames ) {
+        return cx->fun(cx->cx, q, dq);
+    }
+
+    /* Weighted sum over targets */
+    double g[n+1];
+    double result = 0;
+    if( dq ) AA_MEM_ZERO(dq, n);
+    for( size_t k = 0; k < kcx->n_frames; k ++ ) {
+        double w = kcx->weights[k];
+        s_ksol_target( kcx, k );
+        result += w * cx->fun(kcx, q, dq ? g : NULL);
+        if( dq ) {
+            for( size_t i = 0; i < n; i ++ ) dq[i] += w * g[i];
+        }
+    }
+    s_ksol_target( kcx, 0 );
+    return result;
+}
+
+static double
+s_grad_check_fd_helper( void *vcx, const struct aa_dvec *x )
+{
+    assert(1 == x->inc);
+    return s_err_cx_dispatch( (unsigned)x->len, x->data, NULL, vcx );
+}
+
+AA_API int
+aa_rx_ik_opt_check_grad( const struct aa_rx_ik_cx *context,
+                         aa_rx_ik_opt_fun *fun,
+                         const struct aa_dmat *TF,
+                         const struct aa_dvec *q,
+                         double eps, double *err )
+{
+    size_t n = aa_rx_sg_sub_config_count(context->ssg);
+    if( n != q->len || AA_RX_TF_LEN != TF->rows
+        || context->n_frames != TF->cols )
+    {
+        return AA_RX_INVALID_PARAMETER;
+    }
+    if( eps <= 0 ) eps = 1e-6;
+
+    struct kin_solve_cx *kcx = s_kin_solve_cx_alloc( context,
+                                                     aa_mem_region_local_get() );
+    struct aa_mem_region *reg = kcx->reg;
+    kcx->TF_all = TF;
+    s_ksol_target( kcx, 0 );
+
+    /* Evaluate through the same dispatch NLopt sees */
+    struct err_cx ecx;
+    ecx.cx = kcx;
+    ecx.fun = fun;
+    ecx.opt = NULL;
+
+    struct aa_dvec *x = aa_dvec_dup(reg, q);
+    struct aa_dvec *g_an = aa_dvec_alloc(reg, n);
+    struct aa_dvec *g_fd = aa_dvec_alloc(reg, n);
+    s_err_cx_dispatch( (unsigned)n, x->data, g_an->data, &ecx );
+    aa_de_grad_fd( s_grad_check_fd_helper, &ecx, x, eps, g_fd );
+
+    double e = 0, scale = 1;
+    for( size_t i = 0; i < n; i ++ ) {
+        double a = AA_DVEC_REF(g_an,i), b = AA_DVEC_REF(g_fd,i);
+        e = AA_MAX( e, fabs(a-b) );
+        scale = AA_MAX( scale, fabs(b) );
+    }
+    *err = e / scale;
+
+    aa_mem_region_pop(reg, kcx);
+    return 0;
 }
 
 static int
@@ -587,16 +685,26 @@ s_ik_nlopt( struct kin_solve_cx *cx,
 
     struct err_cx ocx, eqctcx;
     ocx.cx = cx;
+    ocx.opt = opt;
     ocx.fun = cx->ik_cx->opts->obj_fun;
     nlopt_set_min_objective(opt, s_err_cx_dispatch, &ocx);
 
     if( cx->ik_cx->opts->eqct_fun ) {
         eqctcx.cx = cx;
+        eqctcx.opt = opt;
         eqctcx.fun = cx->ik_cx->opts->eqct_fun;
         nlopt_add_equality_constraint(opt, s_err_cx_dispatch, &eqctcx,
                                       cx->ik_cx->opts->eqct_tol);
     }
 
+    size_t n_ineqct = cx->ik_cx->ineqct_fun ? cx->ik_cx->ineqct_count : 0;
+    if( n_ineqct ) {
+        double *tol = AA_MEM_REGION_NEW_N(reg,double,n_ineqct);
+        for( size_t i = 0; i < n_ineqct; i ++ ) tol[i] = cx->ik_cx->ineqct_tol;
+        nlopt_add_inequality_mconstraint(opt, (unsigned)n_ineqct,
+                                         s_ineqct_dispatch, cx, tol);
+    }
+
 
     //nlopt_set_xtol_rel(opt, 1e-4); // TODO: make a parameter
     if( cx->opts->tol_obj_abs >= 0 )
@@ -634,8 +742,12 @@ s_ik_nlopt( struct kin_solve_cx *cx,
 
 
     aa_rx_fk_sub(cx->fk, cx->ssg, q);
-    double *E_act = aa_rx_fk_ref(cx->fk, cx->frame);
-    int result = s_check(cx->ik_cx, cx->TF_ref, E_act );
+    int result = 0;
+    for( size_t k = 0; 0 == result && k < cx->n_frames; k ++ ) {
+        s_ksol_target( cx, k );
+        double *E_act = aa_rx_fk_ref(cx->fk, cx->frame);
+        result = s_check(cx->ik_cx, cx->TF_ref, E_act );
+    }
     nlopt_destroy(opt);
     aa_mem_region_pop(reg,ptrtop);
 
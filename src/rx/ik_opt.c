@@ -97,6 +97,7 @@ aa_rx_ik_parm_destroy( struct aa_rx_ik_parm *opts)
 }
 
 AA_DEF_SETTER( aa_rx_ik_parm, enum aa_rx_ik_algo, ik_algo )
+AA_DEF_SETTER_SUB( aa_rx_ik_parm, enum aa_rx_ik_algo, algo, ik_algo )
 
 AA_DEF_SETTER( aa_rx_ik_parm, double, dt )
 AA_DEF_SETTER( aa_rx_ik_parm, double, tol_angle )
@@ -0,0 +1,184 @@
+/* -*- mode: C; c-basic-offset: 4 -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2013, Georgia Tech Research Corporation
+ * Copyright (c) 2015, Rice University
+ * Copyright (c) 2019, Colorado School of Mines
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@gatech.edu>
+ * Georgia Tech Humanoid Robotics Lab
+ * Under Direction of Prof. Mike Stilman <mstilman@cc.gatech.edu>
+ *
+ *
+ * This file is provided under the following "BSD-style" License:
+ *
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *   * Neither the name of the Rice University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * Real-time IK.
+ *
+ * Each call runs Levenberg-Marquardt iterations within an iteration
+ * and time budget, keeping the iterate between calls.  The solver
+ * context and its scratch are allocated at creation, so iterations do
+ * not allocate.  Closed-form solutions are checked in the thread-local
+ * region, which aa_rx_ik_prepare() reserves.
+ */
+
+struct aa_rx_ik_rt {
+    const struct aa_rx_ik_cx *cx;
+    struct aa_mem_region reg;
+    struct kin_solve_cx *kcx;
+
+    double *TF_data;            /* current target */
+    struct aa_dmat TF;
+
+    double *buf;
+    struct lma_state s;
+    int started;
+
+    size_t max_iterations;
+    double max_time;
+    double t_iter;              /* mean time per iteration */
+};
+
+AA_API struct aa_rx_ik_rt *
+aa_rx_ik_rt_create( const struct aa_rx_ik_cx *cx )
+{
+    struct aa_rx_ik_rt *rt = AA_NEW0(struct aa_rx_ik_rt);
+    size_t n_q = aa_rx_sg_sub_config_count(cx->ssg);
+    rt->cx = cx;
+    aa_mem_region_init( &rt->reg, 4096 );
+    rt->kcx = s_kin_solve_cx_alloc( cx, &rt->reg );
+
+    rt->TF_data = AA_NEW0_AR(double, AA_RX_TF_LEN*cx->n_frames);
+    aa_dmat_view( &rt->TF, AA_RX_TF_LEN, cx->n_frames, rt->TF_data, AA_RX_TF_LEN );
+    rt->kcx->TF_all = &rt->TF;
+    s_ksol_target( rt->kcx, 0 );
+
+    rt->buf = AA_NEW_AR(double, s_lma_size(n_q, cx->n_frames));
+    s_lma_bind( &rt->s, n_q, cx->n_frames, rt->buf );
+
+    rt->max_iterations = cx->opts->max_iterations;
+    rt->max_time = 0;
+    return rt;
+}
+
+AA_API void
+aa_rx_ik_rt_destroy( struct aa_rx_ik_rt *rt )
+{
+    aa_mem_region_destroy( &rt->reg );
+    free(rt->TF_data);
+    free(rt->buf);
+    free(rt);
+}
+
+AA_API void
+aa_rx_ik_rt_set_budget( struct aa_rx_ik_rt *rt, size_t iterations, double seconds )
+{
+    rt->max_iterations = iterations;
+    rt->max_time = seconds;
+}
+
+AA_API void
+aa_rx_ik_rt_reset( struct aa_rx_ik_rt *rt, const struct aa_dvec *q )
+{
+    if( q ) aa_dvec_copy( q, rt->kcx->q_sub );
+    else aa_dvec_copy( rt->cx->q_seed, rt->kcx->q_sub );
+    rt->started = 0;
+}
+
+AA_API int
+aa_rx_ik_rt_step( struct aa_rx_ik_rt *rt,
+                  const struct aa_dmat *TF,
+                  struct aa_dvec *q,
+                  double *residual )
+{
+    struct timespec t0 = aa_tm_now();
+    const struct aa_rx_ik_cx *cx = rt->cx;
+    struct kin_solve_cx *kcx = rt->kcx;
+    struct lma_state *s = &rt->s;
+    if( AA_RX_TF_LEN != TF->rows || cx->n_frames != TF->cols || s->n != q->len ) {
+        return AA_RX_INVALID_PARAMETER;
+    }
+
+    /* a new target keeps the iterate but restarts the damping */
+    int changed = 0;
+    for( size_t k = 0; k < cx->n_frames; k ++ ) {
+        const double *E = &AA_DMAT_REF(TF,0,k);
+        double *E_rt = rt->TF_data + AA_RX_TF_LEN*k;
+        if( memcmp(E, E_rt, AA_RX_TF_LEN*sizeof(double)) ) {
+            AA_MEM_CPY( E_rt, E, AA_RX_TF_LEN );
+            changed = 1;
+        }
+    }
+    if( ! rt->started ) {
+        s_lma_init( kcx, s, kcx->q_sub->data );
+        rt->started = 1;
+    } else if( changed ) {
+        s_lma_init( kcx, s, s->x );
+    }
+
+    /* a closed-form solution is within any budget */
+    if( ! s->in_tol && cx->analytic ) {
+        struct aa_dvec v_x = AA_DVEC_INIT(s->n, s->x, 1);
+        struct aa_dvec v_t = AA_DVEC_INIT(s->n, s->x_t, 1);
+        if( 0 == aa_rx_ik_analytic_nearest( cx, &rt->TF, &v_x, &v_t ) ) {
+            s_lma_init( kcx, s, s->x_t );
+        }
+    }
+
+    struct timespec t_last = t0;
+    for( size_t i = 0; ! s->in_tol && i < rt->max_iterations; i ++ ) {
+        /* stop unless another iteration fits in the time budget */
+        if( rt->max_time > 0 ) {
+            struct timespec now = aa_tm_now();
+            double dt = aa_tm_timespec2sec( aa_tm_sub(now, t0) );
+            if( i > 0 ) {
+                double t_i = aa_tm_timespec2sec( aa_tm_sub(now, t_last) );
+                rt->t_iter = (rt->t_iter > 0) ? .9*rt->t_iter + .1*t_i : t_i;
+            }
+            t_last = now;
+            if( dt + rt->t_iter > rt->max_time ) break;
+        }
+        if( s_lma_iterate( kcx, s ) ) break;
+    }
+
+    struct aa_dvec v_x = AA_DVEC_INIT(s->n, s->x, 1);
+    aa_dvec_copy( &v_x, q );
+    if( residual ) *residual = sqrt( 2*s->F );
+    if( ! s->in_tol ) return AA_RX_NO_SOLUTION | AA_RX_NO_IK;
+    return s_ineqct_check( kcx, q );
+}
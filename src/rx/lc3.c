@@ -59,12 +59,55 @@
 
 #include "amino/rx/scene_wk_internal.h"
 
+/*
+ * Arrays of an LC3 linear program.
+ *
+ * Sections are contiguous in this order so each is compared with
+ * one memcmp.
+ */
+struct lc3_lp {
+    double *A;          /* n_q * (n_x+1) */
+    double *b_min;      /* n_q */
+    double *b_max;      /* n_q */
+    double *x_min;      /* n_x+1 */
+    double *x_max;      /* n_x+1 */
+    double *c;          /* n_x+1 */
+    double *end;
+};
+
 struct aa_rx_wk_lc3_cx {
     struct aa_opt_cx *opt_cx;
     const struct aa_rx_sg_sub *ssg;
     struct aa_rx_wk_opts wk_opts;
+
+    struct lc3_lp *lp;          /* this tick's LP, then the last tick's */
+    struct aa_rx_wk_lc3_stats *stats;
 };
 
+static size_t
+lc3_lp_size( size_t n_x, size_t n_q )
+{
+    return n_q*(n_x+1) + 2*n_q + 3*(n_x+1);
+}
+
+static void
+lc3_lp_bind( struct lc3_lp *lp, size_t n_x, size_t n_q, double *buf )
+{
+    lp->A     = buf;
+    lp->b_min = lp->A + n_q*(n_x+1);
+    lp->b_max = lp->b_min + n_q;
+    lp->x_min = lp->b_max + n_q;
+    lp->x_max = lp->x_min + n_x + 1;
+    lp->c     = lp->x_max + n_x + 1;
+    lp->end   = lp->c + n_x + 1;
+}
+
+static int
+lc3_lp_changed( const double *a0, const double *a1, const double *b0 )
+{
+    return 0 != memcmp( a0, b0, (size_t)(a1-a0)*sizeof(double) );
+}
+
 
 static void
 lc3_constraints (
@@ -78,12 +121,7 @@ lc3_constraints (
     const struct aa_dvec *q_a,
     const struct aa_dvec *dq_a,
     const struct aa_dvec *dq_r,
-    double **pA,
-    double **pb_min,
-    double **pb_max,
-    double **px_min,
-    double **px_max,
-    double **pc
+    struct lc3_lp *lp
     )
 {
     struct aa_mem_region *reg =  aa_mem_region_local_get();
@@ -102,29 +140,20 @@ lc3_constraints (
      *   x_lower <=   x <= x_upper
      *   b_lower <= A*x <= b_upper
      */
-    double *A     = AA_MEM_REGION_NEW_N( reg, double, n_q * (n_x+1) );
-    double *b_min = AA_MEM_REGION_NEW_N( reg, double, n_q );
-    double *b_max = AA_MEM_REGION_NEW_N( reg, double, n_q );
-    double *x_min = AA_MEM_REGION_NEW_N( reg, double, n_x + 1 );
-    double *x_max = AA_MEM_REGION_NEW_N( reg, double, n_x + 1 );
-    double *c     = AA_MEM_REGION_NEW_N( reg, double, n_x + 1 );
-    *pA     = A;
-    *pb_min = b_min;
-    *pb_max = b_max;
-    *px_min = x_min;
-    *px_max = x_max;
-    *pc     = c;
-
-
-
-    // Rest of allocated arrays are local temps
+    double *A     = lp->A;
+    double *b_min = lp->b_min;
+    double *b_max = lp->b_max;
+    double *x_min = lp->x_min;
+    double *x_max = lp->x_max;
+    double *c     = lp->c;
+
     void *ptrtop = aa_mem_region_ptr(reg);
 
-    struct aa_dmat *J = aa_rx_sg_sub_jac_vel_get( ssg, reg, fk );
-    //struct aa_dmat *J = aa_rx_sg_sub_get_jac_vel_get( ssg, reg, fk );
+    struct aa_dmat *J = aa_dmat_alloc( reg, n_x, n_q );
+    aa_rx_sg_sub_fk_jac_vel( ssg, fk, q_a, NULL, J );
     struct aa_dmat vJstar = AA_DMAT_INIT( n_q, n_x, A, n_q );
     struct aa_dmat *N  = aa_dmat_alloc(reg, n_q, n_q);
-    aa_rx_wk_get_js( ssg, &cx->wk_opts, fk, J, &vJstar );
+    aa_rx_wk_get_jstar( &cx->wk_opts, J, &vJstar );
     aa_rx_wk_get_n( ssg, &cx->wk_opts, J, &vJstar, 1, N );
 
     struct aa_dvec *dq_rn  = aa_dvec_alloc(reg, n_q );
@@ -231,6 +260,14 @@ aa_rx_wk_lc3_create ( const struct aa_rx_sg_sub *ssg,
     const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
     size_t n_qall = aa_rx_sg_config_count(sg);
 
+    /* the LP of the current tick, then of the last tick */
+    size_t n_lp = lc3_lp_size(n_x, n_q);
+    double *buf = AA_NEW_AR(double, 2*n_lp);
+    cx->lp = AA_NEW_AR(struct lc3_lp, 2);
+    lc3_lp_bind( cx->lp, n_x, n_q, buf );
+    lc3_lp_bind( cx->lp+1, n_x, n_q, buf+n_lp );
+    cx->stats = AA_NEW0(struct aa_rx_wk_lc3_stats);
+
 
     struct aa_dvec *dx_r = aa_dvec_alloc(reg,n_x);
     struct aa_dvec *dq_a = aa_dvec_alloc(reg,n_q);
@@ -251,31 +288,23 @@ aa_rx_wk_lc3_create ( const struct aa_rx_sg_sub *ssg,
     struct aa_rx_fk *fk = aa_rx_fk_alloc(sg,reg);
     aa_rx_fk_all(fk,&qv);
 
-
-    double *A;
-    double *b_min, *b_max;
-    double *x_min, *x_max;
-    double *c;
-
+    struct lc3_lp *lp = cx->lp+1;
     lc3_constraints (
         cx, dt,
         n_x, n_q,
         fk,
         dx_r,
         q_a, dq_a, dq_r,
-        &A,
-        &b_min, &b_max,
-        &x_min, &x_max,
-        &c );
+        lp );
 
 
     cx->opt_cx =
         aa_opt_gmcreate( opts->lp_solver,
                          n_q, n_x+1,
-                         A, n_q,
-                         b_min, b_max,
-                         c,
-                         x_min, x_max );
+                         lp->A, n_q,
+                         lp->b_min, lp->b_max,
+                         lp->c,
+                         lp->x_min, lp->x_max );
 
     aa_opt_set_direction( cx->opt_cx, AA_OPT_MAXIMIZE );
 
@@ -284,9 +313,26 @@ aa_rx_wk_lc3_create ( const struct aa_rx_sg_sub *ssg,
     return cx;
 }
 
+AA_API void
+aa_rx_wk_lc3_destroy( struct aa_rx_wk_lc3_cx *cx )
+{
+    if( cx->opt_cx ) aa_opt_destroy( cx->opt_cx );
+    free( cx->lp[0].A );
+    free( cx->lp );
+    free( cx->stats );
+    free( cx );
+}
+
+AA_API void
+aa_rx_wk_lc3_get_stats( const struct aa_rx_wk_lc3_cx *cx,
+                        struct aa_rx_wk_lc3_stats *stats )
+{
+    memcpy( stats, cx->stats, sizeof(*stats) );
+}
+
 
 AA_API int
-aa_rx_wk_dx2dq_lc3( const struct aa_rx_wk_lc3_cx *cx,
+aa_rx_wk_dx2dq_lc3( struct aa_rx_wk_lc3_cx *cx,
                     double dt,
                     const struct aa_rx_fk *fk,
                     const struct aa_dvec *dx_r,
@@ -294,7 +340,8 @@ aa_rx_wk_dx2dq_lc3( const struct aa_rx_wk_lc3_cx *cx,
                     const struct aa_dvec *dq_r, struct aa_dvec *dq )
 {
 
-    if( dt <= 0 ) return -1;
+    if( dt <= 0 || NULL == cx->opt_cx ) return -1;
+    struct timespec t0 = aa_tm_now();
     const struct aa_rx_sg_sub *ssg = cx->ssg;
 
 
@@ -307,35 +354,42 @@ aa_rx_wk_dx2dq_lc3( const struct aa_rx_wk_lc3_cx *cx,
     aa_la_check_size( dq->len,   n_q);
 
 
-    struct aa_mem_region *reg =  aa_mem_region_local_get();
-    void *ptrtop = aa_mem_region_ptr(reg);
-
-
-    double *A;
-    double *b_min, *b_max;
-    double *x_min, *x_max;
-    double *c;
-
+    struct lc3_lp *lp = cx->lp, *lp0 = cx->lp+1;
     lc3_constraints (
         cx, dt,
         n_x, n_q,
         fk,
         dx_r,
         q_a, dq_a, dq_r,
-        &A,
-        &b_min, &b_max,
-        &x_min, &x_max,
-        &c );
+        lp );
 
-    double *opt_x = AA_MEM_REGION_NEW_N(reg,double, 1+n_x);
+    /* Update only what changed since the last tick.  The solver keeps
+     * its basis, so the previous solution warm starts the next. */
     struct aa_opt_cx *opt_cx = cx->opt_cx;
-    aa_opt_set_obj( opt_cx, n_x+1, c );
-    aa_opt_set_bnd( opt_cx, n_x+1, x_min, x_max );
-    aa_opt_set_cstr_gm( opt_cx, n_q, n_x+1, A, n_q, b_min, b_max );
+    struct aa_rx_wk_lc3_stats *stats = cx->stats;
+    if( lc3_lp_changed(lp->c, lp->end, lp0->c) ) {
+        aa_opt_set_obj( opt_cx, n_x+1, lp->c );
+    }
+    if( lc3_lp_changed(lp->x_min, lp->c, lp0->x_min) ) {
+        aa_opt_set_bnd( opt_cx, n_x+1, lp->x_min, lp->x_max );
+    }
+    int set_matrix = lc3_lp_changed(lp->A, lp->b_min, lp0->A);
+    if( ! set_matrix && lc3_lp_changed(lp->b_min, lp->x_min, lp0->b_min) ) {
+        set_matrix = aa_opt_set_cstr_bnd( opt_cx, n_q, lp->b_min, lp->b_max );
+    }
+    if( set_matrix ) {
+        aa_opt_set_cstr_gm( opt_cx, n_q, n_x+1, lp->A, n_q, lp->b_min, lp->b_max );
+        stats->matrix_updates++;
+    }
+    AA_MEM_CPY( lp0->A, lp->A, lc3_lp_size(n_x, n_q) );
 
+    double opt_x[1+n_x];
+    struct timespec t_solve = aa_tm_now();
     int  r = aa_opt_solve( opt_cx, n_x+1, opt_x );
+    stats->time_solve = aa_tm_timespec2sec( aa_tm_sub(aa_tm_now(), t_solve) );
 
     if( 0 == r ) {
+        double *A = lp->A;
         // extract velocity
         aa_dvec_copy(dq_a, dq);
 
@@ -353,7 +407,9 @@ aa_rx_wk_dx2dq_lc3( const struct aa_rx_wk_lc3_cx *cx,
 
     }
 
-    aa_mem_region_pop(reg,ptrtop);
+    stats->ticks++;
+    stats->time_tick = aa_tm_timespec2sec( aa_tm_sub(aa_tm_now(), t0) );
+    stats->time_tick_max = AA_MAX( stats->time_tick_max, stats->time_tick );
 
     return r;
 }
@@ -54,21 +54,27 @@ sgStateValidityChecker::sgStateValidityChecker(sgSpaceInformation *si)
     TypedStateValidityChecker(si),
     q_all(new double[getTypedStateSpace()->config_count_all()]),
     cl(aa_rx_cl_create(getTypedStateSpace()->scene_graph)),
+    fk(aa_rx_fk_malloc(getTypedStateSpace()->scene_graph)),
+    cl_full(true),
     collisions(NULL)
 {
+    size_t n_q = getTypedStateSpace()->config_count_all();
+    std::fill( q_all, q_all + n_q, 0 );
+    struct aa_dvec vq = AA_DVEC_INIT( n_q, q_all, 1 );
+    aa_rx_fk_all( fk, &vq );
     this->allow();
 }
 
 sgStateValidityChecker::~sgStateValidityChecker()
 {
     delete [] q_all;
+    aa_rx_fk_destroy(this->fk);
     aa_rx_cl_destroy(this->cl);
 }
 
 bool sgStateValidityChecker::isValid(const ompl::base::State *state) const
 {
     sgStateSpace *space = getTypedStateSpace();
-    size_t n_f = space->frame_count();
     int is_collision;
 
     // check collision
@@ -76,10 +82,18 @@ bool sgStateValidityChecker::isValid(const ompl::base::State *state) const
         std::lock_guard<std::mutex> lock(mutex);
 
         const sgSpaceInformation::StateType* state_ = state->as<sgSpaceInformation::StateType>();
-        double *TF_abs = space->get_tf_abs(state, this->q_all);
-        is_collision = aa_rx_cl_check( this->cl, n_f, TF_abs, 7, this->collisions );
 
-        space->region_pop(TF_abs);
+        // Only frames moved by the planning sub-scenegraph change
+        // between states; the rest stay at the start configuration.
+        struct aa_dvec vq = AA_DVEC_INIT( space->config_count_subset(), state_->values, 1 );
+        aa_rx_fk_sub( this->fk, space->sub_scene_graph, &vq );
+        if( cl_full ) {
+            is_collision = aa_rx_cl_check_fk( this->cl, this->fk, this->collisions );
+            cl_full = false;
+        } else {
+            is_collision = aa_rx_cl_check_sub( this->cl, space->sub_scene_graph,
+                                               this->fk, this->collisions );
+        }
     }
 
     return !is_collision;
@@ -90,6 +104,9 @@ void sgStateValidityChecker::set_start( size_t n_q, double *q_initial)
 {
     assert( n_q == getTypedStateSpace()->config_count_all() );
     std::copy( q_initial, q_initial + n_q, q_all );
+    struct aa_dvec vq = AA_DVEC_INIT( n_q, q_all, 1 );
+    aa_rx_fk_all( fk, &vq );
+    cl_full = true;
     this->allow();
 }
 
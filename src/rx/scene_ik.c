@@ -44,6 +44,13 @@
 #endif
 
 
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef HAVE_STDATOMIC_H
+#include <stdatomic.h>
+#endif /* HAVE_STDATOMIC_H */
+
 #include "amino.h"
 #include "amino/rx/rxtype.h"
 #include "amino/rx/rxerr.h"
@@ -63,12 +70,103 @@ static int
 s_ik_nlopt( struct kin_solve_cx *cx,
             struct aa_dvec *q );
 
+static int
+s_ik_lma( struct kin_solve_cx *cx,
+          struct aa_dvec *q );
+
+/* Shared state of concurrent IK starts */
+struct aa_rx_ik_race {
+    pthread_mutex_t mutex;
+#ifdef HAVE_STDATOMIC_H
+    atomic_int done;            ///< stop all starts, set under mutex
+#else
+    int done;                   ///< stop all starts
+#endif
+
+    const struct aa_dmat *TF;
+    struct timespec t0;
+
+    /* first solution */
+    struct aa_dvec *q;
+    int result;
+
+    /* all solutions */
+    int all;
+    struct aa_dmat *Q;
+    size_t n_sol;
+};
+
+/*
+ * Polled by every solver iteration, so avoid the mutex when atomics
+ * are available.  A stale read only costs one more iteration.
+ */
+static int
+s_ik_cancelled( const struct aa_rx_ik_cx *cx )
+{
+    if( NULL == cx->race ) return 0;
+#ifdef HAVE_STDATOMIC_H
+    return atomic_load_explicit( &cx->race->done, memory_order_relaxed );
+#else
+    pthread_mutex_lock( &cx->race->mutex );
+    int done = cx->race->done;
+    pthread_mutex_unlock( &cx->race->mutex );
+    return done;
+#endif
+}
+
+/* Inequality constraints in NLopt's form, also used by the checks below */
+static void
+s_ineqct_dispatch( unsigned m, double *c, unsigned n, const double *q,
+                   double *dc, void *vcx )
+{
+    struct kin_solve_cx *cx = (struct kin_solve_cx *)vcx;
+    const struct aa_rx_ik_cx *ik_cx = cx->ik_cx;
+
+    struct aa_dvec vq = AA_DVEC_INIT(n,(double*)q,1);
+    aa_rx_fk_sub(cx->fk, cx->ssg, &vq);
+
+    /* NLopt stores gradients row-major: one contiguous row per constraint */
+    struct aa_dvec vc = AA_DVEC_INIT(m,c,1);
+    struct aa_dmat vdc = AA_DMAT_INIT(n,m,dc,n);
+    ik_cx->ineqct_fun( ik_cx->ineqct_data, cx->ssg, cx->fk,
+                       &vc, dc ? &vdc : NULL );
+}
+
+/* Check the inequality constraints at q, leaving cx->fk at q */
+static int
+s_ineqct_check( struct kin_solve_cx *cx, const struct aa_dvec *q )
+{
+    const struct aa_rx_ik_cx *ik_cx = cx->ik_cx;
+    size_t m = ik_cx->ineqct_count;
+    if( NULL == ik_cx->ineqct_fun || 0 == m ) return 0;
+
+    double c[m];
+    s_ineqct_dispatch( (unsigned)m, c, (unsigned)q->len, q->data, NULL, cx );
+    for( size_t i = 0; i < m; i ++ ) {
+        if( c[i] > ik_cx->ineqct_tol ) return AA_RX_NO_SOLUTION | AA_RX_NO_IK;
+    }
+    return 0;
+}
+
+/* Make target k the current frame and reference pose. */
+static void
+s_ksol_target( struct kin_solve_cx *cx, size_t k )
+{
+    cx->i_target = k;
+    cx->frame = cx->frames[k];
+    aa_dmat_view_block( &cx->TF_col, cx->TF_all, 0, k, AA_RX_TF_LEN, 1 );
+    cx->TF_ref = &cx->TF_col;
+}
+
 
 static void s_set_frames( struct aa_rx_ik_cx *cx, size_t n_frames, const aa_rx_frame_id *frames )
 {
     if(cx->frames) free(cx->frames);
+    if(cx->weights) free(cx->weights);
     cx->n_frames = n_frames;
     cx->frames = AA_MEM_DUP(aa_rx_frame_id, frames, n_frames);
+    cx->weights = AA_NEW_AR(double, n_frames);
+    for( size_t i = 0; i < n_frames; i ++ ) cx->weights[i] = 1;
 }
 
 AA_API struct aa_rx_ik_cx *
@@ -79,6 +177,7 @@ aa_rx_ik_cx_create(const struct aa_rx_sg_sub *ssg, const struct aa_rx_ik_parm *o
     cx->opts = opts;
 
     cx->frames = NULL;
+    cx->weights = NULL;
     if ( AA_RX_FRAME_NONE == opts->frame ) {
         s_set_frames(cx,
                      aa_rx_sg_sub_frame_ee_count(ssg),
@@ -99,18 +198,55 @@ aa_rx_ik_cx_create(const struct aa_rx_sg_sub *ssg, const struct aa_rx_ik_parm *o
     aa_rx_sg_fill_tf_abs( aa_rx_sg_sub_sg(cx->ssg), cx->q_start, cx->TF );
     aa_rx_fk_all( cx->fk, cx->q_start );
 
+    aa_rx_ik_analytic_detect(cx);
 
     return cx;
 }
 
+AA_API struct aa_rx_ik_cx *
+aa_rx_ik_cx_clone( const struct aa_rx_ik_cx *cx )
+{
+    struct aa_rx_ik_cx *r = AA_NEW0(struct aa_rx_ik_cx);
+    r->ssg = cx->ssg;
+    r->opts = cx->opts;
+    r->restart_time = cx->restart_time;
+    r->threads = cx->threads;
+    r->warm_start = cx->warm_start;
+    r->cache = cx->cache;
+    r->analytic_disabled = cx->analytic_disabled;
+    r->ineqct_fun = cx->ineqct_fun;
+    r->ineqct_data = cx->ineqct_data;
+    r->ineqct_count = cx->ineqct_count;
+    r->ineqct_tol = cx->ineqct_tol;
+
+    s_set_frames(r, cx->n_frames, cx->frames);
+    AA_MEM_CPY(r->weights, cx->weights, cx->n_frames);
+
+    r->q_start = aa_dvec_malloc( cx->q_start->len );
+    aa_dvec_copy( cx->q_start, r->q_start );
+    r->q_seed = aa_dvec_malloc( cx->q_seed->len );
+    aa_dvec_copy( cx->q_seed, r->q_seed );
+
+    r->TF = aa_dmat_malloc( cx->TF->rows, cx->TF->cols );
+    aa_dmat_copy( cx->TF, r->TF );
+    r->fk = aa_rx_fk_malloc(aa_rx_sg_sub_sg(cx->ssg));
+    aa_rx_fk_cpy( r->fk, cx->fk );
+
+    aa_rx_ik_analytic_detect(r);
+
+    return r;
+}
+
 AA_API void
 aa_rx_ik_cx_destroy( struct aa_rx_ik_cx *cx )
 {
+    aa_rx_ik_analytic_destroy(cx);
     aa_rx_fk_destroy(cx->fk);
     free(cx->q_start);
     free(cx->q_seed);
     free(cx->TF);
     free(cx->frames);
+    free(cx->weights);
     free(cx);
 }
 
@@ -132,6 +268,7 @@ aa_rx_ik_set_start( struct aa_rx_ik_cx *context, const struct aa_dvec *q_start )
     aa_dvec_copy( q_start, context->q_start );
     aa_rx_sg_fill_tf_abs( aa_rx_sg_sub_sg(context->ssg), q_start, context->TF );
     aa_rx_fk_all( context->fk, q_start );
+    aa_rx_ik_analytic_detect( context );
 }
 
 AA_API void
@@ -169,6 +306,37 @@ AA_API void
 aa_rx_ik_set_frame_id( struct aa_rx_ik_cx *context, aa_rx_frame_id id )
 {
     s_set_frames(context, 1, &id);
+    aa_rx_ik_analytic_detect( context );
+}
+
+AA_API int
+aa_rx_ik_set_weights( struct aa_rx_ik_cx *context, size_t n, const double *w )
+{
+    if( n != context->n_frames ) return AA_RX_INVALID_PARAMETER;
+    AA_MEM_CPY( context->weights, w, n );
+    return 0;
+}
+
+AA_API void
+aa_rx_ik_set_ineqct( struct aa_rx_ik_cx *context, size_t m,
+                     aa_rx_ik_ineqct_fun *fun, void *data, double tol )
+{
+    context->ineqct_fun = fun;
+    context->ineqct_data = data;
+    context->ineqct_count = fun ? m : 0;
+    context->ineqct_tol = tol;
+}
+
+AA_API void
+aa_rx_ik_set_threads( struct aa_rx_ik_cx *context, size_t n )
+{
+    context->threads = n;
+}
+
+AA_API void
+aa_rx_ik_set_warm_start( struct aa_rx_ik_cx *context, int warm_start )
+{
+    context->warm_start = warm_start;
 }
 
 AA_API void
@@ -196,8 +364,11 @@ s_kin_solve_cx_alloc( const struct aa_rx_ik_cx *ik_cx,
     cx->ssg = ik_cx->ssg;
     cx->opts = ik_cx->opts;
 
-    // TODO: multiple frames in solver
+    cx->n_frames = ik_cx->n_frames;
+    cx->frames = ik_cx->frames;
+    cx->weights = ik_cx->weights;
     cx->frame = ik_cx->frames[0];
+    cx->i_target = 0;
 
     cx->iteration = 0;
 
@@ -232,11 +403,22 @@ aa_rx_ik_solve( const struct aa_rx_ik_cx *context,
     struct kin_solve_cx *kcx = s_kin_solve_cx_alloc( context,
                                                      aa_mem_region_local_get() );
 
-    if( 1 != TF->cols )
-    {   /* only chains */
+    if( context->n_frames != TF->cols )
+    {
+        aa_mem_region_pop(kcx->reg, kcx);
         return AA_RX_INVALID_PARAMETER;
     }
-    kcx->TF_ref = TF;
+    kcx->TF_all = TF;
+    s_ksol_target( kcx, 0 );
+
+    /* Closed-form solvers take precedence, except for concurrent
+     * starts and constrained solves */
+    if( context->analytic && !context->race && !context->ineqct_fun &&
+        0 == aa_rx_ik_analytic_nearest( context, TF, kcx->q_sub, q ) )
+    {
+        aa_mem_region_pop(kcx->reg, kcx);
+        return 0;
+    }
 
     /* aa_rx_sg_tf( kcx->ssg->scenegraph, */
     /*              kcx->q_all->len, kcx->q_all->data, */
@@ -245,6 +427,15 @@ aa_rx_ik_solve( const struct aa_rx_ik_cx *context,
     /*              kcx->TF_abs0, AA_RX_TF_LEN ); */
 
 
+    /* Seed from the cache, except for concurrent starts with their own seeds */
+    struct aa_rx_ik_cache *cache = context->race ? NULL : context->cache;
+    int cache_hit = 0;
+    struct timespec t_cache;
+    if( cache ) {
+        t_cache = aa_tm_now();
+        cache_hit = aa_rx_ik_cache_seed( cache, TF, kcx->q_sub );
+    }
+
     /* Dispatch and solve */
     struct timespec t0;
     if(context->restart_time > 0) {
@@ -264,7 +455,8 @@ aa_rx_ik_solve( const struct aa_rx_ik_cx *context,
             r = s_ik_jpinv( kcx, q );
             break;
         case AA_RX_IK_LMA:
-            goto ERR;
+            r = s_ik_lma( kcx, q );
+            break;
         case AA_RX_IK_SQP:
 #ifdef HAVE_NLOPT
             r = s_ik_nlopt( kcx, q );
@@ -276,28 +468,285 @@ aa_rx_ik_solve( const struct aa_rx_ik_cx *context,
 #endif /*HAVE_NLOPT*/
         }
 
-        if(r && (context->restart_time > 0) ) {
+        /* Only SQP enforces the constraints while solving */
+        if( 0 == r ) r = s_ineqct_check( kcx, q );
+
+        if(r && (context->restart_time > 0) && !s_ik_cancelled(context) ) {
             // try restart
             double dt = aa_tm_timespec2sec( aa_tm_sub(aa_tm_now(),t0) );
             if( dt < context->restart_time ) {
                 // random reseed
                 //printf("restart\n");
                 aa_rx_sg_sub_rand_config( context->ssg, kcx->q_sub );
+                kcx->iteration = 0;
                 restart = 1;
             }
         }
     } while (restart);
 
+    if( cache ) {
+        aa_rx_ik_cache_record( cache, cache_hit,
+                               aa_tm_timespec2sec(aa_tm_sub(aa_tm_now(), t_cache)) );
+        if( 0 == r ) aa_rx_ik_cache_insert( cache, TF, q );
+    }
+
     aa_mem_region_pop(kcx->reg, kcx);
     return r;
 
+#ifndef HAVE_NLOPT
 ERR:
     aa_mem_region_pop(kcx->reg, kcx);
     fprintf(stderr, "Error: unimplemented IK algorithm");
     return AA_RX_NO_SOLUTION | AA_RX_NO_IK | AA_RX_INVALID_PARAMETER;
+#endif /*HAVE_NLOPT*/
 }
 
 
+struct ik_batch_cx {
+    struct aa_rx_ik_cx *cx;
+    const struct aa_dmat *TF;
+    struct aa_dmat *Q;
+    int *status;
+    size_t i0, i1;
+    int result;
+};
+
+/* Solve a contiguous range of targets with a private context */
+static void *
+s_ik_batch_worker( void *vcx )
+{
+    struct ik_batch_cx *b = (struct ik_batch_cx*)vcx;
+    size_t n_f = b->cx->n_frames;
+    b->result = 0;
+    for( size_t i = b->i0; i < b->i1; i ++ ) {
+        struct aa_dmat TF_i;
+        aa_dmat_view_block( &TF_i, b->TF, 0, i*n_f, AA_RX_TF_LEN, n_f );
+        struct aa_dvec q_i = AA_DVEC_INIT( b->Q->rows, &AA_DMAT_REF(b->Q,0,i), 1 );
+        int r = aa_rx_ik_solve( b->cx, &TF_i, &q_i );
+        if( b->status ) b->status[i] = r;
+        b->result |= r;
+        /* seed the next target from this solution */
+        if( 0 == r && b->cx->warm_start ) {
+            aa_rx_ik_set_seed( b->cx, &q_i );
+        }
+    }
+    return NULL;
+}
+
+AA_API int
+aa_rx_ik_solve_batch( const struct aa_rx_ik_cx *context,
+                      size_t n_targets,
+                      const struct aa_dmat *TF,
+                      struct aa_dmat *Q,
+                      int *status )
+{
+    if( AA_RX_TF_LEN != TF->rows
+        || n_targets * context->n_frames != TF->cols
+        || aa_rx_sg_sub_config_count(context->ssg) != Q->rows
+        || n_targets != Q->cols )
+    {
+        return AA_RX_INVALID_PARAMETER;
+    }
+    if( 0 == n_targets ) return 0;
+
+    size_t n_t = context->threads;
+    if( 0 == n_t ) {
+        long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+        n_t = (n_cpu > 0) ? (size_t)n_cpu : 1;
+    }
+    n_t = AA_MIN(n_t, n_targets);
+
+    struct ik_batch_cx b[n_t];
+    pthread_t thread[n_t];
+    int started[n_t];
+    for( size_t j = 0; j < n_t; j ++ ) {
+        b[j].cx = aa_rx_ik_cx_clone(context);
+        b[j].TF = TF;
+        b[j].Q = Q;
+        b[j].status = status;
+        b[j].i0 = (j * n_targets) / n_t;
+        b[j].i1 = ((j+1) * n_targets) / n_t;
+    }
+
+    /* run the first range on this thread */
+    for( size_t j = 1; j < n_t; j ++ ) {
+        started[j] = (0 == pthread_create( &thread[j], NULL, s_ik_batch_worker, b+j ));
+        if( ! started[j] ) s_ik_batch_worker(b+j);
+    }
+    s_ik_batch_worker(b);
+
+    int r = b[0].result;
+    for( size_t j = 1; j < n_t; j ++ ) {
+        if( started[j] ) pthread_join( thread[j], NULL );
+        r |= b[j].result;
+    }
+    for( size_t j = 0; j < n_t; j ++ ) {
+        aa_rx_ik_cx_destroy(b[j].cx);
+    }
+
+    return r;
+}
+
+/* Record a solution unless it duplicates one already found */
+static void
+s_ik_race_add( struct aa_rx_ik_race *race, const struct aa_dvec *q )
+{
+    for( size_t j = 0; j < race->n_sol; j ++ ) {
+        struct aa_dvec q_j = AA_DVEC_INIT( q->len, &AA_DMAT_REF(race->Q,0,j), 1 );
+        if( aa_dvec_ssd(q, &q_j) < 1e-6 ) return;
+    }
+    struct aa_dvec q_n = AA_DVEC_INIT( q->len, &AA_DMAT_REF(race->Q,0,race->n_sol), 1 );
+    aa_dvec_copy( q, &q_n );
+    race->n_sol++;
+    if( race->n_sol == race->Q->cols ) race->done = 1;
+}
+
+static void *
+s_ik_race_worker( void *vcx )
+{
+    struct aa_rx_ik_cx *cx = (struct aa_rx_ik_cx*)vcx;
+    struct aa_rx_ik_race *race = cx->race;
+    double q_data[cx->q_seed->len];
+    struct aa_dvec q = AA_DVEC_INIT( cx->q_seed->len, q_data, 1 );
+
+    if( ! race->all ) {
+        /* the solver restarts until the budget or cancellation */
+        int r = aa_rx_ik_solve( cx, race->TF, &q );
+        pthread_mutex_lock( &race->mutex );
+        if( 0 == r && ! race->done ) {
+            aa_dvec_copy( &q, race->q );
+            race->result = 0;
+            race->done = 1;
+        }
+        pthread_mutex_unlock( &race->mutex );
+        return NULL;
+    }
+
+    /* collect a solution from each seed until the budget expires */
+    double budget = cx->restart_time;
+    cx->restart_time = 0;
+    do {
+        int r = aa_rx_ik_solve( cx, race->TF, &q );
+        pthread_mutex_lock( &race->mutex );
+        if( 0 == r && ! race->done ) s_ik_race_add( race, &q );
+        pthread_mutex_unlock( &race->mutex );
+        aa_rx_ik_set_seed_rand( cx );
+    } while( ! s_ik_cancelled(cx) &&
+             aa_tm_timespec2sec( aa_tm_sub(aa_tm_now(), race->t0) ) < budget );
+
+    return NULL;
+}
+
+/* Start one solver per thread from the current, center, and random seeds */
+static void
+s_ik_race( const struct aa_rx_ik_cx *context, struct aa_rx_ik_race *race )
+{
+    size_t n_t = context->threads;
+    if( 0 == n_t ) {
+        long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+        n_t = (n_cpu > 0) ? (size_t)n_cpu : 1;
+    }
+
+    pthread_mutex_init( &race->mutex, NULL );
+    race->done = 0;
+    race->t0 = aa_tm_now();
+
+    struct aa_rx_ik_cx *cx[n_t];
+    pthread_t thread[n_t];
+    int started[n_t];
+    for( size_t j = 0; j < n_t; j ++ ) {
+        cx[j] = aa_rx_ik_cx_clone(context);
+        cx[j]->race = race;
+        if( 1 == j ) aa_rx_ik_set_seed_center(cx[j]);
+        else if( j > 1 ) aa_rx_ik_set_seed_rand(cx[j]);
+    }
+
+    /* run the first start on this thread */
+    for( size_t j = 1; j < n_t; j ++ ) {
+        started[j] = (0 == pthread_create( &thread[j], NULL, s_ik_race_worker, cx[j] ));
+        if( ! started[j] ) s_ik_race_worker(cx[j]);
+    }
+    s_ik_race_worker(cx[0]);
+
+    for( size_t j = 1; j < n_t; j ++ ) {
+        if( started[j] ) pthread_join( thread[j], NULL );
+    }
+    for( size_t j = 0; j < n_t; j ++ ) {
+        aa_rx_ik_cx_destroy(cx[j]);
+    }
+    pthread_mutex_destroy( &race->mutex );
+}
+
+AA_API int
+aa_rx_ik_solve_race( const struct aa_rx_ik_cx *context,
+                     const struct aa_dmat *TF,
+                     struct aa_dvec *q )
+{
+    if( aa_rx_sg_sub_config_count(context->ssg) != q->len
+        || AA_RX_TF_LEN != TF->rows
+        || context->n_frames != TF->cols )
+    {
+        return AA_RX_INVALID_PARAMETER;
+    }
+
+    struct aa_rx_ik_race race;
+    race.TF = TF;
+    race.q = q;
+    race.result = AA_RX_NO_SOLUTION | AA_RX_NO_IK;
+    race.all = 0;
+    race.Q = NULL;
+    race.n_sol = 0;
+    s_ik_race( context, &race );
+
+    return race.result;
+}
+
+AA_API size_t
+aa_rx_ik_solve_all( const struct aa_rx_ik_cx *context,
+                    const struct aa_dmat *TF,
+                    struct aa_dmat *Q )
+{
+    size_t n_q = aa_rx_sg_sub_config_count(context->ssg);
+    if( n_q != Q->rows
+        || AA_RX_TF_LEN != TF->rows
+        || context->n_frames != TF->cols )
+    {
+        return 0;
+    }
+    if( 0 == Q->cols ) return 0;
+
+    struct aa_rx_ik_race race;
+    race.TF = TF;
+    race.q = NULL;
+    race.all = 1;
+    race.Q = Q;
+    race.n_sol = 0;
+    s_ik_race( context, &race );
+
+    /* rank by distance to the start configuration */
+    size_t n = race.n_sol;
+    double q0[n_q], d[n+1], tmp[n_q];
+    struct aa_dvec v_q0 = AA_DVEC_INIT(n_q, q0, 1);
+    aa_rx_sg_sub_config_gather( context->ssg, context->q_start, &v_q0 );
+    for( size_t j = 0; j < n; j ++ ) {
+        struct aa_dvec q_j = AA_DVEC_INIT( n_q, &AA_DMAT_REF(Q,0,j), 1 );
+        d[j] = aa_dvec_ssd( &v_q0, &q_j );
+    }
+    for( size_t j = 1; j < n; j ++ ) {
+        double d_j = d[j];
+        AA_MEM_CPY( tmp, &AA_DMAT_REF(Q,0,j), n_q );
+        size_t i = j;
+        for( ; i > 0 && d[i-1] > d_j; i -- ) {
+            d[i] = d[i-1];
+            AA_MEM_CPY( &AA_DMAT_REF(Q,0,i), &AA_DMAT_REF(Q,0,i-1), n_q );
+        }
+        d[i] = d_j;
+        AA_MEM_CPY( &AA_DMAT_REF(Q,0,i), tmp, n_q );
+    }
+
+    return n;
+}
+
 /* static struct aa_dmat * */
 /* s_tf0 ( struct aa_mem_region *reg, */
 /*         const struct aa_rx_sg_sub *ssg, aa_rx_frame_id frame, */
@@ -398,40 +847,152 @@ aa_rx_ik_check( const struct aa_rx_ik_cx *cx,
     aa_rx_sg_sub_config_scatter( cx->ssg, q_sub, q_all );
 
     struct aa_rx_fk *fk = aa_rx_fk_alloc(aa_rx_sg_sub_sg(cx->ssg), reg);
+    aa_rx_fk_cpy(fk, cx->fk);
     aa_rx_fk_sub(fk, cx->ssg, q_sub);
-    double *E_act = aa_rx_fk_ref(fk, cx->frames[0]); // TODO: fix for multiple EEs
 
-    int r = s_check(cx,TF, E_act);
+    int r = 0;
+    if( cx->n_frames != TF->cols ) {
+        r = AA_RX_INVALID_PARAMETER;
+    }
+    for( size_t k = 0; 0 == r && k < cx->n_frames; k ++ ) {
+        double *E_act = aa_rx_fk_ref(fk, cx->frames[k]);
+        struct aa_dmat TF_k;
+        aa_dmat_view_block( &TF_k, TF, 0, k, AA_RX_TF_LEN, 1 );
+        r = s_check(cx, &TF_k, E_act);
+    }
     aa_mem_region_pop(reg, ptrtop);
     return r;
 }
 
+/*
+ * Solve toward the pose of a perturbed seed so that the thread-local
+ * region grows to the peak scratch of a solve, and lazily initialized
+ * libraries are initialized.  A grown region keeps one node large
+ * enough for the peak, so later solves of the same size do not
+ * allocate.
+ */
+AA_API int
+aa_rx_ik_prepare( const struct aa_rx_ik_cx *context )
+{
+    if( AA_RX_IK_SQP == context->opts->ik_algo ) {
+        return AA_RX_INVALID_PARAMETER;
+    }
+
+    struct aa_rx_ik_cx *cx = aa_rx_ik_cx_clone( context );
+    cx->cache = NULL;
+    cx->restart_time = 0;
+
+    size_t n_q = cx->q_seed->len;
+    double TF_data[AA_RX_TF_LEN*cx->n_frames], q_data[n_q];
+    struct aa_dmat TF = AA_DMAT_INIT(AA_RX_TF_LEN, cx->n_frames, TF_data, AA_RX_TF_LEN);
+    struct aa_dvec q = AA_DVEC_INIT(n_q, q_data, 1);
+
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(aa_rx_sg_sub_sg(cx->ssg));
+    aa_rx_fk_cpy( fk, cx->fk );
+    aa_rx_fk_sub( fk, cx->ssg, cx->q_seed );
+    for( size_t k = 0; k < cx->n_frames; k ++ ) {
+        AA_MEM_CPY( TF_data + AA_RX_TF_LEN*k, aa_rx_fk_ref(fk, cx->frames[k]),
+                    AA_RX_TF_LEN );
+    }
+    aa_rx_fk_destroy(fk);
+
+    /* Start away from the target so that the solver iterates */
+    for( size_t i = 0; i < n_q; i ++ ) {
+        AA_DVEC_REF(cx->q_seed, i) += .1;
+    }
+
+    /* Closed-form solver, then the iterative fallback */
+    aa_rx_ik_solve( cx, &TF, &q );
+    void *analytic = cx->analytic;
+    cx->analytic = NULL;
+    aa_rx_ik_solve( cx, &TF, &q );
+    cx->analytic = analytic;
+    aa_rx_ik_check( cx, &TF, &q );
+
+    aa_rx_ik_cx_destroy(cx);
+    return 0;
+}
+
+
+/*
+ * End-effector poses and velocity Jacobian at q.  When solving for the
+ * chain tip or for all end-effectors, use the one-pass kernel and
+ * leave cx->fk at the start configuration.  For several targets,
+ * E_act holds one pose per target and J stacks 6 rows per target.
+ */
+static void s_ksol_fk_jac( const struct kin_solve_cx *cx,
+                           const double *q,
+                           double *E_act,
+                           struct aa_dmat *J )
+{
+    struct aa_dvec vq = AA_DVEC_INIT(cx->q_sub->len,(double*)q,1);
+    if( cx->n_frames > 1 ) {
+        aa_rx_sg_sub_fk_jac_vel_ees( cx->ssg, cx->fk, &vq, E_act, AA_RX_TF_LEN, J );
+    } else if( cx->frame == aa_rx_sg_sub_fk_jac_frame(cx->ssg) ) {
+        aa_rx_sg_sub_fk_jac_vel( cx->ssg, cx->fk, &vq, E_act, J );
+    } else {
+        aa_rx_fk_sub(cx->fk, cx->ssg, &vq);
+        AA_MEM_CPY( E_act, aa_rx_fk_ref(cx->fk, cx->frame), AA_RX_TF_LEN );
+        if( J ) aa_rx_sg_sub_jac_vel_fill( cx->ssg, cx->fk, J );
+    }
+}
 
 static void s_ksol_jpinv( const struct kin_solve_cx *cx,
                           const double *q,
                           struct aa_dvec *dq )
 {
-    size_t n_x, n_qs;
-    aa_rx_sg_sub_jacobian_size(cx->ssg,&n_x,&n_qs);
-    struct aa_dvec *w_e = aa_dvec_alloc(cx->reg,n_x);
+    size_t n_e = cx->n_frames;
+    size_t n_qs = aa_rx_sg_sub_config_count(cx->ssg);
+    struct aa_dvec *w_e = aa_dvec_alloc(cx->reg,6*n_e);
     aa_dvec_zero(w_e);
 
-    double *E_act = aa_rx_fk_ref(cx->fk, cx->frame);
-    aa_rx_wk_dx_pos( &cx->opts->wk_opts, E_act, cx->TF_ref->data, w_e );
+    /* Several targets use the packed Jacobian to skip structural zeros */
+    double E_act[AA_RX_TF_LEN*n_e];
+    struct aa_dmat *J = NULL;
+    double *Jp = NULL;
+    if( n_e > 1 ) {
+        struct aa_dvec vq = AA_DVEC_INIT(n_qs,(double*)q,1);
+        Jp = AA_MEM_REGION_NEW_N(cx->reg, double,
+                                 aa_rx_sg_sub_ees_jac_packed_size(cx->ssg));
+        aa_rx_sg_sub_fk_jac_vel_ees_packed( cx->ssg, cx->fk, &vq,
+                                            E_act, AA_RX_TF_LEN, Jp );
+    } else {
+        J = aa_dmat_alloc(cx->reg,6,n_qs);
+        s_ksol_fk_jac( cx, q, E_act, J );
+    }
 
+    double *Jk = Jp;
+    for( size_t k = 0; k < n_e; k ++ ) {
+        struct aa_dvec w_k = AA_DVEC_INIT(6, w_e->data + 6*k, 1);
+        aa_rx_wk_dx_pos( &cx->opts->wk_opts, E_act + AA_RX_TF_LEN*k,
+                         &AA_DMAT_REF(cx->TF_all,0,k), &w_k );
+        /* weight the rows of each target */
+        double w = cx->weights[k];
+        size_t n_k = Jp ? 6*aa_rx_sg_sub_ee_config_count(cx->ssg, k) : 0;
+        if( 1 != w ) {
+            aa_dvec_scal( w, &w_k );
+            if( Jp ) {
+                struct aa_dvec v_Jk = AA_DVEC_INIT(n_k, Jk, 1);
+                aa_dvec_scal( w, &v_Jk );
+            } else {
+                aa_dmat_scal( J, w );
+            }
+        }
+        Jk += n_k;
+    }
 
+    struct aa_dvec *v_dqnull = NULL;
     if( cx->opts->q_ref ) {
-        struct aa_dvec *v_dqnull = aa_dvec_alloc(cx->reg,n_qs);
+        v_dqnull = aa_dvec_alloc(cx->reg,n_qs);
         double *dqnull = v_dqnull->data;
         for( size_t i = 0; i < n_qs; i ++ )  {
             dqnull[i] = - cx->opts->dq_dt[i] * ( q[i] - cx->opts->q_ref[i] );
         }
-        aa_rx_wk_dx2dq_np( cx->ssg, &cx->opts->wk_opts,
-                           cx->fk, w_e, v_dqnull, dq );
+    }
+    if( Jp ) {
+        aa_rx_wk_jdx2dq_ees( cx->ssg, &cx->opts->wk_opts, Jp, w_e, v_dqnull, dq );
     } else {
-        aa_rx_wk_dx2dq( cx->ssg, &cx->opts->wk_opts,
-                        cx->fk,
-                        w_e, dq );
+        aa_rx_wk_jdx2dq( &cx->opts->wk_opts, J, w_e, v_dqnull, dq );
     }
 }
 
@@ -439,6 +1000,8 @@ static void s_ksol_jpinv( const struct kin_solve_cx *cx,
 
 
 #include "ik_jacobian.c"
+#include "ik_lma.c"
+#include "ik_rt.c"
 
 
 
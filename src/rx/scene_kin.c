@@ -38,20 +38,42 @@
 
 #include "amino.h"
 #include "amino/rx/rxtype.h"
+#include "amino/rx/rxerr.h"
 #include "amino/rx/scenegraph.h"
 #include "amino/rx/scene_ik.h"
 #include "amino/rx/scene_sub.h"
 
 #include "amino/rx/scene_fk.h"
+#include "amino/rx/scenegraph_internal.h"
 #include "amino/rx/scene_ik_internal.h"
 #include "amino/mat_internal.h"
 
+/**
+ * Chain-local kinematic instruction.
+ *
+ * The folded instruction for a joint or end-effector of the
+ * sub-scenegraph.  op.config indexes the sub-scenegraph configuration
+ * vector and op.parent the chain-local table.  When op.parent is
+ * negative, base is the scenegraph frame supplying the parent
+ * transform, or AA_RX_FRAME_ROOT for the identity.
+ */
+struct aa_rx_sg_sub_op {
+    struct aa_rx_kin_op op;
+    aa_rx_frame_id frame;   ///< scenegraph frame of the instruction
+    aa_rx_frame_id base;    ///< parent frame outside the chain
+};
+
 AA_API void
 aa_rx_sg_sub_destroy( struct aa_rx_sg_sub *ssg )
 {
     if( ssg->frames ) free( ssg->frames );
     if( ssg->configs ) free( ssg->configs );
     if( ssg->ees ) free( ssg->ees );
+    if( ssg->moved ) free( ssg->moved );
+    if( ssg->ops ) free( ssg->ops );
+    if( ssg->ee_ops ) free( ssg->ee_ops );
+    if( ssg->ee_config_ptr ) free( ssg->ee_config_ptr );
+    if( ssg->ee_configs ) free( ssg->ee_configs );
 
     free(ssg);
 }
@@ -306,6 +328,162 @@ aa_rx_sg_sub_expand_path( const struct aa_rx_sg_sub *ssg, size_t n_pts,
 }
 
 
+/*
+ * Find the frames moved by the sub-scenegraph configurations: all
+ * joints of those configurations and their descendants.
+ */
+static void
+s_sub_init_moved( struct aa_rx_sg_sub *ssg )
+{
+    const struct aa_rx_sg *sg = ssg->scenegraph;
+    const struct aa_rx_kin_op *prog = aa_rx_sg_kin_prog(sg);
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+
+    char is_config[n_q+1], moved[n_f+1];
+    AA_MEM_ZERO(is_config, n_q);
+    AA_MEM_ZERO(moved, n_f);
+    for( size_t i = 0; i < ssg->config_count; i ++ ) {
+        is_config[ssg->configs[i]] = 1;
+    }
+
+    /* Frames are topologically sorted, so one pass finds descendants */
+    size_t n_ranges = 0;
+    for( size_t i = 0; i < n_f; i ++ ) {
+        const struct aa_rx_kin_op *op = prog + i;
+        moved[i] = (AA_RX_KIN_FIXED != op->code && is_config[op->config]) ||
+            (op->parent >= 0 && moved[op->parent]);
+        if( moved[i] && (0 == i || !moved[i-1]) ) n_ranges++;
+    }
+
+    ssg->moved_count = n_ranges;
+    ssg->moved = AA_NEW_AR(size_t, 2*n_ranges + 1);
+    size_t *r = ssg->moved;
+    for( size_t i = 0; i < n_f; i ++ ) {
+        if( moved[i] && (0 == i || !moved[i-1]) ) *r++ = i;
+        if( moved[i] && (n_f-1 == i || !moved[i+1]) ) *r++ = i+1;
+    }
+}
+
+/*
+ * Build the chain-local kinematics table from the folded program:
+ * one instruction per joint, plus the end-effector.
+ *
+ * Returns AA_RX_INVALID_FRAME if an end-effector is not in the chain.
+ */
+static int
+s_sub_init_ops( struct aa_rx_sg_sub *ssg )
+{
+    const struct aa_rx_sg *sg = ssg->scenegraph;
+    const struct aa_rx_kin_op *fold = aa_rx_sg_kin_fold(sg);
+    size_t n_f = aa_rx_sg_frame_count(sg);
+
+    aa_rx_frame_id local[n_f+1];
+    for( size_t i = 0; i < n_f; i ++ ) local[i] = -1;
+
+    char is_ee[n_f+1];
+    AA_MEM_ZERO(is_ee, n_f);
+    for( size_t k = 0; k < ssg->ee_count; k ++ ) {
+        if( ssg->ees[k] >= 0 ) is_ee[ssg->ees[k]] = 1;
+    }
+
+    ssg->ops = AA_NEW_AR(struct aa_rx_sg_sub_op, ssg->frame_count + 1);
+    size_t n = 0, i_config = 0;
+    for( size_t i = 0; i < ssg->frame_count; i ++ ) {
+        aa_rx_frame_id frame = ssg->frames[i];
+        const struct aa_rx_kin_op *op = fold + frame;
+        if( AA_RX_KIN_FIXED == op->code && i + 1 < ssg->frame_count
+            && !is_ee[frame] )
+        {
+            continue;
+        }
+
+        struct aa_rx_sg_sub_op *sop = ssg->ops + n;
+        sop->op = *op;
+        sop->frame = frame;
+        if( AA_RX_KIN_FIXED != op->code ) {
+            sop->op.config = i_config++;
+        }
+        if( op->parent >= 0 && local[op->parent] >= 0 ) {
+            sop->op.parent = local[op->parent];
+            sop->base = AA_RX_FRAME_NONE;
+        } else {
+            sop->op.parent = -1;
+            sop->base = op->parent;
+        }
+        local[frame] = (aa_rx_frame_id)n++;
+    }
+    assert( i_config == ssg->config_count );
+    ssg->op_count = n;
+
+    /* end-effectors outside the sub-scenegraph have no instruction */
+    int r = AA_RX_OK;
+    ssg->ee_ops = AA_NEW_AR(size_t, ssg->ee_count + 1);
+    for( size_t k = 0; k < ssg->ee_count; k ++ ) {
+        aa_rx_frame_id e = ssg->ees[k];
+        if( e >= 0 && local[e] >= 0 ) {
+            ssg->ee_ops[k] = (size_t)local[e];
+        } else {
+            ssg->ee_ops[k] = SIZE_MAX;
+            r = AA_RX_INVALID_FRAME;
+        }
+    }
+
+    /* ancestry mask: the joints that move each end-effector */
+    ssg->ee_config_ptr = AA_NEW_AR(size_t, ssg->ee_count + 1);
+    ssg->ee_configs = AA_NEW_AR(size_t, ssg->ee_count * i_config + 1);
+    size_t m = 0;
+    for( size_t k = 0; k < ssg->ee_count; k ++ ) {
+        ssg->ee_config_ptr[k] = m;
+        if( SIZE_MAX == ssg->ee_ops[k] ) continue;
+        /* walk to the root, then reverse into ascending order */
+        size_t m0 = m;
+        for( aa_rx_frame_id p = (aa_rx_frame_id)ssg->ee_ops[k]; p >= 0;
+             p = ssg->ops[p].op.parent )
+        {
+            const struct aa_rx_kin_op *op = &ssg->ops[p].op;
+            if( AA_RX_KIN_FIXED != op->code ) ssg->ee_configs[m++] = op->config;
+        }
+        for( size_t a = m0, b = m; a + 1 < b; a++, b-- ) {
+            size_t t = ssg->ee_configs[a];
+            ssg->ee_configs[a] = ssg->ee_configs[b-1];
+            ssg->ee_configs[b-1] = t;
+        }
+    }
+    ssg->ee_config_ptr[ssg->ee_count] = m;
+    return r;
+}
+
+AA_API size_t
+aa_rx_sg_sub_ee_config_count( const struct aa_rx_sg_sub *ssg, size_t k )
+{
+    return ssg->ee_config_ptr[k+1] - ssg->ee_config_ptr[k];
+}
+
+AA_API const size_t *
+aa_rx_sg_sub_ee_configs( const struct aa_rx_sg_sub *ssg, size_t k )
+{
+    return ssg->ee_configs + ssg->ee_config_ptr[k];
+}
+
+AA_API size_t
+aa_rx_sg_sub_ees_jac_packed_size( const struct aa_rx_sg_sub *ssg )
+{
+    return 6 * ssg->ee_config_ptr[ssg->ee_count];
+}
+
+AA_API size_t
+aa_rx_sg_sub_moved_count( const struct aa_rx_sg_sub *ssg )
+{
+    return ssg->moved_count;
+}
+
+AA_API const size_t *
+aa_rx_sg_sub_moved( const struct aa_rx_sg_sub *ssg )
+{
+    return ssg->moved;
+}
+
 AA_API struct aa_rx_sg_sub *
 aa_rx_sg_chain_create( const struct aa_rx_sg *sg,
                        aa_rx_frame_id root, aa_rx_frame_id tip )
@@ -328,6 +506,12 @@ aa_rx_sg_chain_create( const struct aa_rx_sg *sg,
     ssg->ees = ees;
     ssg->ee_count = 1;
 
+    s_sub_init_moved(ssg);
+    if( AA_RX_OK != s_sub_init_ops(ssg) ) {
+        aa_rx_sg_sub_destroy(ssg);
+        return NULL;
+    }
+
     return ssg;
 }
 
@@ -359,6 +543,7 @@ aa_rx_sg_multiple_chain_create( const struct aa_rx_sg *sg,
     ssg->frame_count = aa_rx_sg_chain_multiple_frames( sg, root, n_tips,
                                                        tips, tmp, tmp_arr);
     ssg->frames = AA_MEM_DUP(aa_rx_frame_id, tmp_arr, ssg->frame_count);
+    free(tmp_arr);
 
 
     ssg->config_count = aa_rx_sg_chain_config_count( sg,
@@ -368,6 +553,15 @@ aa_rx_sg_multiple_chain_create( const struct aa_rx_sg *sg,
     aa_rx_sg_chain_configs( sg, ssg->frame_count, ssg->frames,
                             ssg->config_count, ssg->configs );
 
+    ssg->ees = AA_MEM_DUP(aa_rx_frame_id, tips, n_tips);
+    ssg->ee_count = n_tips;
+
+    s_sub_init_moved(ssg);
+    if( AA_RX_OK != s_sub_init_ops(ssg) ) {
+        aa_rx_sg_sub_destroy(ssg);
+        return NULL;
+    }
+
     return ssg;
 }
 
@@ -389,6 +583,7 @@ aa_rx_sg_sub_jac_twist_fill2( const struct aa_rx_sg_sub *ssg,
     aa_rx_frame_id *frames = aa_rx_sg_sub_frames(ssg);
     const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
 
+    const struct aa_rx_kin_op *prog = aa_rx_sg_kin_prog(sg);
     double *jr = Jr->data, *jp = Jp->data;
     size_t i_frame = 0, i_config = 0;
     for( ;
@@ -397,32 +592,30 @@ aa_rx_sg_sub_jac_twist_fill2( const struct aa_rx_sg_sub *ssg,
     {
         aa_rx_frame_id frame = frames[i_frame];
         assert( frame >= 0 );
-        enum aa_rx_frame_type ft = aa_rx_sg_frame_type(sg, frame);
+        const struct aa_rx_kin_op *op = prog + frame;
 
-        switch(ft) {
-        case AA_RX_FRAME_FIXED:
+        switch(op->code) {
+        case AA_RX_KIN_FIXED:
             break;
 
-        case AA_RX_FRAME_REVOLUTE:
-        case AA_RX_FRAME_PRISMATIC: {
+        default: {
             assert( i_config <  n_configs );
 
-            const double *a = aa_rx_sg_frame_axis(sg, frame);
-            const double *E = aa_rx_fk_ref(fk,frame);
+            const double *a = op->axis;
+            const double *E = AA_RX_FK_REF(fk,(size_t)frame);
             const double *q = E + AA_TF_QUTR_Q;
             const double *t = E + AA_TF_QUTR_T;
 
-            switch(ft)  {
-            case AA_RX_FRAME_REVOLUTE: {
+            switch(op->code)  {
+            case AA_RX_KIN_PRISMATIC:
+                AA_MEM_ZERO(jr, 3);
+                aa_tf_qrot(q,a,jp);
+                break;
+            default: { /* revolute */
                 aa_tf_qrot(q,a,jr);
                 aa_tf_cross(t, jr, jp);
                 break;
             }
-            case AA_RX_FRAME_PRISMATIC:
-                AA_MEM_ZERO(jr, 3);
-                aa_tf_qrot(q,a,jp);
-                break;
-            default: assert(0);
             }
             jr += Jr->ld;
             jp += Jp->ld;
@@ -438,6 +631,562 @@ aa_rx_sg_sub_jac_twist_fill2( const struct aa_rx_sg_sub *ssg,
 
 }
 
+/*
+ * Single pass over the chain-local table: absolute transforms of each
+ * instruction from q into TF, and the twist Jacobian columns from
+ * those transforms.
+ */
+static void
+s_sub_fk_jac_tf( const struct aa_rx_sg_sub *ssg,
+                 const struct aa_rx_fk *fk,
+                 const double *q,
+                 double *TF,
+                 struct aa_dmat *Jr, struct aa_dmat *Jp )
+{
+    size_t n = ssg->op_count;
+
+    for( size_t i = 0; i < n; i ++ ) {
+        const struct aa_rx_sg_sub_op *sop = ssg->ops + i;
+        const struct aa_rx_kin_op *op = &sop->op;
+        double *E = TF + AA_RX_TF_LEN*i;
+
+        double E_rel[AA_RX_TF_LEN];
+        aa_rx_kin_op_rel( op, q, E_rel );
+        if( op->parent >= 0 ) {
+            aa_tf_qutr_mul( TF + AA_RX_TF_LEN*op->parent, E_rel, E );
+        } else if( sop->base >= 0 ) {
+            aa_tf_qutr_mul( AA_RX_FK_REF(fk,(size_t)sop->base), E_rel, E );
+        } else {
+            AA_MEM_CPY( E, E_rel, AA_RX_TF_LEN );
+        }
+
+        if( NULL == Jr || AA_RX_KIN_FIXED == op->code ) continue;
+
+        const double *a = op->axis;
+        const double *r = E + AA_TF_QUTR_Q;
+        const double *t = E + AA_TF_QUTR_T;
+        double *jr = Jr->data + op->config * Jr->ld;
+        double *jp = Jp->data + op->config * Jp->ld;
+        switch(op->code)  {
+        case AA_RX_KIN_PRISMATIC:
+            AA_MEM_ZERO(jr, 3);
+            aa_tf_qrot(r,a,jp);
+            break;
+        default: /* revolute */
+            aa_tf_qrot(r,a,jr);
+            aa_tf_cross(t, jr, jp);
+            break;
+        }
+    }
+}
+
+static void
+s_sub_fk_jac( const struct aa_rx_sg_sub *ssg,
+              const struct aa_rx_fk *fk,
+              const double *q,
+              double *E_ee,
+              struct aa_dmat *Jr, struct aa_dmat *Jp )
+{
+    size_t n = ssg->op_count;
+    double TF[AA_RX_TF_LEN*n + 1];
+    s_sub_fk_jac_tf( ssg, fk, q, TF, Jr, Jp );
+
+    if( E_ee ) {
+        if( n > 0 ) {
+            AA_MEM_CPY( E_ee, TF + AA_RX_TF_LEN*(n-1), AA_RX_TF_LEN );
+        } else {
+            AA_MEM_CPY( E_ee, aa_tf_qutr_ident, AA_RX_TF_LEN );
+        }
+    }
+}
+
+/* Data of v, copied to buf when not contiguous */
+static const double *
+s_dvec_contig( const struct aa_dvec *v, double *buf )
+{
+    if( 1 == v->inc ) return v->data;
+    struct aa_dvec vb = AA_DVEC_INIT(v->len, buf, 1);
+    aa_dvec_copy(v, &vb);
+    return buf;
+}
+
+static void
+s_sub_fk_jac_dmat( const struct aa_rx_sg_sub *ssg,
+                   const struct aa_rx_fk *fk,
+                   const struct aa_dvec *q_sub,
+                   double *E_ee, struct aa_dmat *J, int vel )
+{
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    aa_la_check_size(n_q, q_sub->len);
+
+    double q_buf[n_q+1];
+    const double *q = s_dvec_contig(q_sub, q_buf);
+
+    if( NULL == J ) {
+        s_sub_fk_jac( ssg, fk, q, E_ee, NULL, NULL );
+        return;
+    }
+
+    aa_la_check_size(6, J->rows);
+    aa_la_check_size(n_q, J->cols);
+
+    struct aa_dmat Jr, Jp;
+    aa_dmat_view_block(&Jp, J, AA_TF_DX_V, 0, 3, J->cols);
+    aa_dmat_view_block(&Jr, J, AA_TF_DX_W, 0, 3, J->cols);
+
+    double E[AA_RX_TF_LEN];
+    s_sub_fk_jac( ssg, fk, q, E, &Jr, &Jp );
+    if( E_ee ) AA_MEM_CPY( E_ee, E, AA_RX_TF_LEN );
+
+    if( vel ) {
+        /* v = t x w + w x p_ee */
+        const double *pe = E + AA_TF_QUTR_T;
+        for( size_t j = 0; j < n_q; j ++ ) {
+            double *jr = Jr.data + j*Jr.ld;
+            double *jp = Jp.data + j*Jp.ld;
+            double tmp[3];
+            aa_tf_cross(jr, pe, tmp);
+            for( size_t k = 0; k < 3; k ++ ) jp[k] += tmp[k];
+        }
+    }
+}
+
+AA_API void
+aa_rx_sg_sub_fk_jac_twist( const struct aa_rx_sg_sub *ssg,
+                           const struct aa_rx_fk *fk,
+                           const struct aa_dvec *q_sub,
+                           double *E_ee, struct aa_dmat *J )
+{
+    s_sub_fk_jac_dmat( ssg, fk, q_sub, E_ee, J, 0 );
+}
+
+AA_API void
+aa_rx_sg_sub_fk_jac_vel( const struct aa_rx_sg_sub *ssg,
+                         const struct aa_rx_fk *fk,
+                         const struct aa_dvec *q_sub,
+                         double *E_ee, struct aa_dmat *J )
+{
+    s_sub_fk_jac_dmat( ssg, fk, q_sub, E_ee, J, 1 );
+}
+
+/* Lie bracket of twists: r = [a, b] */
+static void
+s_twist_ad( const double *a, const double *b, double *r )
+{
+    double t0[3], t1[3];
+    aa_tf_cross( a + AA_TF_DX_W, b + AA_TF_DX_W, r + AA_TF_DX_W );
+    aa_tf_cross( a + AA_TF_DX_W, b + AA_TF_DX_V, t0 );
+    aa_tf_cross( a + AA_TF_DX_V, b + AA_TF_DX_W, t1 );
+    for( size_t k = 0; k < 3; k ++ ) r[AA_TF_DX_V+k] = t0[k] + t1[k];
+}
+
+/*
+ * Convert a twist Jacobian column derivative dj of column j to the
+ * velocity Jacobian, given the derivative dpe of the end-effector
+ * position: dv += dw x pe + w_j x dpe.
+ */
+static void
+s_twist_dot2vel( const double *j, const double *pe, const double *dpe, double *dj )
+{
+    double t0[3], t1[3];
+    aa_tf_cross( dj + AA_TF_DX_W, pe, t0 );
+    aa_tf_cross( j + AA_TF_DX_W, dpe, t1 );
+    for( size_t k = 0; k < 3; k ++ ) dj[AA_TF_DX_V+k] += t0[k] + t1[k];
+}
+
+/* End-effector point velocity from twist column j */
+static void
+s_twist_pe_vel( const double *j, const double *pe, double *u )
+{
+    aa_tf_cross( j + AA_TF_DX_W, pe, u );
+    for( size_t k = 0; k < 3; k ++ ) u[k] += j[AA_TF_DX_V+k];
+}
+
+/*
+ * Poses and packed Jacobian blocks for all end-effectors.  Joint
+ * transforms are computed once; block k holds the columns of the
+ * joints that move end-effector k, in ee_configs order.
+ */
+static void
+s_sub_fk_jac_ees_packed( const struct aa_rx_sg_sub *ssg,
+                         const struct aa_rx_fk *fk,
+                         const struct aa_dvec *q_sub,
+                         double *E_ees, size_t ld_E,
+                         double *J, int vel )
+{
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    size_t n_e = ssg->ee_count;
+    aa_la_check_size(n_q, q_sub->len);
+
+    double q_buf[n_q+1];
+    const double *q = s_dvec_contig(q_sub, q_buf);
+
+    double TF[AA_RX_TF_LEN*ssg->op_count + 1];
+    double Jt[6*n_q + 1];
+    struct aa_dmat Jr = AA_DMAT_INIT(3, n_q, Jt + AA_TF_DX_W, 6);
+    struct aa_dmat Jp = AA_DMAT_INIT(3, n_q, Jt + AA_TF_DX_V, 6);
+    s_sub_fk_jac_tf( ssg, fk, q, TF, J ? &Jr : NULL, &Jp );
+
+    for( size_t k = 0; k < n_e; k ++ ) {
+        size_t i_op = ssg->ee_ops[k];
+        assert( SIZE_MAX != i_op ); /* checked on creation */
+        const double *E = TF + AA_RX_TF_LEN*i_op;
+        if( E_ees ) AA_MEM_CPY( E_ees + k*ld_E, E, AA_RX_TF_LEN );
+        if( NULL == J ) continue;
+
+        const double *pe = E + AA_TF_QUTR_T;
+        double *jk = J + 6*ssg->ee_config_ptr[k];
+        for( size_t i = ssg->ee_config_ptr[k]; i < ssg->ee_config_ptr[k+1]; i ++, jk += 6 ) {
+            const double *jt = Jt + 6*ssg->ee_configs[i];
+            AA_MEM_CPY( jk, jt, 6 );
+            if( vel ) s_twist_pe_vel( jt, pe, jk + AA_TF_DX_V );
+        }
+    }
+}
+
+/*
+ * Stacked Jacobian for all end-effectors.  Each end-effector block
+ * scatters its packed columns and leaves the rest zero.
+ */
+static void
+s_sub_fk_jac_ees( const struct aa_rx_sg_sub *ssg,
+                  const struct aa_rx_fk *fk,
+                  const struct aa_dvec *q_sub,
+                  double *E_ees, size_t ld_E,
+                  struct aa_dmat *J, int vel )
+{
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    size_t n_e = ssg->ee_count;
+    if( NULL == J ) {
+        s_sub_fk_jac_ees_packed( ssg, fk, q_sub, E_ees, ld_E, NULL, vel );
+        return;
+    }
+    aa_la_check_size(6*n_e, J->rows);
+    aa_la_check_size(n_q, J->cols);
+
+    double Jb[aa_rx_sg_sub_ees_jac_packed_size(ssg) + 1];
+    s_sub_fk_jac_ees_packed( ssg, fk, q_sub, E_ees, ld_E, Jb, vel );
+
+    for( size_t k = 0; k < n_e; k ++ ) {
+        for( size_t j = 0; j < n_q; j ++ ) {
+            AA_MEM_ZERO( &AA_DMAT_REF(J, 6*k, j), 6 );
+        }
+        for( size_t i = ssg->ee_config_ptr[k]; i < ssg->ee_config_ptr[k+1]; i ++ ) {
+            AA_MEM_CPY( &AA_DMAT_REF(J, 6*k, ssg->ee_configs[i]), Jb + 6*i, 6 );
+        }
+    }
+}
+
+AA_API void
+aa_rx_sg_sub_fk_jac_twist_ees( const struct aa_rx_sg_sub *ssg,
+                               const struct aa_rx_fk *fk,
+                               const struct aa_dvec *q_sub,
+                               double *E_ees, size_t ld_E,
+                               struct aa_dmat *J )
+{
+    s_sub_fk_jac_ees( ssg, fk, q_sub, E_ees, ld_E, J, 0 );
+}
+
+AA_API void
+aa_rx_sg_sub_fk_jac_vel_ees( const struct aa_rx_sg_sub *ssg,
+                             const struct aa_rx_fk *fk,
+                             const struct aa_dvec *q_sub,
+                             double *E_ees, size_t ld_E,
+                             struct aa_dmat *J )
+{
+    s_sub_fk_jac_ees( ssg, fk, q_sub, E_ees, ld_E, J, 1 );
+}
+
+AA_API void
+aa_rx_sg_sub_fk_jac_twist_ees_packed( const struct aa_rx_sg_sub *ssg,
+                                      const struct aa_rx_fk *fk,
+                                      const struct aa_dvec *q_sub,
+                                      double *E_ees, size_t ld_E,
+                                      double *J )
+{
+    s_sub_fk_jac_ees_packed( ssg, fk, q_sub, E_ees, ld_E, J, 0 );
+}
+
+AA_API void
+aa_rx_sg_sub_fk_jac_vel_ees_packed( const struct aa_rx_sg_sub *ssg,
+                                    const struct aa_rx_fk *fk,
+                                    const struct aa_dvec *q_sub,
+                                    double *E_ees, size_t ld_E,
+                                    double *J )
+{
+    s_sub_fk_jac_ees_packed( ssg, fk, q_sub, E_ees, ld_E, J, 1 );
+}
+
+/*
+ * Eigenvalues of a small symmetric matrix by cyclic Jacobi rotations.
+ * A is column major and overwritten; its diagonal holds the result.
+ */
+static void
+s_sym_eig( size_t m, double *A )
+{
+    for( size_t sweep = 0; sweep < 32; sweep ++ ) {
+        double off = 0, diag = 0;
+        for( size_t q = 0; q < m; q ++ ) {
+            diag += A[q+q*m]*A[q+q*m];
+            for( size_t p = 0; p < q; p ++ ) off += A[p+q*m]*A[p+q*m];
+        }
+        if( off <= DBL_EPSILON*DBL_EPSILON*diag ) return;
+
+        for( size_t q = 1; q < m; q ++ ) {
+            for( size_t p = 0; p < q; p ++ ) {
+                double apq = A[p+q*m];
+                if( 0 == apq ) continue;
+                double theta = (A[q+q*m] - A[p+p*m]) / (2*apq);
+                double t = copysign(1.0, theta) / (fabs(theta) + sqrt(theta*theta + 1));
+                double c = 1 / sqrt(t*t + 1);
+                double sn = t*c;
+                for( size_t k = 0; k < m; k ++ ) {
+                    double akp = A[k+p*m], akq = A[k+q*m];
+                    A[k+p*m] = c*akp - sn*akq;
+                    A[k+q*m] = sn*akp + c*akq;
+                }
+                for( size_t k = 0; k < m; k ++ ) {
+                    double apk = A[p+k*m], aqk = A[q+k*m];
+                    A[p+k*m] = c*apk - sn*aqk;
+                    A[q+k*m] = sn*apk + c*aqk;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Manipulability and smallest singular value of a 6 x n Jacobian from
+ * the eigenvalues of the smaller Gram matrix.
+ */
+static void
+s_jac_measures( size_t n_q, const double *J, double *manip, double *s_min )
+{
+    size_t m = AA_MIN(6, n_q);
+    double G[m*m+1];
+    if( n_q >= 6 ) {
+        /* J * J^T */
+        for( size_t a = 0; a < 6; a ++ ) {
+            for( size_t b = 0; b <= a; b ++ ) {
+                double x = 0;
+                for( size_t k = 0; k < n_q; k ++ ) x += J[a+6*k]*J[b+6*k];
+                G[a+6*b] = G[b+6*a] = x;
+            }
+        }
+    } else {
+        /* J^T * J */
+        for( size_t a = 0; a < n_q; a ++ ) {
+            for( size_t b = 0; b <= a; b ++ ) {
+                double x = 0;
+                for( size_t k = 0; k < 6; k ++ ) x += J[k+6*a]*J[k+6*b];
+                G[a+m*b] = G[b+m*a] = x;
+            }
+        }
+    }
+
+    s_sym_eig( m, G );
+
+    double det = 1, e_min = m > 0 ? G[0] : 0;
+    for( size_t i = 0; i < m; i ++ ) {
+        double e = AA_MAX(0, G[i+i*m]);
+        det *= e;
+        e_min = AA_MIN(e_min, e);
+    }
+    if( manip ) *manip = sqrt(det);
+    if( s_min ) *s_min = sqrt(AA_MAX(0,e_min));
+}
+
+AA_API void
+aa_rx_sg_sub_jac_twist_batch( const struct aa_rx_sg_sub *ssg,
+                              const struct aa_rx_fk *fk,
+                              size_t n, const double *Q, size_t ldq,
+                              double *J, size_t ldj,
+                              double *manip, double *s_min )
+{
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    assert( ldq >= n_q );
+    assert( ldj >= 6*n_q );
+
+    for( size_t j = 0; j < n; j ++ ) {
+        double *Jj = J + j*ldj;
+        struct aa_dmat Jr = AA_DMAT_INIT(3, n_q, Jj + AA_TF_DX_W, 6);
+        struct aa_dmat Jp = AA_DMAT_INIT(3, n_q, Jj + AA_TF_DX_V, 6);
+        s_sub_fk_jac( ssg, fk, Q + j*ldq, NULL, &Jr, &Jp );
+        if( manip || s_min ) {
+            s_jac_measures( n_q, Jj,
+                            manip ? manip + j : NULL,
+                            s_min ? s_min + j : NULL );
+        }
+    }
+}
+
+/*
+ * Twist Jacobian (columns of 6) at q, and the chain ancestry of its
+ * columns: anc[i + n_q*j] is set when joint i is a strict ancestor of
+ * joint j.  Column n_q of anc is the end-effector.
+ */
+static void
+s_sub_jac_anc( const struct aa_rx_sg_sub *ssg,
+               const struct aa_rx_fk *fk,
+               const double *q,
+               double *E_ee, double *J, char *anc )
+{
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    struct aa_dmat Jr = AA_DMAT_INIT(3, n_q, J + AA_TF_DX_W, 6);
+    struct aa_dmat Jp = AA_DMAT_INIT(3, n_q, J + AA_TF_DX_V, 6);
+    s_sub_fk_jac( ssg, fk, q, E_ee, &Jr, &Jp );
+
+    AA_MEM_ZERO(anc, n_q*(n_q+1));
+    for( size_t k = 0; k < ssg->op_count; k ++ ) {
+        const struct aa_rx_kin_op *op = &ssg->ops[k].op;
+        size_t col;
+        if( AA_RX_KIN_FIXED != op->code ) col = op->config;
+        else if( k + 1 == ssg->op_count ) col = n_q;
+        else continue;
+        for( aa_rx_frame_id p = op->parent; p >= 0; p = ssg->ops[p].op.parent ) {
+            const struct aa_rx_kin_op *pop = &ssg->ops[p].op;
+            if( AA_RX_KIN_FIXED != pop->code ) anc[pop->config + n_q*col] = 1;
+        }
+    }
+    /* a joint at the tip moves the end-effector too */
+    if( ssg->op_count > 0 ) {
+        const struct aa_rx_kin_op *op = &ssg->ops[ssg->op_count-1].op;
+        if( AA_RX_KIN_FIXED != op->code ) anc[op->config + n_q*n_q] = 1;
+    }
+}
+
+static void
+s_sub_jac_dot( const struct aa_rx_sg_sub *ssg,
+               const struct aa_rx_fk *fk,
+               const struct aa_dvec *q_sub, const struct aa_dvec *dq_sub,
+               struct aa_dmat *J_out, struct aa_dmat *J_dot, int vel )
+{
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    aa_la_check_size(n_q, q_sub->len);
+    aa_la_check_size(n_q, dq_sub->len);
+    aa_la_check_size(6, J_dot->rows);
+    aa_la_check_size(n_q, J_dot->cols);
+
+    double q_buf[n_q+1], dq_buf[n_q+1];
+    const double *q = s_dvec_contig(q_sub, q_buf);
+    const double *dq = s_dvec_contig(dq_sub, dq_buf);
+
+    double J[6*n_q+1], E_ee[AA_RX_TF_LEN];
+    char anc[n_q*(n_q+1)+1];
+    s_sub_jac_anc( ssg, fk, q, E_ee, J, anc );
+
+    /* J_dot_j = [ sum_{i < j} J_i dq_i, J_j ] */
+    double pe_dot[3] = {0,0,0};
+    for( size_t j = 0; j < n_q; j ++ ) {
+        double V[6] = {0,0,0, 0,0,0};
+        for( size_t i = 0; i < n_q; i ++ ) {
+            if( anc[i + n_q*j] ) {
+                for( size_t k = 0; k < 6; k ++ ) V[k] += J[6*i+k] * dq[i];
+            }
+        }
+        s_twist_ad( V, J + 6*j, &AA_DMAT_REF(J_dot, 0, j) );
+    }
+
+    const double *pe = E_ee + AA_TF_QUTR_T;
+    if( vel ) {
+        for( size_t i = 0; i < n_q; i ++ ) {
+            if( anc[i + n_q*n_q] ) {
+                double u[3];
+                s_twist_pe_vel( J + 6*i, pe, u );
+                for( size_t k = 0; k < 3; k ++ ) pe_dot[k] += u[k] * dq[i];
+            }
+        }
+        for( size_t j = 0; j < n_q; j ++ ) {
+            s_twist_dot2vel( J + 6*j, pe, pe_dot, &AA_DMAT_REF(J_dot, 0, j) );
+        }
+    }
+
+    if( J_out ) {
+        aa_la_check_size(6, J_out->rows);
+        aa_la_check_size(n_q, J_out->cols);
+        for( size_t j = 0; j < n_q; j ++ ) {
+            double *jo = &AA_DMAT_REF(J_out, 0, j);
+            AA_MEM_CPY( jo, J + 6*j, 6 );
+            if( vel ) s_twist_pe_vel( J + 6*j, pe, jo + AA_TF_DX_V );
+        }
+    }
+}
+
+AA_API void
+aa_rx_sg_sub_jac_twist_dot( const struct aa_rx_sg_sub *ssg,
+                            const struct aa_rx_fk *fk,
+                            const struct aa_dvec *q_sub, const struct aa_dvec *dq_sub,
+                            struct aa_dmat *J, struct aa_dmat *J_dot )
+{
+    s_sub_jac_dot( ssg, fk, q_sub, dq_sub, J, J_dot, 0 );
+}
+
+AA_API void
+aa_rx_sg_sub_jac_vel_dot( const struct aa_rx_sg_sub *ssg,
+                          const struct aa_rx_fk *fk,
+                          const struct aa_dvec *q_sub, const struct aa_dvec *dq_sub,
+                          struct aa_dmat *J, struct aa_dmat *J_dot )
+{
+    s_sub_jac_dot( ssg, fk, q_sub, dq_sub, J, J_dot, 1 );
+}
+
+static void
+s_sub_jac_hess( const struct aa_rx_sg_sub *ssg,
+                const struct aa_rx_fk *fk,
+                const struct aa_dvec *q_sub,
+                double *H, int vel )
+{
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    aa_la_check_size(n_q, q_sub->len);
+
+    double q_buf[n_q+1];
+    const double *q = s_dvec_contig(q_sub, q_buf);
+
+    double J[6*n_q+1], E_ee[AA_RX_TF_LEN];
+    char anc[n_q*(n_q+1)+1];
+    s_sub_jac_anc( ssg, fk, q, E_ee, J, anc );
+    const double *pe = E_ee + AA_TF_QUTR_T;
+
+    for( size_t i = 0; i < n_q; i ++ ) {
+        double dpe[3] = {0,0,0};
+        if( vel && anc[i + n_q*n_q] ) s_twist_pe_vel( J + 6*i, pe, dpe );
+        for( size_t j = 0; j < n_q; j ++ ) {
+            double *h = H + 6*(j + n_q*i);
+            if( anc[i + n_q*j] ) {
+                s_twist_ad( J + 6*i, J + 6*j, h );
+            } else {
+                AA_MEM_ZERO( h, 6 );
+            }
+            if( vel ) s_twist_dot2vel( J + 6*j, pe, dpe, h );
+        }
+    }
+}
+
+AA_API void
+aa_rx_sg_sub_jac_twist_hess( const struct aa_rx_sg_sub *ssg,
+                             const struct aa_rx_fk *fk,
+                             const struct aa_dvec *q_sub,
+                             double *H )
+{
+    s_sub_jac_hess( ssg, fk, q_sub, H, 0 );
+}
+
+AA_API void
+aa_rx_sg_sub_jac_vel_hess( const struct aa_rx_sg_sub *ssg,
+                           const struct aa_rx_fk *fk,
+                           const struct aa_dvec *q_sub,
+                           double *H )
+{
+    s_sub_jac_hess( ssg, fk, q_sub, H, 1 );
+}
+
+AA_API aa_rx_frame_id
+aa_rx_sg_sub_fk_jac_frame( const struct aa_rx_sg_sub *ssg )
+{
+    return ssg->op_count > 0 ?
+        ssg->ops[ssg->op_count-1].frame : AA_RX_FRAME_ROOT;
+}
+
 AA_API struct aa_dmat *
 aa_rx_sg_sub_jac_twist_get( const struct aa_rx_sg_sub *ssg, struct aa_mem_region *reg,
                             const struct aa_rx_fk *fk  )
@@ -481,6 +1230,7 @@ aa_rx_sg_sub_jac_vel_fill2( const struct aa_rx_sg_sub *ssg,
     aa_rx_frame_id *frames = aa_rx_sg_sub_frames(ssg);
     const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
 
+    const struct aa_rx_kin_op *prog = aa_rx_sg_kin_prog(sg);
     double *jr = Jr->data, *jp = Jp->data;
     size_t i_frame = 0, i_config = 0;
     for( ;
@@ -489,34 +1239,32 @@ aa_rx_sg_sub_jac_vel_fill2( const struct aa_rx_sg_sub *ssg,
     {
         aa_rx_frame_id frame = frames[i_frame];
         assert( frame >= 0 );
-        enum aa_rx_frame_type ft = aa_rx_sg_frame_type(sg, frame);
+        const struct aa_rx_kin_op *op = prog + frame;
 
-        switch(ft) {
-        case AA_RX_FRAME_FIXED:
+        switch(op->code) {
+        case AA_RX_KIN_FIXED:
             break;
 
-        case AA_RX_FRAME_REVOLUTE:
-        case AA_RX_FRAME_PRISMATIC: {
+        default: {
             assert( i_config <  n_configs );
 
-            const double *a = aa_rx_sg_frame_axis(sg, frame);
-            const double *E = aa_rx_fk_ref(fk,frame);
+            const double *a = op->axis;
+            const double *E = AA_RX_FK_REF(fk,(size_t)frame);
             const double *q = E + AA_TF_QUTR_Q;
             const double *t = E + AA_TF_QUTR_T;
 
-            switch(ft)  {
-            case AA_RX_FRAME_REVOLUTE: {
+            switch(op->code)  {
+            case AA_RX_KIN_PRISMATIC:
+                AA_MEM_ZERO(jr, 3);
+                aa_tf_qrot(q,a,jp);
+                break;
+            default: { /* revolute */
                 aa_tf_qrot(q,a,jr);
                 double tmp[3];
                 for( size_t j = 0; j < 3; j++ ) tmp[j] = pe[j] - t[j];
                 aa_tf_cross(jr, tmp, jp);
                 break;
             }
-            case AA_RX_FRAME_PRISMATIC:
-                AA_MEM_ZERO(jr, 3);
-                aa_tf_qrot(q,a,jp);
-                break;
-            default: assert(0);
             }
             jr += Jr->ld;
             jp += Jp->ld;
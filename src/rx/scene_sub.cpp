@@ -83,21 +83,14 @@ aa_rx_fk_sub( struct aa_rx_fk *fk,
               const struct aa_dvec *q_sub )
 {
     aa_rx_sg_ensure_clean_frames(ssg->scenegraph);
+    assert( fk->sg == ssg->scenegraph );
+
+    /* Other configurations stay at their last value in fk */
     size_t n_all = aa_rx_sg_config_count(ssg->scenegraph);
-    double q_all[n_all];
-    struct aa_dvec vq_all = AA_DVEC_INIT(n_all, q_all, 1);
+    struct aa_dvec vq_all = AA_DVEC_INIT(n_all, fk->q, 1);
     aa_rx_sg_sub_config_scatter(ssg, q_sub, &vq_all);
 
-    amino::SceneGraph *sg = ssg->scenegraph->sg;
-
-    for( size_t i_sub = 0; i_sub < ssg->frame_count; i_sub++ ) {
-        double E_rel[AA_RX_TF_LEN];
-        aa_rx_frame_id i_frame = ssg->frames[i_sub];
-        amino::SceneFrame *f = sg->frames[i_frame];
-        f->tf_rel(q_all, E_rel);
-        aa_rx_fk_set_rel(fk,i_frame,E_rel);
-    }
-
+    aa_rx_fk_update_ranges( fk, ssg->moved_count, ssg->moved );
 }
 
 AA_API size_t
@@ -112,7 +105,7 @@ aa_rx_sg_chain_multiple_frames( const struct aa_rx_sg *sg,
     for(size_t i=0; i < n_tips; i ++){
 	aa_rx_frame_id tip = tips[i];
 	while( tip !=root && tip != AA_RX_FRAME_ROOT ){
-	    if (frames.find(tip) == frames.end()) break;
+	    if (frames.find(tip) != frames.end()) break;
 	    enum aa_rx_frame_type ft = aa_rx_sg_frame_type( sg, tip );
 	    switch(ft) {
 	    case AA_RX_FRAME_FIXED:
@@ -129,7 +122,7 @@ aa_rx_sg_chain_multiple_frames( const struct aa_rx_sg *sg,
     size_t a=0;
     std::set<aa_rx_frame_id>::iterator it = frames.begin();
 
-    while( it != frames.end()){
+    while( it != frames.end() && a < n_frames ){
 	chain_frames[a] = *it;
 	a++;
 	it++;
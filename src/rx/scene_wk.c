@@ -76,34 +76,301 @@ aa_rx_wk_opts_destroy( struct aa_rx_wk_opts * opts)
 }
 
 AA_API int
-aa_rx_wk_dx2dq( const struct aa_rx_sg_sub *ssg,
-                const struct aa_rx_wk_opts * opts,
-                const struct aa_rx_fk *fk,
-                const struct aa_dvec *dx,
-                struct aa_dvec *dq )
+aa_rx_wk_jdx2dq( const struct aa_rx_wk_opts * opts,
+                 const struct aa_dmat *J,
+                 const struct aa_dvec *dx, const struct aa_dvec *dq_r,
+                 struct aa_dvec *dq )
 {
-    size_t rows,cols;
-    aa_rx_sg_sub_jacobian_size( ssg, &rows, &cols );
+    size_t rows = J->rows, cols = J->cols;
     aa_la_check_size(dx->len,   rows);
     aa_la_check_size(dq->len,   cols);
 
     struct aa_mem_region *reg =  aa_mem_region_local_get();
     void *ptrtop = aa_mem_region_ptr(reg);
 
-    struct aa_dmat *J = aa_dmat_alloc(reg,rows,cols);
     struct aa_dmat *J_star = aa_dmat_alloc(reg,cols,rows);
-    aa_rx_wk_get_js( ssg, opts, fk, J, J_star );
+    aa_rx_wk_get_jstar( opts, J, J_star );
 
     // workspace solution: dq = J^* dx
     aa_dmat_gemv( CblasNoTrans,
                   1.0, J_star, dx,
                   0.0, dq );
 
+    if( dq_r ) {
+        aa_la_check_size(dq_r->len, cols);
+        struct aa_dmat *N = aa_dmat_alloc(reg,cols,cols);
+        aa_rx_wk_get_n( NULL, opts, J, J_star, 1, N );
+
+        // Nullspace projection: dq = dq - N*dq_r
+        aa_dmat_gemv(CblasNoTrans,
+                     -1, N, dq_r,
+                     1, dq );
+    }
+
     aa_mem_region_pop(reg,ptrtop);
 
     return 0;
 }
 
+/*
+ * With the packed Jacobian, dq = J^T*M*(dx - J*dq_r) + dq_r where
+ * M = inv(J*J^T) with the same damping as aa_rx_wk_get_jstar().  Only
+ * G = J*J^T is formed, and each block G_ab sums over the joints
+ * shared by end-effectors a and b.
+ */
+AA_API int
+aa_rx_wk_jdx2dq_ees( const struct aa_rx_sg_sub *ssg,
+                     const struct aa_rx_wk_opts * opts,
+                     const double *J,
+                     const struct aa_dvec *dx, const struct aa_dvec *dq_r,
+                     struct aa_dvec *dq )
+{
+    size_t n_e = aa_rx_sg_sub_frame_ee_count(ssg);
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    size_t m = 6*n_e;
+    aa_la_check_size(dx->len, m);
+    aa_la_check_size(dq->len, n_q);
+    if( dq_r ) aa_la_check_size(dq_r->len, n_q);
+
+    struct aa_mem_region *reg =  aa_mem_region_local_get();
+    void *ptrtop = aa_mem_region_ptr(reg);
+
+    const size_t *c[n_e+1];
+    const double *Jk[n_e+1];
+    size_t nc[n_e+1];
+    for( size_t k = 0, off = 0; k < n_e; k ++ ) {
+        c[k] = aa_rx_sg_sub_ee_configs(ssg, k);
+        nc[k] = aa_rx_sg_sub_ee_config_count(ssg, k);
+        Jk[k] = J + 6*off;
+        off += nc[k];
+    }
+
+    // y = dx - J*dq_r
+    double *y = AA_MEM_REGION_NEW_N(reg, double, m);
+    for( size_t i = 0; i < m; i ++ ) y[i] = AA_DVEC_REF(dx,i);
+    if( dq_r ) {
+        for( size_t k = 0; k < n_e; k ++ ) {
+            for( size_t a = 0; a < nc[k]; a ++ ) {
+                double qa = AA_DVEC_REF(dq_r, c[k][a]);
+                for( size_t i = 0; i < 6; i ++ ) y[6*k+i] -= Jk[k][6*a+i] * qa;
+            }
+        }
+    }
+
+    // G = J*J^T over shared columns
+    double *G = AA_MEM_REGION_NEW_N(reg, double, m*m);
+    AA_MEM_ZERO(G, m*m);
+    for( size_t a = 0; a < n_e; a ++ ) {
+        for( size_t b = a; b < n_e; b ++ ) {
+            double *Gab = G + 6*a + 6*b*m;
+            for( size_t ia = 0, ib = 0; ia < nc[a] && ib < nc[b]; ) {
+                if( c[a][ia] < c[b][ib] ) { ia++; continue; }
+                if( c[a][ia] > c[b][ib] ) { ib++; continue; }
+                const double *ja = Jk[a] + 6*ia++, *jb = Jk[b] + 6*ib++;
+                for( size_t j = 0; j < 6; j ++ ) {
+                    for( size_t i = 0; i < 6; i ++ ) Gab[i+j*m] += ja[i]*jb[j];
+                }
+            }
+            for( size_t j = 0; j < 6; j ++ ) {
+                for( size_t i = 0; i < 6; i ++ ) G[6*b+j + (6*a+i)*m] = Gab[i+j*m];
+            }
+        }
+    }
+
+    // z = M*y, overwriting y
+    int r = 0;
+    if( opts->s2min <= 0 && opts->k_dls > 0 ) {
+        for( size_t i = 0; i < m; i ++ ) G[i+i*m] += opts->k_dls;
+        r = aa_cla_dposv( 'U', (int)m, 1, G, (int)m, y, (int)m );
+    } else {
+        // G = U*S*U^T, so with J = U*sqrt(S)*V^T the pseudo-inverse
+        // singular values become a scaling of U^T*y.
+        double *U = AA_MEM_REGION_NEW_N(reg, double, 2*m*m + m);
+        double *Vt = U + m*m, *S = Vt + m*m;
+        aa_la_d_svd( m, m, G, m, U, m, S, Vt, m );
+        // truncate at the precision of G rather than of J
+        double tol = (double)AA_MAX(m,n_q) * S[0] * DBL_EPSILON;
+        double t[m];
+        for( size_t i = 0; i < m; i ++ ) {
+            double ti = 0;
+            for( size_t j = 0; j < m; j ++ ) ti += U[j+i*m] * y[j];
+            if( opts->s2min > 0 ) {
+                t[i] = ti / AA_MAX(S[i], opts->s2min);
+            } else {
+                t[i] = (S[i] > tol) ? ti / S[i] : 0;
+            }
+        }
+        for( size_t j = 0; j < m; j ++ ) {
+            y[j] = 0;
+            for( size_t i = 0; i < m; i ++ ) y[j] += U[j+i*m] * t[i];
+        }
+    }
+
+    // dq = J^T*z + dq_r
+    if( dq_r ) aa_dvec_copy( dq_r, dq );
+    else aa_dvec_zero( dq );
+    for( size_t k = 0; k < n_e; k ++ ) {
+        for( size_t a = 0; a < nc[k]; a ++ ) {
+            double d = 0;
+            for( size_t i = 0; i < 6; i ++ ) d += Jk[k][6*a+i] * y[6*k+i];
+            AA_DVEC_REF(dq, c[k][a]) += d;
+        }
+    }
+
+    aa_mem_region_pop(reg,ptrtop);
+
+    return r;
+}
+
+struct aa_rx_wk_prio_cx {
+    struct aa_rx_wk_opts opts;
+    size_t n_q;
+    size_t n_tasks;
+    size_t *rows;
+
+    double *P;      /* null-space projector of the levels so far */
+    double *Jh;     /* level Jacobian, projected by P */
+    double *U;
+    double *S;
+    double *Vt;
+    double *e;      /* level error, then scaled by the inverse */
+};
+
+AA_API struct aa_rx_wk_prio_cx *
+aa_rx_wk_prio_create( const struct aa_rx_wk_opts *opts,
+                      size_t n_q, size_t n_tasks, const size_t *rows )
+{
+    size_t m = 0;
+    for( size_t k = 0; k < n_tasks; k ++ ) m = AA_MAX(m, rows[k]);
+
+    struct aa_rx_wk_prio_cx *cx = AA_NEW0(struct aa_rx_wk_prio_cx);
+    memcpy(&cx->opts, opts, sizeof(*opts));
+    cx->n_q = n_q;
+    cx->n_tasks = n_tasks;
+    cx->rows = AA_NEW_AR(size_t, n_tasks);
+    AA_MEM_CPY(cx->rows, rows, n_tasks);
+
+    double *buf = AA_NEW_AR(double, 2*n_q*n_q + m*n_q + m*m + 2*m);
+    cx->P  = buf;
+    cx->Vt = cx->P + n_q*n_q;
+    cx->Jh = cx->Vt + n_q*n_q;
+    cx->U  = cx->Jh + m*n_q;
+    cx->S  = cx->U + m*m;
+    cx->e  = cx->S + m;
+    return cx;
+}
+
+AA_API void
+aa_rx_wk_prio_destroy( struct aa_rx_wk_prio_cx *cx )
+{
+    free(cx->P);
+    free(cx->rows);
+    free(cx);
+}
+
+/* Singular value inverse, matching the damping of aa_rx_wk_get_jstar() */
+static double
+s_prio_sinv( const struct aa_rx_wk_opts *opts, double s, double tol )
+{
+    if( opts->s2min > 0 ) {
+        return (s*s >= opts->s2min) ? 1/s : s/opts->s2min;
+    } else if( opts->k_dls > 0 ) {
+        return s / (s*s + opts->k_dls);
+    } else {
+        return (s > tol) ? 1/s : 0;
+    }
+}
+
+AA_API int
+aa_rx_wk_jdx2dq_prio( struct aa_rx_wk_prio_cx *cx,
+                      const struct aa_dmat *J,
+                      const struct aa_dvec *dx, const struct aa_dvec *dq_r,
+                      struct aa_dvec *dq )
+{
+    const size_t n = cx->n_q;
+    const int ni = (int)n;
+    size_t m_all = 0;
+    for( size_t k = 0; k < cx->n_tasks; k ++ ) m_all += cx->rows[k];
+    aa_la_check_size(J->rows, m_all);
+    aa_la_check_size(J->cols, n);
+    aa_la_check_size(dx->len, m_all);
+    aa_la_check_size(dq->len, n);
+    if( dq_r ) aa_la_check_size(dq_r->len, n);
+
+    /* P = I, dq = 0 */
+    AA_MEM_ZERO(cx->P, n*n);
+    for( size_t i = 0; i < n; i ++ ) cx->P[i*(n+1)] = 1;
+    aa_dvec_zero(dq);
+
+    size_t r0 = 0;
+    for( size_t k = 0; k < cx->n_tasks; r0 += cx->rows[k++] ) {
+        const size_t m = cx->rows[k];
+        const int mi = (int)m;
+        if( 0 == m ) continue;
+        struct aa_dmat Jk;
+        aa_dmat_view_block( &Jk, J, r0, 0, m, n );
+
+        /* Jh = J_k * P */
+        if( 0 == k ) {
+            struct aa_dmat Jh = AA_DMAT_INIT(m, n, cx->Jh, m);
+            aa_dmat_lacpy( "A", &Jk, &Jh );
+        } else {
+            cblas_dgemm( CblasColMajor, CblasNoTrans, CblasNoTrans,
+                         mi, ni, ni,
+                         1, Jk.data, (int)Jk.ld, cx->P, ni,
+                         0, cx->Jh, mi );
+        }
+
+        /* e = dx_k - J_k * dq */
+        cblas_dcopy( mi, dx->data + r0*dx->inc, (int)dx->inc, cx->e, 1 );
+        cblas_dgemv( CblasColMajor, CblasNoTrans, mi, ni,
+                     -1, Jk.data, (int)Jk.ld, AA_VEC_ARGS(dq),
+                     1, cx->e, 1 );
+
+        int r = aa_la_d_svd( m, n, cx->Jh, m, cx->U, m, cx->S, cx->Vt, n );
+        if( r ) return r;
+
+        /* dq += V * inv(S) * U^T * e
+         * P  -= V * inv(S) * S * V^T */
+        size_t kmin = AA_MIN(m, n);
+        double tol = (double)AA_MAX(m, n) * cx->S[0] * DBL_EPSILON;
+        double ue[kmin];
+        int last = (k+1 == cx->n_tasks) && !dq_r;
+        for( size_t i = 0; i < kmin; i ++ ) {
+            double s = cx->S[i];
+            double f = s_prio_sinv( &cx->opts, s, tol );
+            ue[i] = f * cblas_ddot( mi, cx->U + m*i, 1, cx->e, 1 );
+            if( !last && f > 0 ) {
+                cblas_dger( CblasColMajor, ni, ni, -f*s,
+                            cx->Vt + i, ni, cx->Vt + i, ni,
+                            cx->P, ni );
+            }
+        }
+        cblas_dgemv( CblasColMajor, CblasTrans, (int)kmin, ni,
+                     1, cx->Vt, ni, ue, 1,
+                     1, AA_VEC_ARGS(dq) );
+    }
+
+    /* dq += P * dq_r */
+    if( dq_r ) {
+        cblas_dgemv( CblasColMajor, CblasNoTrans, ni, ni,
+                     1, cx->P, ni, AA_VEC_ARGS(dq_r),
+                     1, AA_VEC_ARGS(dq) );
+    }
+
+    return 0;
+}
+
+AA_API int
+aa_rx_wk_dx2dq( const struct aa_rx_sg_sub *ssg,
+                const struct aa_rx_wk_opts * opts,
+                const struct aa_rx_fk *fk,
+                const struct aa_dvec *dx,
+                struct aa_dvec *dq )
+{
+    return aa_rx_wk_dx2dq_np( ssg, opts, fk, dx, NULL, dq );
+}
+
 AA_API int
 aa_rx_wk_dx2dq_np( const struct aa_rx_sg_sub *ssg,
                    const struct aa_rx_wk_opts * opts,
@@ -113,31 +380,16 @@ aa_rx_wk_dx2dq_np( const struct aa_rx_sg_sub *ssg,
 {
     size_t rows, cols;
     aa_rx_sg_sub_jacobian_size( ssg, &rows, &cols );
-    aa_la_check_size(dx->len,   rows);
-    aa_la_check_size(dq_r->len, cols);
-    aa_la_check_size(dq->len,   cols);
 
     struct aa_mem_region *reg =  aa_mem_region_local_get();
     void *ptrtop = aa_mem_region_ptr(reg);
 
     struct aa_dmat *J = aa_dmat_alloc(reg,rows,cols);
-    struct aa_dmat *J_star = aa_dmat_alloc(reg,cols,rows);
-    struct aa_dmat *N = aa_dmat_alloc(reg,cols,cols);
-    aa_rx_wk_get_js( ssg, opts, fk, J, J_star );
-    aa_rx_wk_get_n( ssg, opts, J, J_star, 1, N );
-
-    // workspace solution: dq = J^* dx
-    aa_dmat_gemv(CblasNoTrans,
-                 1, J_star, dx,
-                 0, dq );
-
-    // Nullspace projection: dq = dq - N*dq_r
-    aa_dmat_gemv(CblasNoTrans,
-                 -1, N, dq_r,
-                 1, dq );
+    aa_rx_sg_sub_jac_vel_fill( ssg, fk, J );
+    int r = aa_rx_wk_jdx2dq( opts, J, dx, dq_r, dq );
 
     aa_mem_region_pop(reg,ptrtop);
-    return 0;
+    return r;
 }
 
 AA_API void
@@ -302,6 +302,51 @@ static void sort_frame_helper( std::list<SceneFrame*> &list,
     list.push_back(f);
 }
 
+/* Index of the only nonzero unit element of axis, or -1 */
+static int unit_axis( const double axis[3] )
+{
+    for( int i = 0; i < 3; i ++ ) {
+        int j = (i+1)%3, k = (i+2)%3;
+        if( 1 == fabs(axis[i]) && 0 == axis[j] && 0 == axis[k] ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void compile_frame( SceneFrame *f, struct aa_rx_kin_op *op )
+{
+    AA_MEM_CPY( op->E, f->E, 7 );
+    op->parent = f->parent_id;
+    op->config = 0;
+    op->offset = 0;
+    AA_MEM_ZERO( op->axis, 3 );
+    AA_MEM_ZERO( op->axis_v, 3 );
+
+    switch( f->type ) {
+    case AA_RX_FRAME_FIXED:
+        op->code = AA_RX_KIN_FIXED;
+        return;
+    case AA_RX_FRAME_REVOLUTE:
+    case AA_RX_FRAME_PRISMATIC: {
+        SceneFrameJoint *fj = static_cast<SceneFrameJoint*>(f);
+        op->config = fj->config_index;
+        op->offset = fj->offset;
+        AA_MEM_CPY( op->axis, fj->axis, 3 );
+        if( AA_RX_FRAME_PRISMATIC == f->type ) {
+            op->code = AA_RX_KIN_PRISMATIC;
+            aa_tf_qrot( f->E + AA_TF_QUTR_Q, fj->axis, op->axis_v );
+        } else {
+            static const enum aa_rx_kin_opcode codes[3] =
+                {AA_RX_KIN_REVOLUTE_X, AA_RX_KIN_REVOLUTE_Y, AA_RX_KIN_REVOLUTE_Z};
+            int i = unit_axis( fj->axis );
+            op->code = (i < 0) ? AA_RX_KIN_REVOLUTE : codes[i];
+        }
+        return;
+    }
+    }
+}
+
 int SceneGraph::index()
 {
     if( ! dirty_indices ) return 0;
@@ -371,6 +416,29 @@ int SceneGraph::index()
         }
     }
 
+    // Compile kinematics
+    kin_prog.resize( frames.size() );
+    for( size_t i = 0; i < frames.size(); i ++ ) {
+        compile_frame( frames[i], &kin_prog[i] );
+    }
+
+    // Fold fixed frames into their descendants
+    kin_fold = kin_prog;
+    for( size_t i = 0; i < kin_fold.size(); i ++ ) {
+        struct aa_rx_kin_op *op = &kin_fold[i];
+        if( op->parent < 0 ) continue;
+        const struct aa_rx_kin_op *p = &kin_fold[(size_t)op->parent];
+        if( AA_RX_KIN_FIXED != p->code ) continue;
+        // parent is already folded onto a joint or the root
+        double E[7];
+        aa_tf_qutr_mul( p->E, op->E, E );
+        AA_MEM_CPY( op->E, E, 7 );
+        op->parent = p->parent;
+        if( AA_RX_KIN_PRISMATIC == op->code ) {
+            aa_tf_qrot( op->E + AA_TF_QUTR_Q, op->axis, op->axis_v );
+        }
+    }
+
     dirty_indices = 0;
     return 0;
 }
@@ -253,25 +253,17 @@ AA_API void aa_rx_sg_tf
     amino::SceneGraph *sg = scene_graph->sg;
 
 
+    const struct aa_rx_kin_op *prog = sg->kin_prog.data();
     double *E_rel = TF_rel, *E_abs = TF_abs;
     for( size_t i_frame = 0;
          i_frame < n_tf && i_frame < sg->frames.size();
          i_frame++,
              E_rel += ld_rel, E_abs += ld_abs )
     {
-        amino::SceneFrame *f = sg->frames[i_frame];
-        // compute relative
-        f->tf_rel( q, E_rel );
-        // chain to global
-        if( f->in_global() ) {
-            // TODO: can we somehow get rid of this branch?
-            //       maybe a separate type for global frames
-            AA_MEM_CPY(E_abs, E_rel, 7);
-        } else {
-            assert( f->parent_id < (ssize_t)i_frame );
-            double *E_abs_parent = TF_abs + (ld_abs * (size_t)f->parent_id);
-            aa_tf_qutr_mul(E_abs_parent, E_rel, E_abs);
-        }
+        const struct aa_rx_kin_op *op = prog + i_frame;
+        assert( op->parent < (ssize_t)i_frame );
+        aa_rx_kin_op_rel( op, q, E_rel );
+        aa_rx_kin_op_abs( op, TF_abs, ld_abs, E_rel, E_abs );
     }
 
 }
@@ -404,6 +396,7 @@ AA_API void aa_rx_sg_tf_update
     amino::SceneGraph *sg = scene_graph->sg;
     assert( n_q == scene_graph->sg->config_size );
 
+    const struct aa_rx_kin_op *prog = sg->kin_prog.data();
     bool updated[sg->frames.size()];
 
     const double *E_rel0 = TF_rel0;
@@ -419,40 +412,24 @@ AA_API void aa_rx_sg_tf_update
              E_abs += ld_abs
         )
     {
-        amino::SceneFrame *f = sg->frames[i_frame];
-        enum aa_rx_frame_type type = f->type;
-        bool update_abs = 0;
-        bool in_global =  f->in_global();
-
-        switch( type ) {
-        case AA_RX_FRAME_FIXED:
-            f->tf_rel(q, E_rel);
-            update_abs = !in_global && updated[f->parent_id];
-            break;
-        case AA_RX_FRAME_REVOLUTE:
-        case AA_RX_FRAME_PRISMATIC: {
-            amino::SceneFrameJoint *fj = static_cast<amino::SceneFrameJoint*>(f);
-            if( aa_feq(q0[fj->config_index], q[fj->config_index], 0 )) {
-                AA_MEM_CPY(E_rel, E_rel0, 7);
-                update_abs = !in_global && updated[f->parent_id];
-            } else {
-                f->tf_rel(q, E_rel);
-                update_abs = 1;
-            }
-            break; }
+        const struct aa_rx_kin_op *op = prog + i_frame;
+        bool in_global = op->parent < 0;
+        bool update_abs;
+
+        if( AA_RX_KIN_FIXED == op->code ) {
+            AA_MEM_CPY(E_rel, op->E, 7);
+            update_abs = !in_global && updated[op->parent];
+        } else if( aa_feq(q0[op->config], q[op->config], 0 ) ) {
+            AA_MEM_CPY(E_rel, E_rel0, 7);
+            update_abs = !in_global && updated[op->parent];
+        } else {
+            aa_rx_kin_op_rel(op, q, E_rel);
+            update_abs = 1;
         }
 
         if( update_abs ) {
-            // chain to global
-            if( in_global ) {
-                // TODO: can we somehow get rid of this branch?
-                //       maybe a separate type for global frames
-                AA_MEM_CPY(E_abs, E_rel, 7);
-            } else {
-                assert( f->parent_id < (ssize_t)i_frame );
-                double *E_abs_parent = TF_abs + (ld_abs * (size_t)f->parent_id);
-                aa_tf_qutr_mul(E_abs_parent, E_rel, E_abs);
-            }
+            assert( op->parent < (ssize_t)i_frame );
+            aa_rx_kin_op_abs( op, TF_abs, ld_abs, E_rel, E_abs );
             updated[i_frame] = 1;
         } else {
             AA_MEM_CPY(E_abs, E_abs0, 7);
@@ -858,11 +835,19 @@ aa_rx_sg_alloc_config ( const struct aa_rx_sg *sg, struct aa_mem_region *region
 struct aa_rx_fk *
 aa_rx_fk_alloc(const struct aa_rx_sg *scene_graph, struct aa_mem_region *reg)
 {
+    size_t n_f = aa_rx_sg_frame_count(scene_graph);
     struct aa_rx_fk *fk = AA_MEM_REGION_NEW(reg,struct aa_rx_fk);
     fk->sg = scene_graph;
-    fk->TF_abs = AA_MEM_REGION_NEW_N( reg,double,
-                                      AA_RX_FK_LD*aa_rx_sg_frame_count(scene_graph));
+    fk->TF_abs = AA_MEM_REGION_NEW_N( reg,double, AA_RX_FK_LD*n_f);
+    /* aa_rx_fk_set_config() relies on a zero initial configuration */
+    fk->q = AA_MEM_REGION_ZNEW_N( reg, double, aa_rx_sg_config_count(scene_graph) );
+    fk->dirty = (aa_bits*)aa_mem_region_zalloc( reg, aa_bits_size(n_f) );
+    fk->lazy = (aa_bits*)aa_mem_region_zalloc( reg, aa_bits_size(n_f) );
+    fk->stale = (aa_bits*)aa_mem_region_zalloc( reg, aa_bits_size(n_f) );
+    fk->materialized = (aa_bits*)aa_mem_region_zalloc( reg, aa_bits_size(n_f) );
     fk->in_heap = 0;
+    fk->q_valid = 0;
+    fk->collapsed = 0;
     return fk;
 }
 
@@ -872,19 +857,60 @@ aa_rx_fk_alloc(const struct aa_rx_sg *scene_graph, struct aa_mem_region *reg)
 struct aa_rx_fk *
 aa_rx_fk_malloc(const struct aa_rx_sg *scene_graph)
 {
+    size_t n_f = aa_rx_sg_frame_count(scene_graph);
     struct aa_rx_fk *fk = AA_NEW(struct aa_rx_fk);
     fk->sg = scene_graph;
-    fk->TF_abs = AA_NEW_AR(double, AA_RX_FK_LD*aa_rx_sg_frame_count(scene_graph));
+    fk->TF_abs = AA_NEW_AR(double, AA_RX_FK_LD*n_f);
+    /* aa_rx_fk_set_config() relies on a zero initial configuration */
+    fk->q = AA_NEW0_AR( double, aa_rx_sg_config_count(scene_graph) );
+    fk->dirty = (aa_bits*)aa_malloc0( aa_bits_size(n_f) );
+    fk->lazy = (aa_bits*)aa_malloc0( aa_bits_size(n_f) );
+    fk->stale = (aa_bits*)aa_malloc0( aa_bits_size(n_f) );
+    fk->materialized = (aa_bits*)aa_malloc0( aa_bits_size(n_f) );
     fk->in_heap = 1;
+    fk->q_valid = 0;
+    fk->collapsed = 0;
     return fk;
 }
 
+/*
+ * Derive a stale frame from its folded parent.
+ */
+static inline void
+s_fk_derive( struct aa_rx_fk *fk, size_t id )
+{
+    const struct aa_rx_kin_op *op = &fk->sg->sg->kin_fold[id];
+    aa_rx_kin_op_abs( op, fk->TF_abs, AA_RX_FK_LD, op->E,
+                      AA_RX_FK_REF(fk, id) );
+    aa_bits_set( fk->stale, id, 0 );
+}
+
+/*
+ * Derive all stale frames.
+ */
+static void
+s_fk_derive_all( struct aa_rx_fk *fk )
+{
+    if( ! fk->collapsed ) return;
+    size_t n_f = aa_rx_sg_frame_count(fk->sg);
+    for( size_t i = 0; i < n_f; i ++ ) {
+        if( aa_bits_get(fk->stale, i) ) s_fk_derive(fk, i);
+    }
+}
+
 AA_API void
 aa_rx_fk_cpy(struct aa_rx_fk *dst, const struct aa_rx_fk *src)
 {
     assert( src->sg == dst->sg );
-    AA_MEM_CPY( dst->TF_abs, src->TF_abs,
-                AA_RX_FK_LD * aa_rx_sg_frame_count(src->sg) );
+    size_t n_f = aa_rx_sg_frame_count(src->sg);
+    AA_MEM_CPY( dst->TF_abs, src->TF_abs, AA_RX_FK_LD * n_f );
+    AA_MEM_CPY( dst->q, src->q, aa_rx_sg_config_count(src->sg) );
+    /* Copy the mode too, since stale frames of src are not derived */
+    AA_MEM_CPY( dst->lazy, src->lazy, aa_bits_words(n_f) );
+    AA_MEM_CPY( dst->stale, src->stale, aa_bits_words(n_f) );
+    AA_MEM_CPY( dst->materialized, src->materialized, aa_bits_words(n_f) );
+    dst->collapsed = src->collapsed;
+    dst->q_valid = src->q_valid;
 }
 
 AA_API double *
@@ -901,7 +927,7 @@ aa_rx_fk_get_abs_qutr(const struct aa_rx_fk *fk, aa_rx_frame_id id, double E[7]
         abort();
         exit(EXIT_FAILURE);
     }
-    AA_MEM_CPY(E, AA_RX_FK_REF(fk, (size_t)(id)), AA_RX_TF_LEN);
+    AA_MEM_CPY(E, aa_rx_fk_ref(fk, id), AA_RX_TF_LEN);
 }
 
 
@@ -911,10 +937,10 @@ aa_rx_fk_get_rel_qutr(const struct aa_rx_fk *fk,
                       double E[7])
 {
     const double *gEp = (AA_RX_FRAME_ROOT == parent) ?
-        aa_tf_qutr_ident : AA_RX_FK_REF(fk, (size_t)(parent));
+        aa_tf_qutr_ident : aa_rx_fk_ref(fk, parent);
 
     const double *gEc = (AA_RX_FRAME_ROOT == child) ?
-        aa_tf_qutr_ident : AA_RX_FK_REF(fk, (size_t)(child));
+        aa_tf_qutr_ident : aa_rx_fk_ref(fk, child);
 
     aa_tf_qutr_cmul(gEp, gEc, E);
 }
@@ -927,6 +953,11 @@ aa_rx_fk_destroy(struct aa_rx_fk * fk)
 {
     if( fk->in_heap ) {
         free(fk->TF_abs);
+        free(fk->q);
+        free(fk->dirty);
+        free(fk->lazy);
+        free(fk->stale);
+        free(fk->materialized);
         free(fk);
     } else {
         fprintf(stderr, "ERROR: attempting to free non-heap allocated aa_rx_fk.");
@@ -935,21 +966,135 @@ aa_rx_fk_destroy(struct aa_rx_fk * fk)
     }
 }
 
+AA_API const struct aa_rx_kin_op *
+aa_rx_sg_kin_prog( const struct aa_rx_sg *scene_graph )
+{
+    aa_rx_sg_ensure_clean_frames(scene_graph);
+    return scene_graph->sg->kin_prog.data();
+}
+
+AA_API const struct aa_rx_kin_op *
+aa_rx_sg_kin_fold( const struct aa_rx_sg *scene_graph )
+{
+    aa_rx_sg_ensure_clean_frames(scene_graph);
+    return scene_graph->sg->kin_fold.data();
+}
+
+AA_API void
+aa_rx_kin_prog_fk( const struct aa_rx_kin_op *prog, size_t n,
+                   const double *q,
+                   double *TF_abs, size_t ld_abs )
+{
+    double E_rel[AA_RX_TF_LEN];
+    double *E_abs = TF_abs;
+    for( const struct aa_rx_kin_op *op = prog, *end = prog + n;
+         op < end;
+         op++, E_abs += ld_abs )
+    {
+        if( AA_RX_KIN_FIXED == op->code ) {
+            aa_rx_kin_op_abs( op, TF_abs, ld_abs, op->E, E_abs );
+        } else {
+            aa_rx_kin_op_rel( op, q, E_rel );
+            aa_rx_kin_op_abs( op, TF_abs, ld_abs, E_rel, E_abs );
+        }
+    }
+}
+
 AA_API void
 aa_rx_fk_set_rel(struct aa_rx_fk *fk, aa_rx_frame_id id, const double E_rel[AA_RX_TF_LEN])
 {
+    fk->q_valid = 0;
     aa_rx_frame_id parent = aa_rx_sg_frame_parent(fk->sg,id);
-    double *E_abs = aa_rx_fk_ref(fk, id);
+    double *E_abs = AA_RX_FK_REF(fk, (size_t)id);
+    aa_bits_set( fk->stale, (size_t)id, 0 );
     if( AA_RX_FRAME_ROOT ==  parent ) {
         // TODO: can we somehow get rid of this branch?
         //       maybe a separate type for global frames
         AA_MEM_CPY(E_abs, E_rel, AA_RX_TF_LEN);
     } else {
+        aa_rx_fk_derive(fk, parent);
         double *E_abs_parent = aa_rx_fk_ref(fk, parent);
         aa_tf_qutr_mul(E_abs_parent, E_rel, E_abs);
     }
 }
 
+/*
+ * Recompute dirty frames, and their descendants, starting at i_start.
+ */
+static void
+s_fk_sweep( struct aa_rx_fk *fk, size_t i_start )
+{
+    amino::SceneGraph *sg = fk->sg->sg;
+    const struct aa_rx_kin_op *prog =
+        fk->collapsed ? sg->kin_fold.data() : sg->kin_prog.data();
+    size_t n_f = sg->kin_prog.size();
+    aa_bits *dirty = fk->dirty;
+
+    double E_rel[AA_RX_TF_LEN];
+    for( size_t i = i_start; i < n_f; i ++ ) {
+        const struct aa_rx_kin_op *op = prog + i;
+        if( aa_bits_get(dirty, i) ||
+            (op->parent >= 0 && aa_bits_get(dirty, (size_t)op->parent)) )
+        {
+            if( fk->collapsed && aa_bits_get(fk->lazy, i) ) {
+                aa_bits_set(fk->stale, i, 1);
+                continue;
+            }
+            aa_rx_kin_op_rel( op, fk->q, E_rel );
+            aa_rx_kin_op_abs( op, fk->TF_abs, AA_RX_FK_LD, E_rel,
+                              AA_RX_FK_REF(fk, i) );
+            aa_bits_set(dirty, i, 1);
+        }
+    }
+
+    AA_MEM_ZERO( dirty, aa_bits_words(n_f) );
+}
+
+/*
+ * Compute all frames for configuration q.
+ */
+static void
+s_fk_full( struct aa_rx_fk *fk, const double *q )
+{
+    amino::SceneGraph *sg = fk->sg->sg;
+    size_t n_f = sg->kin_prog.size();
+    if( fk->collapsed ) {
+        const struct aa_rx_kin_op *prog = sg->kin_fold.data();
+        double E_rel[AA_RX_TF_LEN];
+        for( size_t i = 0; i < n_f; i ++ ) {
+            if( aa_bits_get(fk->lazy, i) ) continue;
+            aa_rx_kin_op_rel( prog+i, q, E_rel );
+            aa_rx_kin_op_abs( prog+i, fk->TF_abs, AA_RX_FK_LD, E_rel,
+                              AA_RX_FK_REF(fk, i) );
+        }
+        AA_MEM_CPY( fk->stale, fk->lazy, aa_bits_words(n_f) );
+    } else {
+        aa_rx_kin_prog_fk( sg->kin_prog.data(), n_f,
+                           q, fk->TF_abs, AA_RX_FK_LD );
+    }
+    fk->q_valid = 1;
+}
+
+/*
+ * Mark joint frames for config_id as dirty, returning the least such
+ * frame.
+ */
+static size_t
+s_fk_mark( struct aa_rx_fk *fk, size_t config_id, size_t i_min )
+{
+    amino::SceneGraph *sg = fk->sg->sg;
+    const struct aa_rx_kin_op *prog = sg->kin_prog.data();
+    size_t n_f = sg->kin_prog.size();
+    for( size_t i = 0; i < n_f; i ++ ) {
+        const struct aa_rx_kin_op *op = prog + i;
+        if( AA_RX_KIN_FIXED != op->code && config_id == op->config ) {
+            aa_bits_set(fk->dirty, i, 1);
+            i_min = AA_MIN(i_min, i);
+        }
+    }
+    return i_min;
+}
+
 /**
  * Compute the forward kinematics.
  */
@@ -960,18 +1105,122 @@ aa_rx_fk_all( struct aa_rx_fk *fk,
 {
     const struct aa_rx_sg *scenegraph = fk->sg;
     aa_rx_sg_ensure_clean_frames(scenegraph);
-    aa_dvec_check_size( aa_rx_sg_config_count(scenegraph), q );
+    size_t n_q = aa_rx_sg_config_count(scenegraph);
+    aa_dvec_check_size( n_q, q );
 
     amino::SceneGraph *sg = scenegraph->sg;
 
-    double E_rel[AA_RX_TF_LEN], *E_abs = fk->TF_abs;
-    for( size_t i_frame = 0;
-         i_frame < sg->frames.size();
-         i_frame++, E_abs += AA_RX_FK_LD )
-    {
-        amino::SceneFrame *f = sg->frames[i_frame];
-        f->tf_rel( q->data, E_rel );
-        aa_rx_fk_set_rel(fk,i_frame,E_rel);
+    if( ! fk->q_valid ) {
+        s_fk_full( fk, q->data );
+        AA_MEM_CPY( fk->q, q->data, n_q );
+        return;
+    }
+
+    /* Only recompute frames below changed joints */
+    const struct aa_rx_kin_op *prog = sg->kin_prog.data();
+    size_t n_f = sg->kin_prog.size();
+    size_t i_min = n_f;
+    for( size_t i = 0; i < n_f; i ++ ) {
+        const struct aa_rx_kin_op *op = prog + i;
+        if( AA_RX_KIN_FIXED != op->code &&
+            ! aa_feq(q->data[op->config], fk->q[op->config], 0) )
+        {
+            aa_bits_set(fk->dirty, i, 1);
+            i_min = AA_MIN(i_min, i);
+        }
+    }
+
+    AA_MEM_CPY( fk->q, q->data, n_q );
+    s_fk_sweep( fk, i_min );
+}
+
+AA_API void
+aa_rx_fk_update_ranges( struct aa_rx_fk *fk,
+                        size_t n_ranges, const size_t *ranges )
+{
+    if( ! fk->q_valid ) {
+        s_fk_full( fk, fk->q );
+        return;
+    }
+
+    amino::SceneGraph *sg = fk->sg->sg;
+    const struct aa_rx_kin_op *prog =
+        fk->collapsed ? sg->kin_fold.data() : sg->kin_prog.data();
+
+    double E_rel[AA_RX_TF_LEN];
+    for( size_t r = 0; r < n_ranges; r ++ ) {
+        for( size_t i = ranges[2*r]; i < ranges[2*r+1]; i ++ ) {
+            if( fk->collapsed && aa_bits_get(fk->lazy, i) ) {
+                aa_bits_set(fk->stale, i, 1);
+                continue;
+            }
+            aa_rx_kin_op_rel( prog+i, fk->q, E_rel );
+            aa_rx_kin_op_abs( prog+i, fk->TF_abs, AA_RX_FK_LD, E_rel,
+                              AA_RX_FK_REF(fk, i) );
+        }
+    }
+}
+
+AA_API void
+aa_rx_fk_set_config( struct aa_rx_fk *fk,
+                     aa_rx_config_id config_id, double value )
+{
+    aa_rx_sg_ensure_clean_frames(fk->sg);
+    assert( config_id >= 0 &&
+            (size_t)config_id < aa_rx_sg_config_count(fk->sg) );
+
+    size_t i_config = (size_t)config_id;
+
+    if( ! fk->q_valid ) {
+        fk->q[i_config] = value;
+        s_fk_full( fk, fk->q );
+    } else if( ! aa_feq(fk->q[i_config], value, 0) ) {
+        fk->q[i_config] = value;
+        s_fk_sweep( fk, s_fk_mark(fk, i_config, aa_rx_fk_cnt(fk)) );
+    }
+}
+
+AA_API void
+aa_rx_fk_set_collapsed( struct aa_rx_fk *fk, int collapsed )
+{
+    aa_rx_sg_ensure_clean_frames(fk->sg);
+    amino::SceneGraph *sg = fk->sg->sg;
+    size_t n_f = sg->frames.size();
+
+    s_fk_derive_all( fk );
+    AA_MEM_ZERO( fk->lazy, aa_bits_words(n_f) );
+    AA_MEM_ZERO( fk->stale, aa_bits_words(n_f) );
+
+    if( collapsed ) {
+        for( size_t i = 0; i < n_f; i ++ ) {
+            aa_bits_set( fk->lazy, i,
+                         AA_RX_KIN_FIXED == sg->kin_prog[i].code &&
+                         sg->frames[i]->geometry.empty() &&
+                         ! aa_bits_get(fk->materialized, i) );
+        }
+    }
+
+    fk->collapsed = collapsed ? 1 : 0;
+}
+
+AA_API void
+aa_rx_fk_materialize( struct aa_rx_fk *fk, aa_rx_frame_id id )
+{
+    assert( id >= 0 && (size_t)id < aa_rx_fk_cnt(fk) );
+    aa_bits_set( fk->materialized, (size_t)id, 1 );
+    if( fk->collapsed ) {
+        /* compute now, then keep current on every update */
+        aa_rx_fk_derive( fk, id );
+        aa_bits_set( fk->lazy, (size_t)id, 0 );
+    }
+}
+
+AA_API void
+aa_rx_fk_derive( struct aa_rx_fk *fk, aa_rx_frame_id id )
+{
+    assert( id >= 0 && (size_t)id < aa_rx_fk_cnt(fk) );
+    if( fk->collapsed && aa_bits_get(fk->stale, (size_t)id) ) {
+        s_fk_derive( fk, (size_t)id );
     }
 }
 
@@ -995,3 +1244,125 @@ aa_rx_fk_cnt( const struct aa_rx_fk *fk )
 {
     return aa_rx_sg_frame_count(fk->sg);
 }
+
+
+/*
+ * Structure-of-arrays product C = A*B, for n transforms.  Component
+ * k of A is stored contiguously at A + k*lda, and likewise for B and
+ * C.  The loop body is branch-free and independent across the n
+ * transforms so that the compiler may vectorize it.
+ */
+static void
+s_qutr_mul_soa( size_t n,
+                const double *A, size_t lda,
+                const double *B, size_t ldb,
+                double *C, size_t ldc )
+{
+    const double *ax = A, *ay = A+lda, *az = A+2*lda, *aw = A+3*lda;
+    const double *avx = A+4*lda, *avy = A+5*lda, *avz = A+6*lda;
+    const double *bx = B, *by = B+ldb, *bz = B+2*ldb, *bw = B+3*ldb;
+    const double *bvx = B+4*ldb, *bvy = B+5*ldb, *bvz = B+6*ldb;
+    double *cx = C, *cy = C+ldc, *cz = C+2*ldc, *cw = C+3*ldc;
+    double *cvx = C+4*ldc, *cvy = C+5*ldc, *cvz = C+6*ldc;
+
+    for( size_t j = 0; j < n; j ++ ) {
+        /* translation: a.v + a.q * b.v * conj(a.q) */
+        double tx = 2 * (ay[j]*bvz[j] - az[j]*bvy[j]);
+        double ty = 2 * (az[j]*bvx[j] - ax[j]*bvz[j]);
+        double tz = 2 * (ax[j]*bvy[j] - ay[j]*bvx[j]);
+        double vx = bvx[j] + aw[j]*tx + (ay[j]*tz - az[j]*ty) + avx[j];
+        double vy = bvy[j] + aw[j]*ty + (az[j]*tx - ax[j]*tz) + avy[j];
+        double vz = bvz[j] + aw[j]*tz + (ax[j]*ty - ay[j]*tx) + avz[j];
+        /* rotation: a.q * b.q */
+        double qx = aw[j]*bx[j] + ax[j]*bw[j] + ay[j]*bz[j] - az[j]*by[j];
+        double qy = aw[j]*by[j] - ax[j]*bz[j] + ay[j]*bw[j] + az[j]*bx[j];
+        double qz = aw[j]*bz[j] + ax[j]*by[j] - ay[j]*bx[j] + az[j]*bw[j];
+        double qw = aw[j]*bw[j] - ax[j]*bx[j] - ay[j]*by[j] - az[j]*bz[j];
+        cx[j] = qx; cy[j] = qy; cz[j] = qz; cw[j] = qw;
+        cvx[j] = vx; cvy[j] = vy; cvz[j] = vz;
+    }
+}
+
+/*
+ * Structure-of-arrays product C = A*E, where E is a single (fixed)
+ * transform.
+ */
+static void
+s_qutr_mul_soa_c( size_t n,
+                  const double *A, const double E[7], double *C, size_t ld )
+{
+    const double *ax = A, *ay = A+ld, *az = A+2*ld, *aw = A+3*ld;
+    const double *avx = A+4*ld, *avy = A+5*ld, *avz = A+6*ld;
+    double *cx = C, *cy = C+ld, *cz = C+2*ld, *cw = C+3*ld;
+    double *cvx = C+4*ld, *cvy = C+5*ld, *cvz = C+6*ld;
+    const double bx = E[0], by = E[1], bz = E[2], bw = E[3];
+    const double bvx = E[4], bvy = E[5], bvz = E[6];
+
+    for( size_t j = 0; j < n; j ++ ) {
+        double tx = 2 * (ay[j]*bvz - az[j]*bvy);
+        double ty = 2 * (az[j]*bvx - ax[j]*bvz);
+        double tz = 2 * (ax[j]*bvy - ay[j]*bvx);
+        double vx = bvx + aw[j]*tx + (ay[j]*tz - az[j]*ty) + avx[j];
+        double vy = bvy + aw[j]*ty + (az[j]*tx - ax[j]*tz) + avy[j];
+        double vz = bvz + aw[j]*tz + (ax[j]*ty - ay[j]*tx) + avz[j];
+        double qx = aw[j]*bx + ax[j]*bw + ay[j]*bz - az[j]*by;
+        double qy = aw[j]*by - ax[j]*bz + ay[j]*bw + az[j]*bx;
+        double qz = aw[j]*bz + ax[j]*by - ay[j]*bx + az[j]*bw;
+        double qw = aw[j]*bw - ax[j]*bx - ay[j]*by - az[j]*bz;
+        cx[j] = qx; cy[j] = qy; cz[j] = qz; cw[j] = qw;
+        cvx[j] = vx; cvy[j] = vy; cvz[j] = vz;
+    }
+}
+
+AA_API void
+aa_rx_fk_batch( const struct aa_rx_sg *scene_graph,
+                size_t n, const double *Q, size_t ldq,
+                double *TF, size_t ldtf )
+{
+    if( NULL == scene_graph || 0 == n ) return;
+
+    aa_rx_sg_ensure_clean_frames( scene_graph );
+    assert( ldtf >= n );
+
+    amino::SceneGraph *sg = scene_graph->sg;
+    struct aa_mem_region *reg = aa_mem_region_local_get();
+
+    /* relative transforms of a single frame, SoA with ld=n */
+    double *E_rel = AA_MEM_REGION_NEW_N(reg, double, AA_RX_TF_LEN*n);
+
+    for( size_t i_frame = 0; i_frame < sg->kin_prog.size(); i_frame++ ) {
+        const struct aa_rx_kin_op *op = &sg->kin_prog[i_frame];
+        double *E_abs = TF + AA_RX_TF_LEN*ldtf*i_frame;
+        const double *E_abs_parent =
+            (op->parent < 0) ? NULL : TF + AA_RX_TF_LEN*ldtf*(size_t)op->parent;
+
+        if( AA_RX_KIN_FIXED == op->code ) {
+            if( E_abs_parent ) {
+                s_qutr_mul_soa_c( n, E_abs_parent, op->E, E_abs, ldtf );
+            } else {
+                for( size_t k = 0; k < AA_RX_TF_LEN; k ++ ) {
+                    double *row = E_abs + k*ldtf;
+                    for( size_t j = 0; j < n; j ++ ) row[j] = op->E[k];
+                }
+            }
+            continue;
+        }
+
+        /* joint frames: relative TF per configuration */
+        for( size_t j = 0; j < n; j ++ ) {
+            double E[AA_RX_TF_LEN];
+            aa_rx_kin_op_rel( op, Q + j*ldq, E );
+            for( size_t k = 0; k < AA_RX_TF_LEN; k ++ ) E_rel[k*n + j] = E[k];
+        }
+
+        if( E_abs_parent ) {
+            s_qutr_mul_soa( n, E_abs_parent, ldtf, E_rel, n, E_abs, ldtf );
+        } else {
+            for( size_t k = 0; k < AA_RX_TF_LEN; k ++ ) {
+                AA_MEM_CPY( E_abs + k*ldtf, E_rel + k*n, n );
+            }
+        }
+    }
+
+    aa_mem_region_pop(reg, E_rel);
+}
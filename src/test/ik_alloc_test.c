@@ -0,0 +1,284 @@
+/* -*- mode: C; c-basic-offset: 4; -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2019, Colorado School of Mines
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ndantam@mines.edu>
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of copyright holder the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Check that prepared IK, FK, and Jacobian calls do not allocate.
+ *
+ * The allocator is interposed to count calls while armed.
+ */
+
+#include "config.h"
+#include "amino.h"
+#include "amino/test.h"
+#include "amino/rx/rxtype.h"
+#include "amino/rx/scenegraph.h"
+#include "amino/rx/scene_fk.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/scene_ik.h"
+
+#ifdef __GLIBC__
+
+#include <errno.h>
+#include <pthread.h>
+
+extern void *__libc_malloc( size_t size );
+extern void *__libc_calloc( size_t n, size_t size );
+extern void *__libc_realloc( void *ptr, size_t size );
+extern void *__libc_memalign( size_t alignment, size_t size );
+extern void __libc_free( void *ptr );
+
+static __thread volatile int s_armed = 0;
+static __thread volatile size_t s_count = 0;
+
+static void s_note( void )
+{
+    if( s_armed ) s_count++;
+}
+
+void *malloc( size_t size )
+{
+    s_note();
+    return __libc_malloc(size);
+}
+
+void *calloc( size_t n, size_t size )
+{
+    s_note();
+    return __libc_calloc(n, size);
+}
+
+void *realloc( void *ptr, size_t size )
+{
+    s_note();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign( size_t alignment, size_t size )
+{
+    s_note();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc( size_t alignment, size_t size )
+{
+    s_note();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign( void **ptr, size_t alignment, size_t size )
+{
+    s_note();
+    void *p = __libc_memalign(alignment, size);
+    if( NULL == p ) return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+
+void free( void *ptr )
+{
+    __libc_free(ptr);
+}
+
+static void arm( void )
+{
+    s_count = 0;
+    s_armed = 1;
+}
+
+/* Disarm and test that nothing allocated while armed */
+static void disarm( const char *name )
+{
+    s_armed = 0;
+    size_t n = s_count;
+    if( n ) fprintf( stderr, "%s: %lu allocations\n", name, (unsigned long)n );
+    test( name, 0 == n );
+}
+
+struct path {
+    struct aa_rx_sg *sg;
+    struct aa_rx_sg_sub *ssg;
+    struct aa_rx_ik_parm *parm;
+    struct aa_rx_ik_cx *cx;
+    size_t n;
+    double *TF;
+    double *Q;
+};
+
+/* Hot-path calls, run on a fresh thread like a control loop */
+static void *s_control( void *arg )
+{
+    struct path *p = (struct path*)arg;
+    struct aa_rx_sg_sub *ssg = p->ssg;
+    struct aa_rx_ik_cx *cx = p->cx;
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    size_t n_all = aa_rx_sg_config_count(p->sg);
+    size_t n = p->n;
+    struct aa_dvec vq0 = AA_DVEC_INIT(n_q, p->Q, 1);
+
+    /* the counter sees allocations */
+    {
+        void *volatile ptr;
+        arm();
+        ptr = malloc(16);
+        s_armed = 0;
+        free(ptr);
+        test( "alloc count", 1 == s_count );
+    }
+
+    /* forward kinematics and Jacobians into caller storage */
+    {
+        struct aa_rx_fk *fk = aa_rx_fk_malloc(p->sg);
+        double q_all[n_all], J[6*n_q];
+        struct aa_dvec vq_all = AA_DVEC_INIT(n_all, q_all, 1);
+        struct aa_dmat mJ = AA_DMAT_INIT(6, n_q, J, 6);
+        AA_MEM_ZERO( q_all, n_all );
+        arm();
+        for( size_t i = 0; i < n; i ++ ) {
+            struct aa_dvec vq = AA_DVEC_INIT(n_q, p->Q + n_q*i, 1);
+            aa_rx_fk_sub( fk, ssg, &vq );
+            aa_rx_sg_sub_jac_vel_fill( ssg, fk, &mJ );
+            aa_rx_fk_all( fk, &vq_all );
+        }
+        disarm( "fk alloc" );
+        aa_rx_fk_destroy(fk);
+    }
+
+    /* Jacobian pseudo-inverse and Levenberg-Marquardt solves */
+    enum aa_rx_ik_algo algos[2] = {AA_RX_IK_JPINV, AA_RX_IK_LMA};
+    const char *names[2] = {"jpinv alloc", "lma alloc"};
+    for( size_t a = 0; a < 2; a ++ ) {
+        aa_rx_ik_parm_set_algo( p->parm, algos[a] );
+        aa_rx_ik_set_seed( cx, &vq0 );
+        test( "ik prepare", 0 == aa_rx_ik_prepare( cx ) );
+        int r = 0;
+        arm();
+        for( size_t i = 0; i < n; i ++ ) {
+            struct aa_dmat TF_i = AA_DMAT_INIT(7, 1, p->TF + 7*i, 7);
+            double q[n_q];
+            struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+            r |= aa_rx_ik_solve( cx, &TF_i, &vq );
+            r |= aa_rx_ik_check( cx, &TF_i, &vq );
+            aa_rx_ik_set_seed( cx, &vq );
+        }
+        disarm( names[a] );
+        test( "ik solve", 0 == r );
+    }
+
+    /* Real-time steps */
+    {
+        aa_rx_ik_set_seed( cx, &vq0 );
+        struct aa_rx_ik_rt *rt = aa_rx_ik_rt_create( cx );
+        aa_rx_ik_rt_set_budget( rt, 100, 0 );
+        int r = 0;
+        arm();
+        for( size_t i = 0; i < n; i ++ ) {
+            struct aa_dmat TF_i = AA_DMAT_INIT(7, 1, p->TF + 7*i, 7);
+            double q[n_q];
+            struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+            r |= aa_rx_ik_rt_step( rt, &TF_i, &vq, NULL );
+        }
+        disarm( "rt alloc" );
+        test( "ik rt", 0 == r );
+        aa_rx_ik_rt_destroy( rt );
+    }
+
+    return NULL;
+}
+
+int main( void )
+{
+    aa_test_ulimit();
+    time_t seed = time(NULL);
+    srand((unsigned int)seed);
+
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    double q_ident[4] = AA_TF_QUAT_IDENT_INITIALIZER;
+    double v[3] = {0, 0, .3};
+    const double *axes[3] = {aa_tf_vec_z, aa_tf_vec_y, aa_tf_vec_x};
+    char parent[32] = "", name[32];
+    for( size_t i = 0; i < 6; i ++ ) {
+        snprintf(name, sizeof(name), "j%lu", (unsigned long)i);
+        aa_rx_sg_add_frame_revolute( sg, parent, name, q_ident, v, NULL, axes[i%3], 0 );
+        strcpy(parent, name);
+    }
+    aa_rx_sg_add_frame_fixed( sg, parent, "ee", q_ident, v );
+    aa_rx_sg_init(sg);
+
+    aa_rx_frame_id ee = aa_rx_sg_frame_id(sg, "ee");
+    struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, ee );
+    struct aa_rx_ik_parm *parm = aa_rx_ik_parm_create();
+    aa_rx_ik_parm_set_tol_dq( parm, 1e-3 );
+    struct aa_rx_ik_cx *cx = aa_rx_ik_cx_create( ssg, parm );
+
+    /* targets along a joint-space path */
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    const size_t n = 16;
+    double q0[n_q], dq[n_q], TF[7*n], Q[n_q*n];
+    aa_test_randv( -1, 1, n_q, q0 );
+    aa_test_randv( -.05, .05, n_q, dq );
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    for( size_t i = 0; i < n; i ++ ) {
+        double *q = Q + n_q*i;
+        for( size_t j = 0; j < n_q; j ++ ) q[j] = q0[j] + (double)i*dq[j];
+        struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+        aa_rx_fk_sub( fk, ssg, &vq );
+        aa_rx_fk_get_abs_qutr( fk, ee, TF + 7*i );
+    }
+    aa_rx_fk_destroy(fk);
+
+    struct path p = {sg, ssg, parm, cx, n, TF, Q};
+    pthread_t thread;
+    test( "thread create", 0 == pthread_create( &thread, NULL, s_control, &p ) );
+    test( "thread join", 0 == pthread_join( thread, NULL ) );
+
+    aa_rx_ik_cx_destroy(cx);
+    aa_rx_ik_parm_destroy(parm);
+    aa_rx_sg_sub_destroy(ssg);
+    aa_rx_sg_destroy(sg);
+
+    return 0;
+}
+
+#else /*__GLIBC__*/
+
+/* Interposing the allocator needs glibc */
+int main( void )
+{
+    return 77;
+}
+
+#endif /*__GLIBC__*/
@@ -0,0 +1,542 @@
+/* -*- mode: C; c-basic-offset: 4; -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2019, Colorado School of Mines
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ndantam@mines.edu>
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of copyright holder the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "config.h"
+#include "amino.h"
+#include "amino/rx/rxtype.h"
+#include "amino/rx/scenegraph.h"
+#include "amino/rx/scene_fk.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/scene_wk.h"
+#include "amino/rx/scene_ik.h"
+
+/*
+ * Compare batched forward kinematics against per-configuration
+ * forward kinematics on a serial chain.
+ */
+
+#ifdef HAVE_TESTSCENES
+AA_API struct aa_rx_sg * aa_rx_dl_sg__7dof(struct aa_rx_sg *sg, const char *root);
+#endif
+
+#define N_JOINTS 7
+#define N_CONFIGS 4096
+#define N_REP 16
+
+/* Humanoid-like tree: a two-joint torso with five six-joint limbs */
+#define N_LIMBS 5
+static void tree( struct aa_rx_sg *sg )
+{
+    static const double v_link[3] = {0, 0, .3};
+    double q_ident[4] = AA_TF_QUAT_IDENT_INITIALIZER;
+    const double *axes[3] = {aa_tf_vec_z, aa_tf_vec_y, aa_tf_vec_x};
+
+    aa_rx_sg_add_frame_revolute( sg, "", "torso0", q_ident, v_link,
+                                 NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "torso0", "torso1", q_ident, v_link,
+                                 NULL, aa_tf_vec_y, 0 );
+    char parent[32], name[32];
+    for( size_t k = 0; k < N_LIMBS; k ++ ) {
+        strcpy(parent, "torso1");
+        for( size_t i = 0; i < 6; i ++ ) {
+            snprintf(name, sizeof(name), "limb%lu_%lu", (unsigned long)k, (unsigned long)i);
+            aa_rx_sg_add_frame_revolute( sg, parent, name,
+                                         q_ident, v_link,
+                                         NULL, axes[(i+k)%3], 0 );
+            strcpy(parent, name);
+        }
+        snprintf(name, sizeof(name), "ee%lu", (unsigned long)k);
+        aa_rx_sg_add_frame_fixed( sg, parent, name, q_ident, v_link );
+    }
+}
+
+/* 6R arm with a spherical wrist */
+static void wrist6( struct aa_rx_sg *sg )
+{
+    double q_ident[4] = AA_TF_QUAT_IDENT_INITIALIZER;
+    static const double v0[3] = {0, 0, 0}, v1[3] = {0, 0, .4}, v2[3] = {.05, .1, .4};
+    static const double v3[3] = {.4, 0, .02}, v_ee[3] = {.1, 0, .05};
+    aa_rx_sg_add_frame_revolute( sg, "", "j0", q_ident, v0, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j0", "j1", q_ident, v1, NULL, aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j1", "j2", q_ident, v2, NULL, aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j2", "j3", q_ident, v3, NULL, aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j3", "j4", q_ident, v0, NULL, aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j4", "j5", q_ident, v0, NULL, aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "j5", "ee", q_ident, v_ee );
+}
+
+static void chain( struct aa_rx_sg *sg )
+{
+    static const double v_link[3] = {0, 0, .3};
+    static const double v_tool[3] = {0, 0, .1};
+    double q_ident[4] = AA_TF_QUAT_IDENT_INITIALIZER;
+    const double *axes[3] = {aa_tf_vec_z, aa_tf_vec_y, aa_tf_vec_x};
+
+    /* URDF-style: each joint is followed by link and visual frames */
+    char parent[32] = "", name[32];
+    for( size_t i = 0; i < N_JOINTS; i ++ ) {
+        snprintf(name, sizeof(name), "joint%lu", (unsigned long)i);
+        aa_rx_sg_add_frame_revolute( sg, parent, name,
+                                     q_ident, v_link,
+                                     NULL, axes[i%3], 0 );
+        strcpy(parent, name);
+        snprintf(name, sizeof(name), "link%lu", (unsigned long)i);
+        aa_rx_sg_add_frame_fixed( sg, parent, name, q_ident, v_tool );
+        strcpy(parent, name);
+        snprintf(name, sizeof(name), "visual%lu", (unsigned long)i);
+        aa_rx_sg_add_frame_fixed( sg, parent, name, q_ident, v_tool );
+        strcpy(parent, name);
+    }
+    aa_rx_sg_add_frame_fixed( sg, parent, "tool", q_ident, v_tool );
+}
+
+int main( int argc, char **argv )
+{
+    (void)argc; (void)argv;
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    chain(sg);
+    aa_rx_sg_init(sg);
+
+    size_t n_q = aa_rx_sg_config_count(sg);
+    size_t n_f = aa_rx_sg_frame_count(sg);
+
+    double *Q = AA_NEW_AR(double, n_q*N_CONFIGS);
+    double *TF = AA_NEW_AR(double, AA_RX_TF_LEN*n_f*N_CONFIGS);
+    for( size_t i = 0; i < n_q*N_CONFIGS; i ++ ) {
+        Q[i] = aa_frand_minmax(-M_PI, M_PI);
+    }
+
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+
+    aa_tick("fk_all, %d configs x %d: ", N_CONFIGS, N_REP);
+    for( size_t r = 0; r < N_REP; r ++ ) {
+        for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+            struct aa_dvec q = AA_DVEC_INIT(n_q, Q+j*n_q, 1);
+            aa_rx_fk_all(fk, &q);
+        }
+    }
+    aa_tock();
+
+    aa_rx_fk_set_collapsed(fk, 1);
+    aa_tick("fk_all collapsed, %d configs x %d: ", N_CONFIGS, N_REP);
+    for( size_t r = 0; r < N_REP; r ++ ) {
+        for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+            struct aa_dvec q = AA_DVEC_INIT(n_q, Q+j*n_q, 1);
+            aa_rx_fk_all(fk, &q);
+        }
+    }
+    aa_tock();
+    aa_rx_fk_set_collapsed(fk, 0);
+
+    aa_tick("fk_set_config, last joint, %d configs x %d: ", N_CONFIGS, N_REP);
+    for( size_t r = 0; r < N_REP; r ++ ) {
+        for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+            aa_rx_fk_set_config(fk, (aa_rx_config_id)(n_q-1), Q[j*n_q]);
+        }
+    }
+    aa_tock();
+
+    aa_tick("fk_batch, %d configs x %d: ", N_CONFIGS, N_REP);
+    for( size_t r = 0; r < N_REP; r ++ ) {
+        aa_rx_fk_batch(sg, N_CONFIGS, Q, n_q, TF, N_CONFIGS);
+    }
+    aa_tock();
+
+    /* Jacobians for the full chain */
+    {
+        struct aa_rx_sg_sub *ssg =
+            aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT,
+                                   aa_rx_sg_frame_id(sg, "tool") );
+        double J[6*n_q], E[AA_RX_TF_LEN];
+        struct aa_dmat mJ = AA_DMAT_INIT(6, n_q, J, 6);
+
+        aa_tick("fk_sub + jac_vel_fill, %d configs x %d: ", N_CONFIGS, N_REP);
+        for( size_t r = 0; r < N_REP; r ++ ) {
+            for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+                struct aa_dvec q = AA_DVEC_INIT(n_q, Q+j*n_q, 1);
+                aa_rx_fk_sub(fk, ssg, &q);
+                aa_rx_sg_sub_jac_vel_fill(ssg, fk, &mJ);
+            }
+        }
+        aa_tock();
+
+        aa_tick("fk_jac_vel, %d configs x %d: ", N_CONFIGS, N_REP);
+        for( size_t r = 0; r < N_REP; r ++ ) {
+            for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+                struct aa_dvec q = AA_DVEC_INIT(n_q, Q+j*n_q, 1);
+                aa_rx_sg_sub_fk_jac_vel(ssg, fk, &q, E, &mJ);
+            }
+        }
+        aa_tock();
+
+        double *Jb = AA_NEW_AR(double, 6*n_q*N_CONFIGS);
+        double *manip = AA_NEW_AR(double, N_CONFIGS);
+        double *s_min = AA_NEW_AR(double, N_CONFIGS);
+        aa_tick("jac_twist_batch + measures, %d configs x %d: ", N_CONFIGS, N_REP);
+        for( size_t r = 0; r < N_REP; r ++ ) {
+            aa_rx_sg_sub_jac_twist_batch(ssg, fk, N_CONFIGS, Q, n_q,
+                                         Jb, 6*n_q, manip, s_min);
+        }
+        aa_tock();
+
+        aa_tick("jac_twist_get + svd, %d configs x %d: ", N_CONFIGS, N_REP);
+        for( size_t r = 0; r < N_REP; r ++ ) {
+            for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+                struct aa_mem_region *reg = aa_mem_region_local_get();
+                struct aa_dvec q = AA_DVEC_INIT(n_q, Q+j*n_q, 1);
+                aa_rx_fk_sub(fk, ssg, &q);
+                struct aa_dmat *Jt = aa_rx_sg_sub_jac_twist_get(ssg, reg, fk);
+                double S[6];
+                aa_la_d_svd( 6, n_q, Jt->data, Jt->ld, NULL, 0, S, NULL, 0 );
+                aa_mem_region_pop(reg, Jt);
+            }
+        }
+        aa_tock();
+
+        /* Pose, then a 3-row secondary task, then posture */
+        {
+            struct aa_rx_wk_opts *wk = aa_rx_wk_opts_create();
+            size_t rows[2] = {6, 3};
+            struct aa_rx_wk_prio_cx *pcx = aa_rx_wk_prio_create(wk, n_q, 2, rows);
+            double Js[9*n_q], dx[9], dq[n_q], dq_r[n_q];
+            for( size_t i = 0; i < 9; i ++ ) dx[i] = aa_frand_minmax(-1, 1);
+            for( size_t i = 0; i < n_q; i ++ ) dq_r[i] = aa_frand_minmax(-1, 1);
+            for( size_t i = 0; i < 9*n_q; i ++ ) Js[i] = aa_frand_minmax(-1, 1);
+            struct aa_dmat mJs = AA_DMAT_INIT(9, n_q, Js, 9);
+            struct aa_dmat mJ6;
+            aa_dmat_view_block(&mJ6, &mJs, 0, 0, 6, n_q);
+            struct aa_dvec vdx = AA_DVEC_INIT(9, dx, 1);
+            struct aa_dvec vdx6 = AA_DVEC_INIT(6, dx, 1);
+            struct aa_dvec vdq = AA_DVEC_INIT(n_q, dq, 1);
+            struct aa_dvec vdq_r = AA_DVEC_INIT(n_q, dq_r, 1);
+
+            aa_tick("jac + jdx2dq np, %d configs: ", N_CONFIGS);
+            for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+                struct aa_dvec q = AA_DVEC_INIT(n_q, Q+j*n_q, 1);
+                aa_rx_fk_sub(fk, ssg, &q);
+                aa_rx_sg_sub_jac_vel_fill(ssg, fk, &mJ6);
+                aa_rx_wk_jdx2dq(wk, &mJ6, &vdx6, &vdq_r, &vdq);
+            }
+            aa_tock();
+
+            aa_tick("jac + jdx2dq_prio, 2 levels + posture, %d configs: ", N_CONFIGS);
+            for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+                struct aa_dvec q = AA_DVEC_INIT(n_q, Q+j*n_q, 1);
+                aa_rx_fk_sub(fk, ssg, &q);
+                aa_rx_sg_sub_jac_vel_fill(ssg, fk, &mJ6);
+                aa_rx_wk_jdx2dq_prio(pcx, &mJs, &vdx, &vdq_r, &vdq);
+            }
+            aa_tock();
+
+            aa_rx_wk_prio_destroy(pcx);
+            aa_rx_wk_opts_destroy(wk);
+        }
+
+        /* Batch IK along a joint-space path */
+        {
+            const size_t n_path = 1000;
+            aa_rx_frame_id tool = aa_rx_sg_frame_id(sg, "tool");
+            double *TFp = AA_NEW_AR(double, AA_RX_TF_LEN*n_path);
+            double *Qp = AA_NEW_AR(double, n_q*n_path);
+            for( size_t j = 0; j < n_path; j ++ ) {
+                double q[n_q];
+                for( size_t i = 0; i < n_q; i ++ ) {
+                    q[i] = .5*sin( 2*M_PI*(double)(j+i*n_path/n_q)/(double)n_path );
+                }
+                struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+                aa_rx_fk_sub(fk, ssg, &vq);
+                aa_rx_fk_get_abs_qutr(fk, tool, TFp + AA_RX_TF_LEN*j);
+                if( 0 == j ) AA_MEM_CPY(Qp, q, n_q);
+            }
+            struct aa_rx_ik_parm *parm = aa_rx_ik_parm_create();
+            aa_rx_ik_parm_set_algo( parm, AA_RX_IK_JPINV );
+            aa_rx_ik_parm_set_tol_dq( parm, 1e-3 );
+            struct aa_rx_ik_cx *cx = aa_rx_ik_cx_create( ssg, parm );
+            struct aa_dvec vq0 = AA_DVEC_INIT(n_q, Qp, 1);
+            aa_rx_ik_set_seed( cx, &vq0 );
+            struct aa_dmat mTF = AA_DMAT_INIT(AA_RX_TF_LEN, n_path, TFp, AA_RX_TF_LEN);
+            struct aa_dmat mQ = AA_DMAT_INIT(n_q, n_path, Qp, n_q);
+
+            const size_t threads[3] = {1, 1, 0};
+            const int warm[3] = {0, 1, 1};
+            for( size_t k = 0; k < 3; k ++ ) {
+                aa_rx_ik_set_threads( cx, threads[k] );
+                aa_rx_ik_set_warm_start( cx, warm[k] );
+                aa_tick("ik_solve_batch, %lu waypoints, threads %lu, warm %d: ",
+                        (unsigned long)n_path, (unsigned long)threads[k], warm[k]);
+                int r = aa_rx_ik_solve_batch( cx, n_path, &mTF, &mQ, NULL );
+                aa_tock();
+                if( r ) fprintf(stderr, "ik_solve_batch: some targets failed\n");
+            }
+
+            /* Same path with Levenberg-Marquardt */
+            aa_rx_ik_parm_set_algo( parm, AA_RX_IK_LMA );
+            aa_rx_ik_set_threads( cx, 1 );
+            for( int k = 0; k < 2; k ++ ) {
+                aa_rx_ik_set_warm_start( cx, k );
+                aa_tick("ik_solve_batch lma, %lu waypoints, warm %d: ",
+                        (unsigned long)n_path, k);
+                int r = aa_rx_ik_solve_batch( cx, n_path, &mTF, &mQ, NULL );
+                aa_tock();
+                if( r ) fprintf(stderr, "ik_solve_batch lma: some targets failed\n");
+            }
+
+            /* Real-time tracking of the path with a per-step budget */
+            {
+                struct aa_rx_ik_rt *rt = aa_rx_ik_rt_create( cx );
+                aa_rx_ik_rt_set_budget( rt, 100, 1e-4 );
+                double q[n_q], t_max = 0;
+                struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+                size_t n_fail = 0;
+                aa_tick("ik_rt_step, %lu waypoints, budget 100 us: ", (unsigned long)n_path);
+                for( size_t j = 0; j < n_path; j ++ ) {
+                    struct aa_dmat TF_j = AA_DMAT_INIT(AA_RX_TF_LEN, 1, TFp + AA_RX_TF_LEN*j,
+                                                       AA_RX_TF_LEN);
+                    struct timespec t0 = aa_tm_now();
+                    n_fail += (0 != aa_rx_ik_rt_step( rt, &TF_j, &vq, NULL ));
+                    t_max = AA_MAX( t_max, aa_tm_timespec2sec(aa_tm_sub(aa_tm_now(), t0)) );
+                }
+                aa_tock();
+                printf("ik_rt_step: max %f us, %lu unconverged\n",
+                       1e6*t_max, (unsigned long)n_fail);
+                aa_rx_ik_rt_destroy( rt );
+            }
+
+            /* Second pass over the path seeded from a solution cache */
+            {
+                struct aa_rx_ik_cache *cache = aa_rx_ik_cache_create( n_q, 1, n_path, .02 );
+                aa_rx_ik_set_cache( cx, cache );
+                aa_rx_ik_set_warm_start( cx, 0 );
+                aa_rx_ik_solve_batch( cx, n_path, &mTF, &mQ, NULL );
+                aa_tick("ik_solve_batch lma, %lu waypoints, cached: ", (unsigned long)n_path);
+                aa_rx_ik_solve_batch( cx, n_path, &mTF, &mQ, NULL );
+                aa_tock();
+                struct aa_rx_ik_cache_stats stats;
+                aa_rx_ik_cache_get_stats( cache, &stats );
+                printf("ik cache: %lu/%lu hits, %f ms saved\n",
+                       (unsigned long)stats.hits, (unsigned long)stats.lookups,
+                       1e3*stats.time_saved);
+                aa_rx_ik_set_cache( cx, NULL );
+                aa_rx_ik_cache_destroy( cache );
+            }
+
+#ifdef HAVE_NLOPT
+            /* SQP with analytic and finite-difference gradients */
+            {
+                const size_t n_sqp = 100;
+                aa_rx_ik_opt_fun *funs[2] = { aa_rx_ik_opt_err_qlnpv,
+                                              aa_rx_ik_opt_err_qlnpv_fd };
+                const char *names[2] = { "analytic", "finite difference" };
+                struct aa_dmat TF_s = AA_DMAT_INIT(AA_RX_TF_LEN, n_sqp, TFp, AA_RX_TF_LEN);
+                struct aa_dmat Q_s = AA_DMAT_INIT(n_q, n_sqp, Qp, n_q);
+                aa_rx_ik_parm_set_algo( parm, AA_RX_IK_SQP );
+                aa_rx_ik_set_warm_start( cx, 1 );
+                for( size_t k = 0; k < 2; k ++ ) {
+                    aa_rx_ik_parm_set_obj( parm, funs[k] );
+                    aa_tick("ik_solve_batch sqp, %lu waypoints, %s: ",
+                            (unsigned long)n_sqp, names[k]);
+                    int r = aa_rx_ik_solve_batch( cx, n_sqp, &TF_s, &Q_s, NULL );
+                    aa_tock();
+                    if( r ) fprintf(stderr, "ik_solve_batch sqp: some targets failed\n");
+                }
+            }
+#endif /*HAVE_NLOPT*/
+
+            aa_rx_ik_cx_destroy(cx);
+            aa_rx_ik_parm_destroy(parm);
+            free(TFp);
+            free(Qp);
+        }
+
+        free(Jb);
+        free(manip);
+        free(s_min);
+        aa_rx_sg_sub_destroy(ssg);
+    }
+
+    aa_rx_fk_destroy(fk);
+    free(Q);
+    free(TF);
+    aa_rx_sg_destroy(sg);
+
+    /* Stacked Jacobian and solve for a branching tree */
+    {
+        struct aa_rx_sg *sgt = aa_rx_sg_create();
+        tree(sgt);
+        aa_rx_sg_init(sgt);
+        aa_rx_frame_id tips[N_LIMBS];
+        for( size_t k = 0; k < N_LIMBS; k ++ ) {
+            char name[32];
+            snprintf(name, sizeof(name), "ee%lu", (unsigned long)k);
+            tips[k] = aa_rx_sg_frame_id(sgt, name);
+        }
+        struct aa_rx_sg_sub *ssg =
+            aa_rx_sg_multiple_chain_create( sgt, AA_RX_FRAME_ROOT, N_LIMBS, tips );
+        struct aa_rx_fk *fkt = aa_rx_fk_malloc(sgt);
+        struct aa_rx_wk_opts *wk = aa_rx_wk_opts_create();
+
+        size_t n_t = aa_rx_sg_sub_config_count(ssg);
+        size_t m = 6*N_LIMBS;
+        double *Qt = AA_NEW_AR(double, n_t*N_CONFIGS);
+        for( size_t i = 0; i < n_t*N_CONFIGS; i ++ ) {
+            Qt[i] = aa_frand_minmax(-M_PI, M_PI);
+        }
+        double *J = AA_NEW_AR(double, m*n_t);
+        double *Jp = AA_NEW_AR(double, aa_rx_sg_sub_ees_jac_packed_size(ssg));
+        double dx[m], dq[n_t];
+        for( size_t i = 0; i < m; i ++ ) dx[i] = aa_frand_minmax(-1, 1);
+        struct aa_dmat mJ = AA_DMAT_INIT(m, n_t, J, m);
+        struct aa_dvec vdx = AA_DVEC_INIT(m, dx, 1);
+        struct aa_dvec vdq = AA_DVEC_INIT(n_t, dq, 1);
+
+        aa_tick("tree fk_jac_vel_ees + jdx2dq, %d configs: ", N_CONFIGS);
+        for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+            struct aa_dvec q = AA_DVEC_INIT(n_t, Qt+j*n_t, 1);
+            aa_rx_sg_sub_fk_jac_vel_ees(ssg, fkt, &q, NULL, 0, &mJ);
+            aa_rx_wk_jdx2dq(wk, &mJ, &vdx, NULL, &vdq);
+        }
+        aa_tock();
+
+        aa_tick("tree fk_jac_vel_ees_packed + jdx2dq_ees, %d configs: ", N_CONFIGS);
+        for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+            struct aa_dvec q = AA_DVEC_INIT(n_t, Qt+j*n_t, 1);
+            aa_rx_sg_sub_fk_jac_vel_ees_packed(ssg, fkt, &q, NULL, 0, Jp);
+            aa_rx_wk_jdx2dq_ees(ssg, wk, Jp, &vdx, NULL, &vdq);
+        }
+        aa_tock();
+
+        free(Qt);
+        free(J);
+        free(Jp);
+        aa_rx_wk_opts_destroy(wk);
+        aa_rx_fk_destroy(fkt);
+        aa_rx_sg_sub_destroy(ssg);
+        aa_rx_sg_destroy(sgt);
+    }
+
+    /* Closed-form and numeric IK for a 6R arm with a spherical wrist */
+    {
+        struct aa_rx_sg *sgw = aa_rx_sg_create();
+        wrist6(sgw);
+        aa_rx_sg_init(sgw);
+        aa_rx_frame_id ee = aa_rx_sg_frame_id(sgw, "ee");
+        struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sgw, AA_RX_FRAME_ROOT, ee );
+        struct aa_rx_ik_parm *parm = aa_rx_ik_parm_create();
+        aa_rx_ik_parm_set_algo( parm, AA_RX_IK_LMA );
+        struct aa_rx_ik_cx *cx = aa_rx_ik_cx_create( ssg, parm );
+        struct aa_rx_fk *fkw = aa_rx_fk_malloc(sgw);
+
+        const size_t n_w = 6;
+        double *TFw = AA_NEW_AR(double, 7*N_CONFIGS);
+        double *Qw = AA_NEW_AR(double, n_w*N_CONFIGS);
+        for( size_t i = 0; i < n_w*N_CONFIGS; i ++ ) Qw[i] = aa_frand_minmax(-2, 2);
+        for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+            struct aa_dvec q = AA_DVEC_INIT(n_w, Qw+j*n_w, 1);
+            aa_rx_fk_sub(fkw, ssg, &q);
+            aa_rx_fk_get_abs_qutr(fkw, ee, TFw + 7*j);
+        }
+
+        double Qa[8*n_w], q[n_w];
+        struct aa_dmat mQa = AA_DMAT_INIT(n_w, 8, Qa, n_w);
+        struct aa_dvec vq = AA_DVEC_INIT(n_w, q, 1);
+        size_t n_sol = 0;
+        aa_tick("ik_solve_analytic %s, %d targets: ", aa_rx_ik_get_analytic(cx), N_CONFIGS);
+        for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+            struct aa_dmat TF = AA_DMAT_INIT(7, 1, TFw+7*j, 7);
+            n_sol += aa_rx_ik_solve_analytic( cx, &TF, &mQa );
+        }
+        aa_tock();
+        printf("%f branches per target\n", (double)n_sol / N_CONFIGS);
+
+        for( int k = 0; k < 2; k ++ ) {
+            aa_rx_ik_set_analytic( cx, !k );
+            size_t n_fail = 0;
+            aa_tick("ik_solve %s, %d targets: ", k ? "lma" : "analytic", N_CONFIGS);
+            for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+                struct aa_dmat TF = AA_DMAT_INIT(7, 1, TFw+7*j, 7);
+                n_fail += (0 != aa_rx_ik_solve( cx, &TF, &vq ));
+            }
+            aa_tock();
+            if( n_fail ) fprintf(stderr, "ik_solve: %lu targets failed\n", (unsigned long)n_fail);
+        }
+
+        free(TFw);
+        free(Qw);
+        aa_rx_fk_destroy(fkw);
+        aa_rx_ik_cx_destroy(cx);
+        aa_rx_ik_parm_destroy(parm);
+        aa_rx_sg_sub_destroy(ssg);
+        aa_rx_sg_destroy(sgw);
+    }
+
+#ifdef HAVE_TESTSCENES
+    /* The compiled 7-DOF demo robot */
+    {
+        struct aa_rx_sg *sgd = aa_rx_dl_sg__7dof(NULL, "");
+        aa_rx_sg_init(sgd);
+        size_t n_d = aa_rx_sg_config_count(sgd);
+        size_t n_fd = aa_rx_sg_frame_count(sgd);
+        double *Qd = AA_NEW_AR(double, n_d*N_CONFIGS);
+        double *TFd = AA_NEW_AR(double, AA_RX_TF_LEN*n_fd*N_CONFIGS);
+        for( size_t i = 0; i < n_d*N_CONFIGS; i ++ ) {
+            Qd[i] = aa_frand_minmax(-M_PI, M_PI);
+        }
+        struct aa_rx_fk *fkd = aa_rx_fk_malloc(sgd);
+
+        aa_tick("7dof fk_all, %d configs x %d: ", N_CONFIGS, N_REP);
+        for( size_t r = 0; r < N_REP; r ++ ) {
+            for( size_t j = 0; j < N_CONFIGS; j ++ ) {
+                struct aa_dvec q = AA_DVEC_INIT(n_d, Qd+j*n_d, 1);
+                aa_rx_fk_all(fkd, &q);
+            }
+        }
+        aa_tock();
+
+        aa_tick("7dof fk_batch, %d configs x %d: ", N_CONFIGS, N_REP);
+        for( size_t r = 0; r < N_REP; r ++ ) {
+            aa_rx_fk_batch(sgd, N_CONFIGS, Qd, n_d, TFd, N_CONFIGS);
+        }
+        aa_tock();
+
+        aa_rx_fk_destroy(fkd);
+        free(Qd);
+        free(TFd);
+        aa_rx_sg_destroy(sgd);
+    }
+#endif /*HAVE_TESTSCENES*/
+
+    return 0;
+}
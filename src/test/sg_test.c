@@ -40,11 +40,18 @@
  *
  */
 
+#include "config.h"
 #include "amino.h"
 #include "amino/test.h"
 #include "amino/rx/rxtype.h"
 #include "amino/rx/scenegraph.h"
 #include "amino/rx/scenegraph_internal.h"
+#include "amino/rx/scene_fk.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/scene_ik.h"
+#include "amino/rx/rxerr.h"
+#include "amino/rx/scene_wk.h"
+#include "amino/rx/scene_ik_internal.h"
 #include <assert.h>
 
 
@@ -52,6 +59,18 @@
 static void scara( struct aa_rx_sg *sg );
 static void check_scara( struct aa_rx_sg *sg );
 static void check_tf( struct aa_rx_sg *sg );
+static void check_fk_batch( struct aa_rx_sg *sg );
+static void check_kin_prog( void );
+static void check_fk_incremental( struct aa_rx_sg *sg );
+static void check_fk_collapsed( void );
+static void check_fk_sub( void );
+static void check_jac_batch( size_t n_joints );
+static void check_fk_jac_ees( void );
+static void check_wk_prio( void );
+static void check_ik_batch( void );
+static void check_ik_analytic( void );
+static void check_ik_grad( void );
+static void check_ik_ineqct( void );
 
 int main(void)
 {
@@ -62,7 +81,28 @@ int main(void)
     check_scara(sg);
     check_tf(sg);
 
-
+    /* Add some fixed frames for the batch checks */
+    {
+        double q_ident[4] = AA_TF_QUAT_IDENT_INITIALIZER;
+        double v_tool[3] = {0, 0, .1};
+        double v_base[3] = {1, 2, 3};
+        aa_rx_sg_add_frame_fixed( sg, "q3", "tool", q_ident, v_tool );
+        aa_rx_sg_add_frame_fixed( sg, "", "base", q_ident, v_base );
+        aa_rx_sg_init(sg);
+    }
+    check_fk_batch(sg);
+    check_fk_incremental(sg);
+    check_kin_prog();
+    check_fk_collapsed();
+    check_fk_sub();
+    check_jac_batch(3);
+    check_jac_batch(7);
+    check_fk_jac_ees();
+    check_wk_prio();
+    check_ik_batch();
+    check_ik_analytic();
+    check_ik_grad();
+    check_ik_ineqct();
 
     aa_rx_sg_destroy(sg);
 
@@ -198,3 +238,1139 @@ static void check_tf( struct aa_rx_sg *sg )
         aveq( "chain 0", 7*4, E_ref, TF_abs, 1e-6 );
     }
 }
+
+static void check_fk_batch( struct aa_rx_sg *sg )
+{
+    size_t frame_cnt =  aa_rx_sg_frame_count(sg);
+    size_t config_cnt =  aa_rx_sg_config_count(sg);
+    const size_t n = 13, ldtf = 16;
+
+    double Q[config_cnt*n];
+    double TF[AA_RX_TF_LEN*frame_cnt*ldtf];
+    aa_test_randv( -M_PI, M_PI, config_cnt*n, Q );
+
+    aa_rx_fk_batch( sg, n, Q, config_cnt, TF, ldtf );
+
+    for( size_t j = 0; j < n; j ++ ) {
+        double TF_rel[7*frame_cnt];
+        double TF_abs[7*frame_cnt];
+        aa_rx_sg_tf( sg, config_cnt, Q + j*config_cnt,
+                     frame_cnt, TF_rel, 7, TF_abs, 7 );
+        for( size_t i = 0; i < frame_cnt; i ++ ) {
+            double E[AA_RX_TF_LEN];
+            for( size_t k = 0; k < AA_RX_TF_LEN; k ++ ) {
+                E[k] = TF[(AA_RX_TF_LEN*i + k)*ldtf + j];
+            }
+            aveq( "fk batch", AA_RX_TF_LEN, TF_abs + 7*i, E, 1e-9 );
+        }
+    }
+}
+
+/* Reference relative transform for a joint */
+static void joint_rel( enum aa_rx_frame_type type, const double E[7],
+                       const double axis[3], double q, double E_rel[7] )
+{
+    if( AA_RX_FRAME_REVOLUTE == type ) {
+        double h[4];
+        aa_tf_axang2quat2( axis, q, h );
+        aa_tf_qmul( E, h, E_rel );
+        AA_MEM_CPY( E_rel+4, E+4, 3 );
+    } else {
+        double x[3] = {q*axis[0], q*axis[1], q*axis[2]};
+        aa_tf_qv_chain( E, E+4, aa_tf_quat_ident, x, E_rel, E_rel+4 );
+    }
+}
+
+static void check_kin_prog( void )
+{
+    /* Exercise each specialized instruction */
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    double a[3] = {1, 2, 3};
+    aa_tf_vnormalize(a);
+    const double ny[3] = {0, -1, 0};
+    const double *axes[] = {aa_tf_vec_x, ny, aa_tf_vec_z, a, a};
+    enum aa_rx_frame_type types[] = {AA_RX_FRAME_REVOLUTE,
+                                     AA_RX_FRAME_REVOLUTE,
+                                     AA_RX_FRAME_REVOLUTE,
+                                     AA_RX_FRAME_REVOLUTE,
+                                     AA_RX_FRAME_PRISMATIC};
+    const char *names[] = {"a", "b", "c", "d", "e"};
+    const size_t n = sizeof(names)/sizeof(names[0]);
+    double E[n][7];
+
+    const char *parent = "";
+    for( size_t i = 0; i < n; i ++ ) {
+        aa_test_randv( -1, 1, 7, E[i] );
+        aa_tf_qnormalize( E[i] );
+        if( AA_RX_FRAME_REVOLUTE == types[i] ) {
+            aa_rx_sg_add_frame_revolute( sg, parent, names[i], E[i], E[i]+4,
+                                         NULL, axes[i], 0 );
+        } else {
+            aa_rx_sg_add_frame_prismatic( sg, parent, names[i], E[i], E[i]+4,
+                                          NULL, axes[i], 0 );
+        }
+        parent = names[i];
+    }
+    aa_rx_sg_init(sg);
+
+    double q[n];
+    aa_test_randv( -M_PI, M_PI, n, q );
+    struct aa_dvec vq = AA_DVEC_INIT(n, q, 1);
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    aa_rx_fk_all(fk, &vq);
+
+    double E_abs[7] = AA_TF_QUTR_IDENT_INITIALIZER;
+    for( size_t i = 0; i < n; i ++ ) {
+        aa_rx_frame_id fid = aa_rx_sg_frame_id(sg, names[i]);
+        aa_rx_config_id cid = aa_rx_sg_config_id(sg, names[i]);
+        double E_rel[7], E_tmp[7];
+        joint_rel( types[i], E[i], axes[i], q[cid], E_rel );
+        aa_tf_qutr_mul( E_abs, E_rel, E_tmp );
+        AA_MEM_CPY( E_abs, E_tmp, 7 );
+        aveq( "kin prog", 7, E_abs, aa_rx_fk_ref(fk, fid), 1e-9 );
+    }
+
+    aa_rx_fk_destroy(fk);
+    aa_rx_sg_destroy(sg);
+}
+
+static void check_fk_tf( struct aa_rx_sg *sg, const char *name,
+                         struct aa_rx_fk *fk, const double *q )
+{
+    size_t frame_cnt =  aa_rx_sg_frame_count(sg);
+    size_t config_cnt =  aa_rx_sg_config_count(sg);
+    double TF_rel[7*frame_cnt];
+    double TF_abs[7*frame_cnt];
+    aa_rx_sg_tf( sg, config_cnt, q, frame_cnt, TF_rel, 7, TF_abs, 7 );
+    aveq( name, 7*frame_cnt, TF_abs, aa_rx_fk_data(fk), 1e-9 );
+}
+
+static void check_fk_incremental( struct aa_rx_sg *sg )
+{
+    size_t config_cnt =  aa_rx_sg_config_count(sg);
+    double q[config_cnt];
+    struct aa_dvec vq = AA_DVEC_INIT(config_cnt, q, 1);
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+
+    /* set_config before any full update */
+    AA_MEM_ZERO(q, config_cnt);
+    q[1] = .5;
+    aa_rx_fk_set_config(fk, 1, q[1]);
+    check_fk_tf( sg, "fk set_config initial", fk, q );
+
+    for( size_t i = 0; i < 32; i ++ ) {
+        /* full update */
+        aa_test_randv( -M_PI, M_PI, config_cnt, q );
+        aa_rx_fk_all(fk, &vq);
+        check_fk_tf( sg, "fk all", fk, q );
+
+        /* change one joint */
+        size_t j = (size_t)rand() % config_cnt;
+        q[j] = aa_frand_minmax(-M_PI, M_PI);
+        aa_rx_fk_all(fk, &vq);
+        check_fk_tf( sg, "fk all incremental", fk, q );
+
+        /* set one joint */
+        j = (size_t)rand() % config_cnt;
+        q[j] = aa_frand_minmax(-M_PI, M_PI);
+        aa_rx_fk_set_config(fk, (aa_rx_config_id)j, q[j]);
+        check_fk_tf( sg, "fk set_config", fk, q );
+    }
+
+    aa_rx_fk_destroy(fk);
+}
+
+static void check_fk_collapsed( void )
+{
+    /* Runs of fixed frames between joints */
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    const char *names[] = {"f0", "f1", "j0", "f2", "f3", "j1", "f4", "f5"};
+    const char types[] = "ffrffpff";
+    const size_t n = sizeof(names)/sizeof(names[0]);
+    const char *parent = "";
+    for( size_t i = 0; i < n; i ++ ) {
+        double E[7];
+        aa_test_randv( -1, 1, 7, E );
+        aa_tf_qnormalize( E );
+        switch( types[i] ) {
+        case 'f':
+            aa_rx_sg_add_frame_fixed( sg, parent, names[i], E, E+4 );
+            break;
+        case 'r':
+            aa_rx_sg_add_frame_revolute( sg, parent, names[i], E, E+4,
+                                         NULL, aa_tf_vec_y, 0 );
+            break;
+        case 'p':
+            aa_rx_sg_add_frame_prismatic( sg, parent, names[i], E, E+4,
+                                          NULL, aa_tf_vec_x, 0 );
+            break;
+        }
+        parent = names[i];
+    }
+    /* A branch off the middle of a fixed run */
+    aa_rx_sg_add_frame_fixed( sg, "f2", "b0", aa_tf_quat_ident, aa_tf_vec_z );
+    aa_rx_sg_init(sg);
+
+    size_t frame_cnt =  aa_rx_sg_frame_count(sg);
+    size_t config_cnt =  aa_rx_sg_config_count(sg);
+    double q[config_cnt];
+    struct aa_dvec vq = AA_DVEC_INIT(config_cnt, q, 1);
+    double TF_rel[7*frame_cnt];
+    double TF_abs[7*frame_cnt];
+
+    aa_rx_frame_id f3 = aa_rx_sg_frame_id(sg, "f3");
+    aa_rx_frame_id f5 = aa_rx_sg_frame_id(sg, "f5");
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    struct aa_rx_fk *fk_m = aa_rx_fk_malloc(sg);
+    aa_rx_fk_set_collapsed(fk, 1);
+    aa_rx_fk_materialize(fk, f3);
+
+    /* materializing before collapsing also persists, re-collapsed */
+    aa_rx_fk_materialize(fk_m, f5);
+    aa_rx_fk_set_collapsed(fk_m, 1);
+    aa_rx_fk_set_collapsed(fk_m, 1);
+
+    for( size_t k = 0; k < 16; k ++ ) {
+        aa_test_randv( -M_PI, M_PI, config_cnt, q );
+        if( k % 2 ) {
+            aa_rx_fk_all(fk, &vq);
+        } else {
+            aa_rx_fk_set_config(fk, (aa_rx_config_id)(k/2 % config_cnt),
+                                q[k/2 % config_cnt]);
+            AA_MEM_CPY(q, fk->q, config_cnt);
+        }
+        aa_rx_fk_all(fk_m, &vq);
+        aa_rx_sg_tf( sg, config_cnt, q, frame_cnt, TF_rel, 7, TF_abs, 7 );
+
+        /* materialized frames are current without deriving */
+        aveq( "fk collapsed materialized", 7,
+              TF_abs + 7*f3, aa_rx_fk_ref(fk, f3), 1e-9 );
+        aveq( "fk collapsed materialized first", 7,
+              TF_abs + 7*f5, aa_rx_fk_ref(fk_m, f5), 1e-9 );
+
+        for( size_t i = 0; i < frame_cnt; i ++ ) {
+            double E[7];
+            aa_rx_fk_derive(fk, (aa_rx_frame_id)i);
+            aa_rx_fk_get_abs_qutr(fk, (aa_rx_frame_id)i, E);
+            aveq( "fk collapsed", 7, TF_abs + 7*i, E, 1e-9 );
+        }
+    }
+    aa_rx_fk_destroy(fk_m);
+
+    /* leave collapsed mode */
+    aa_rx_fk_all(fk, &vq);
+    aa_rx_fk_set_collapsed(fk, 0);
+    aveq( "fk uncollapsed", 7*frame_cnt, TF_abs, aa_rx_fk_data(fk), 1e-9 );
+
+    aa_rx_fk_destroy(fk);
+    aa_rx_sg_destroy(sg);
+}
+
+/* Compare the one-pass kernels against FK followed by the Jacobian fill */
+static void check_fk_jac( const struct aa_rx_sg_sub *ssg,
+                          const struct aa_rx_fk *fk0,
+                          const struct aa_dvec *q_sub )
+{
+    const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    double J0[6*n_q], J1[6*n_q], E[7];
+    struct aa_dmat mJ0 = AA_DMAT_INIT(6, n_q, J0, 6);
+    struct aa_dmat mJ1 = AA_DMAT_INIT(6, n_q, J1, 6);
+
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    aa_rx_fk_cpy(fk, fk0);
+    aa_rx_fk_sub(fk, ssg, q_sub);
+    const double *E_ee = aa_rx_fk_ref(fk, aa_rx_sg_sub_fk_jac_frame(ssg));
+
+    aa_rx_sg_sub_jac_twist_fill(ssg, fk, &mJ0);
+    aa_rx_sg_sub_fk_jac_twist(ssg, fk0, q_sub, E, &mJ1);
+    aveq( "fk jac twist E", 7, E_ee, E, 1e-9 );
+    aveq( "fk jac twist J", 6*n_q, J0, J1, 1e-9 );
+
+    aa_rx_sg_sub_jac_vel_fill(ssg, fk, &mJ0);
+    aa_rx_sg_sub_fk_jac_vel(ssg, fk0, q_sub, E, &mJ1);
+    aveq( "fk jac vel E", 7, E_ee, E, 1e-9 );
+    aveq( "fk jac vel J", 6*n_q, J0, J1, 1e-9 );
+
+    aa_rx_fk_destroy(fk);
+}
+
+static void check_fk_sub( void )
+{
+    /* Chain with a gripper below the tip and an unrelated branch */
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    double q_ident[4] = AA_TF_QUAT_IDENT_INITIALIZER;
+    double v[3] = {.1, .2, .3};
+    aa_rx_sg_add_frame_revolute( sg, "", "a0", q_ident, v, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "", "o0", q_ident, v, NULL, aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "a0", "l0", q_ident, v );
+    aa_rx_sg_add_frame_revolute( sg, "l0", "a1", q_ident, v, NULL, aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "o0", "o1", q_ident, v );
+    aa_rx_sg_add_frame_fixed( sg, "a1", "tip", q_ident, v );
+    aa_rx_sg_add_frame_prismatic( sg, "tip", "g0", q_ident, v, NULL, aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "g0", "g1", q_ident, v );
+    aa_rx_sg_init(sg);
+
+    size_t frame_cnt =  aa_rx_sg_frame_count(sg);
+    size_t config_cnt =  aa_rx_sg_config_count(sg);
+    struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT,
+                                                      aa_rx_sg_frame_id(sg, "tip") );
+    size_t n_sub = aa_rx_sg_sub_config_count(ssg);
+    aa_rx_config_id *configs = aa_rx_sg_sub_configs(ssg);
+
+    /* Expected moved set: chain joints and their descendants */
+    int moved[frame_cnt];
+    for( aa_rx_frame_id i = 0; i < (aa_rx_frame_id)frame_cnt; i ++ ) {
+        aa_rx_frame_id p = aa_rx_sg_frame_parent(sg, i);
+        aa_rx_config_id c = aa_rx_sg_frame_config(sg, i);
+        moved[i] = (p >= 0 && moved[p]);
+        for( size_t j = 0; j < n_sub; j ++ ) {
+            if( c == configs[j] ) moved[i] = 1;
+        }
+    }
+    {
+        int have[frame_cnt];
+        AA_MEM_ZERO(have, frame_cnt);
+        const size_t *r = aa_rx_sg_sub_moved(ssg);
+        for( size_t k = 0; k < aa_rx_sg_sub_moved_count(ssg); k ++ ) {
+            test( "moved range order", r[2*k] < r[2*k+1] &&
+                  (0 == k || r[2*k-1] < r[2*k]) );
+            for( size_t i = r[2*k]; i < r[2*k+1]; i ++ ) have[i] = 1;
+        }
+        for( size_t i = 0; i < frame_cnt; i ++ ) {
+            test( "moved set", have[i] == moved[i] );
+        }
+        test( "gripper moved", have[aa_rx_sg_frame_id(sg, "g1")] );
+        test( "branch fixed", !have[aa_rx_sg_frame_id(sg, "o1")] );
+    }
+
+    double q[config_cnt];
+    double q_sub[n_sub];
+    double TF_rel[7*frame_cnt];
+    double TF_abs[7*frame_cnt];
+    struct aa_dvec vq = AA_DVEC_INIT(config_cnt, q, 1);
+    struct aa_dvec vq_sub = AA_DVEC_INIT(n_sub, q_sub, 1);
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+
+    aa_test_randv( -M_PI, M_PI, config_cnt, q );
+    aa_rx_fk_all(fk, &vq);
+    for( size_t k = 0; k < 16; k ++ ) {
+        aa_test_randv( -M_PI, M_PI, n_sub, q_sub );
+        aa_rx_fk_sub(fk, ssg, &vq_sub);
+        aa_rx_sg_sub_config_set( ssg, n_sub, q_sub, config_cnt, q );
+        aa_rx_sg_tf( sg, config_cnt, q, frame_cnt, TF_rel, 7, TF_abs, 7 );
+        aveq( "fk sub", 7*frame_cnt, TF_abs, aa_rx_fk_data(fk), 1e-9 );
+        check_fk_jac( ssg, fk, &vq_sub );
+    }
+
+    /* Chain rooted below a joint, ending past a prismatic joint */
+    {
+        struct aa_rx_sg_sub *ssg_g =
+            aa_rx_sg_chain_create( sg, aa_rx_sg_frame_id(sg, "l0"),
+                                   aa_rx_sg_frame_id(sg, "g1") );
+        size_t n_g = aa_rx_sg_sub_config_count(ssg_g);
+        double q_g[n_g];
+        struct aa_dvec vq_g = AA_DVEC_INIT(n_g, q_g, 1);
+        for( size_t k = 0; k < 16; k ++ ) {
+            aa_test_randv( -M_PI, M_PI, n_g, q_g );
+            check_fk_jac( ssg_g, fk, &vq_g );
+        }
+        aa_rx_sg_sub_destroy(ssg_g);
+    }
+
+    aa_rx_fk_destroy(fk);
+    aa_rx_sg_sub_destroy(ssg);
+    aa_rx_sg_destroy(sg);
+}
+
+/* Compare J_dot and the Hessian against central differences of J */
+static void check_jac_dot( const struct aa_rx_sg_sub *ssg,
+                           const struct aa_rx_fk *fk,
+                           const struct aa_dvec *q, int vel )
+{
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    double H[6*n_q*n_q], H_fd[6*n_q*n_q];
+    double Jd[6*n_q], Jd_fd[6*n_q], J0[6*n_q], J1[6*n_q], dq[n_q];
+    struct aa_dmat mJ0 = AA_DMAT_INIT(6, n_q, J0, 6);
+    struct aa_dmat mJ1 = AA_DMAT_INIT(6, n_q, J1, 6);
+    struct aa_dmat mJd = AA_DMAT_INIT(6, n_q, Jd, 6);
+    struct aa_dvec vdq = AA_DVEC_INIT(n_q, dq, 1);
+    const double h = 1e-6;
+
+    for( size_t i = 0; i < n_q; i ++ ) {
+        double qh[n_q];
+        struct aa_dvec vqh = AA_DVEC_INIT(n_q, qh, 1);
+        AA_MEM_CPY(qh, q->data, n_q);
+        qh[i] += h;
+        if( vel ) aa_rx_sg_sub_fk_jac_vel( ssg, fk, &vqh, NULL, &mJ1 );
+        else aa_rx_sg_sub_fk_jac_twist( ssg, fk, &vqh, NULL, &mJ1 );
+        qh[i] -= 2*h;
+        if( vel ) aa_rx_sg_sub_fk_jac_vel( ssg, fk, &vqh, NULL, &mJ0 );
+        else aa_rx_sg_sub_fk_jac_twist( ssg, fk, &vqh, NULL, &mJ0 );
+        for( size_t k = 0; k < 6*n_q; k ++ ) {
+            H_fd[6*n_q*i + k] = (J1[k] - J0[k]) / (2*h);
+        }
+    }
+    if( vel ) aa_rx_sg_sub_jac_vel_hess( ssg, fk, q, H );
+    else aa_rx_sg_sub_jac_twist_hess( ssg, fk, q, H );
+    aveq( vel ? "jac vel hess" : "jac twist hess", 6*n_q*n_q, H_fd, H, 1e-6 );
+
+    aa_test_randv( -1, 1, n_q, dq );
+    AA_MEM_ZERO(Jd_fd, 6*n_q);
+    for( size_t i = 0; i < n_q; i ++ ) {
+        for( size_t k = 0; k < 6*n_q; k ++ ) Jd_fd[k] += H_fd[6*n_q*i + k] * dq[i];
+    }
+    if( vel ) aa_rx_sg_sub_jac_vel_dot( ssg, fk, q, &vdq, &mJ1, &mJd );
+    else aa_rx_sg_sub_jac_twist_dot( ssg, fk, q, &vdq, &mJ1, &mJd );
+    aveq( vel ? "jac vel dot" : "jac twist dot", 6*n_q, Jd_fd, Jd, 1e-6 );
+
+    if( vel ) aa_rx_sg_sub_fk_jac_vel( ssg, fk, q, NULL, &mJ0 );
+    else aa_rx_sg_sub_fk_jac_twist( ssg, fk, q, NULL, &mJ0 );
+    aveq( "jac dot J", 6*n_q, J0, J1, 1e-9 );
+}
+
+static void check_jac_batch( size_t n_joints )
+{
+    /* Random serial chain */
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    char parent[32] = "", name[32];
+    for( size_t i = 0; i < n_joints; i ++ ) {
+        double E[7], axis[3];
+        aa_test_randv( -1, 1, 7, E );
+        aa_tf_qnormalize( E );
+        aa_test_randv( -1, 1, 3, axis );
+        aa_tf_vnormalize( axis );
+        snprintf(name, sizeof(name), "j%lu", (unsigned long)i);
+        if( i % 4 == 3 ) {
+            aa_rx_sg_add_frame_prismatic( sg, parent, name, E, E+4, NULL, axis, 0 );
+        } else {
+            aa_rx_sg_add_frame_revolute( sg, parent, name, E, E+4, NULL, axis, 0 );
+        }
+        strcpy(parent, name);
+    }
+    aa_rx_sg_add_frame_fixed( sg, parent, "ee", aa_tf_quat_ident, aa_tf_vec_x );
+    aa_rx_sg_init(sg);
+
+    struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT,
+                                                      aa_rx_sg_frame_id(sg, "ee") );
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    const size_t n = 16;
+    double Q[n_q*n], J[6*n_q*n], manip[n], s_min[n];
+    aa_test_randv( -M_PI, M_PI, n_q*n, Q );
+
+    aa_rx_sg_sub_jac_twist_batch( ssg, fk, n, Q, n_q, J, 6*n_q, manip, s_min );
+
+    for( size_t j = 0; j < n; j ++ ) {
+        double J1[6*n_q];
+        struct aa_dmat mJ1 = AA_DMAT_INIT(6, n_q, J1, 6);
+        struct aa_dvec vq = AA_DVEC_INIT(n_q, Q+j*n_q, 1);
+        aa_rx_sg_sub_fk_jac_twist( ssg, fk, &vq, NULL, &mJ1 );
+        aveq( "jac batch", 6*n_q, J1, J + j*6*n_q, 1e-9 );
+
+        size_t m = AA_MIN(6, n_q);
+        double S[m];
+        aa_la_d_svd( 6, n_q, J1, 6, NULL, 0, S, NULL, 0 );
+        double p = 1;
+        for( size_t i = 0; i < m; i ++ ) p *= S[i];
+        aveq( "jac batch manip", 1, &p, manip+j, 1e-6 );
+        aveq( "jac batch s_min", 1, &S[m-1], s_min+j, 1e-6 );
+
+        check_jac_dot( ssg, fk, &vq, 0 );
+        check_jac_dot( ssg, fk, &vq, 1 );
+    }
+
+    aa_rx_fk_destroy(fk);
+    aa_rx_sg_sub_destroy(ssg);
+    aa_rx_sg_destroy(sg);
+}
+
+/* Stacked Jacobian of a two-armed tree against each arm's chain */
+static void check_fk_jac_ees( void )
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    double q_ident[4] = AA_TF_QUAT_IDENT_INITIALIZER;
+    double v[3] = {.1, .2, .3};
+    aa_rx_sg_add_frame_revolute( sg, "", "t0", q_ident, v, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "t0", "t1", q_ident, v, NULL, aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "t1", "l0", q_ident, v, NULL, aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "l0", "l1", q_ident, v, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "l1", "l_ee", q_ident, v );
+    aa_rx_sg_add_frame_prismatic( sg, "t1", "r0", q_ident, v, NULL, aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "r0", "r1", q_ident, v, NULL, aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "r1", "r_ee", q_ident, v );
+    aa_rx_sg_init(sg);
+
+    aa_rx_frame_id tips[2] = { aa_rx_sg_frame_id(sg, "l_ee"),
+                               aa_rx_sg_frame_id(sg, "r_ee") };
+    struct aa_rx_sg_sub *ssg =
+        aa_rx_sg_multiple_chain_create( sg, AA_RX_FRAME_ROOT, 2, tips );
+    struct aa_rx_sg_sub *ssg_k[2];
+    for( size_t k = 0; k < 2; k ++ ) {
+        ssg_k[k] = aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, tips[k] );
+    }
+
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    size_t n_all = aa_rx_sg_config_count(sg);
+    test( "ees count", 2 == aa_rx_sg_sub_frame_ee_count(ssg) );
+    test( "ees configs", n_all == n_q );
+
+    /* an end-effector outside the chain is rejected on creation */
+    aa_rx_frame_id bad_tips[2] = { tips[0], aa_rx_sg_frame_id(sg, "l0") };
+    test( "ees outside chain",
+          NULL == aa_rx_sg_multiple_chain_create( sg, bad_tips[1], 2, bad_tips ) );
+    test( "ee outside chain",
+          NULL == aa_rx_sg_chain_create( sg, bad_tips[1], bad_tips[1] ) );
+
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    double q[n_q], q_all[n_all], J[12*n_q], E[14];
+    struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+    struct aa_dvec vq_all = AA_DVEC_INIT(n_all, q_all, 1);
+    struct aa_dmat mJ = AA_DMAT_INIT(12, n_q, J, 12);
+    for( size_t t = 0; t < 8; t ++ ) {
+        aa_test_randv( -M_PI, M_PI, n_q, q );
+        aa_rx_sg_sub_config_set( ssg, n_q, q, n_all, q_all );
+        aa_rx_sg_sub_fk_jac_vel_ees( ssg, fk, &vq, E, 7, &mJ );
+
+        for( size_t k = 0; k < 2; k ++ ) {
+            size_t n_k = aa_rx_sg_sub_config_count(ssg_k[k]);
+            double q_k[n_k], J_k[6*n_k], E_k[7];
+            struct aa_dvec vq_k = AA_DVEC_INIT(n_k, q_k, 1);
+            struct aa_dmat mJ_k = AA_DMAT_INIT(6, n_k, J_k, 6);
+            aa_rx_sg_sub_config_gather( ssg_k[k], &vq_all, &vq_k );
+            aa_rx_sg_sub_fk_jac_vel( ssg_k[k], fk, &vq_k, E_k, &mJ_k );
+            aveq( "ees E", 7, E_k, E + 7*k, 1e-9 );
+
+            for( size_t j = 0; j < n_q; j ++ ) {
+                double col[6] = {0};
+                aa_rx_config_id id = aa_rx_sg_sub_config(ssg, j);
+                for( size_t i = 0; i < n_k; i ++ ) {
+                    if( id == aa_rx_sg_sub_config(ssg_k[k], i) ) {
+                        AA_MEM_CPY( col, J_k + 6*i, 6 );
+                    }
+                }
+                aveq( "ees J", 6, col, &AA_DMAT_REF(&mJ, 6*k, j), 1e-9 );
+            }
+        }
+
+        /* Packed blocks hold the ancestor columns */
+        double Jp[aa_rx_sg_sub_ees_jac_packed_size(ssg)];
+        aa_rx_sg_sub_fk_jac_vel_ees_packed( ssg, fk, &vq, NULL, 0, Jp );
+        double *Jk = Jp;
+        for( size_t k = 0; k < 2; k ++ ) {
+            size_t n_k = aa_rx_sg_sub_ee_config_count(ssg, k);
+            const size_t *c = aa_rx_sg_sub_ee_configs(ssg, k);
+            test( "ees configs count", 4 == n_k );
+            for( size_t a = 0; a < n_k; a ++, Jk += 6 ) {
+                test( "ees configs order", 0 == a || c[a-1] < c[a] );
+                aveq( "ees packed", 6, &AA_DMAT_REF(&mJ, 6*k, c[a]), Jk, 0 );
+            }
+        }
+
+        /* Packed and dense solves agree for each damping mode */
+        struct aa_rx_wk_opts *wk = aa_rx_wk_opts_create();
+        double dx[12], dq_r[n_q], dq0[n_q], dq1[n_q];
+        struct aa_dvec vdx = AA_DVEC_INIT(12, dx, 1);
+        struct aa_dvec vdq_r = AA_DVEC_INIT(n_q, dq_r, 1);
+        struct aa_dvec vdq0 = AA_DVEC_INIT(n_q, dq0, 1);
+        struct aa_dvec vdq1 = AA_DVEC_INIT(n_q, dq1, 1);
+        aa_test_randv( -1, 1, 12, dx );
+        aa_test_randv( -1, 1, n_q, dq_r );
+        for( int mode = 0; mode < 3; mode ++ ) {
+            wk->s2min = (0 == mode) ? 1e-2 : 0;
+            wk->k_dls = (1 == mode) ? 1e-2 : 0;
+            aa_rx_wk_jdx2dq( wk, &mJ, &vdx, &vdq_r, &vdq0 );
+            aa_rx_wk_jdx2dq_ees( ssg, wk, Jp, &vdx, &vdq_r, &vdq1 );
+            aveq( "ees jdx2dq np", n_q, dq0, dq1, 1e-6 );
+            aa_rx_wk_jdx2dq( wk, &mJ, &vdx, NULL, &vdq0 );
+            aa_rx_wk_jdx2dq_ees( ssg, wk, Jp, &vdx, NULL, &vdq1 );
+            aveq( "ees jdx2dq", n_q, dq0, dq1, 1e-6 );
+        }
+        aa_rx_wk_opts_destroy(wk);
+    }
+
+    /* IK check over both targets */
+    {
+        struct aa_rx_ik_parm *parm = aa_rx_ik_parm_create();
+        struct aa_rx_ik_cx *cx = aa_rx_ik_cx_create( ssg, parm );
+        double w[2] = {1, 2};
+        test( "ik weights size", AA_RX_INVALID_PARAMETER == aa_rx_ik_set_weights(cx, 1, w) );
+        test( "ik weights", 0 == aa_rx_ik_set_weights(cx, 2, w) );
+
+        struct aa_dmat TF = AA_DMAT_INIT(7, 2, E, 7);
+        aa_rx_sg_sub_fk_jac_vel_ees( ssg, fk, &vq, E, 7, NULL );
+        test( "ik check ees", 0 == aa_rx_ik_check(cx, &TF, &vq) );
+        E[7+AA_TF_QUTR_T] += 1;
+        test( "ik check ees miss", 0 != aa_rx_ik_check(cx, &TF, &vq) );
+        E[7+AA_TF_QUTR_T] -= 1;
+
+        /* Joint solve for both targets from a nearby seed */
+        aa_rx_ik_parm_set_algo( parm, AA_RX_IK_JPINV );
+        aa_rx_ik_parm_set_tol_dq( parm, 1e-3 );
+        double q_s[n_q];
+        struct aa_dvec vq_s = AA_DVEC_INIT(n_q, q_s, 1);
+        for( size_t i = 0; i < n_q; i ++ ) q_s[i] = q[i] + aa_frand_minmax(-.1, .1);
+        aa_rx_ik_set_seed( cx, &vq_s );
+        test( "ik solve ees", 0 == aa_rx_ik_solve(cx, &TF, &vq_s) );
+        test( "ik solve ees check", 0 == aa_rx_ik_check(cx, &TF, &vq_s) );
+
+        aa_rx_ik_parm_set_algo( parm, AA_RX_IK_LMA );
+        for( size_t i = 0; i < n_q; i ++ ) q_s[i] = q[i] + aa_frand_minmax(-.1, .1);
+        aa_rx_ik_set_seed( cx, &vq_s );
+        test( "ik lma ees", 0 == aa_rx_ik_solve(cx, &TF, &vq_s) );
+        test( "ik lma ees check", 0 == aa_rx_ik_check(cx, &TF, &vq_s) );
+
+        aa_rx_ik_cx_destroy(cx);
+        aa_rx_ik_parm_destroy(parm);
+    }
+
+    aa_rx_fk_destroy(fk);
+    for( size_t k = 0; k < 2; k ++ ) aa_rx_sg_sub_destroy(ssg_k[k]);
+    aa_rx_sg_sub_destroy(ssg);
+    aa_rx_sg_destroy(sg);
+}
+
+/* Task-priority control on random Jacobians */
+static void check_wk_prio( void )
+{
+    struct aa_rx_wk_opts *wk = aa_rx_wk_opts_create();
+    const size_t n = 7;
+    double J[8*n], dx[8], dq_r[n], dq0[n], dq1[n];
+    struct aa_dvec vdq_r = AA_DVEC_INIT(n, dq_r, 1);
+    struct aa_dvec vdq0 = AA_DVEC_INIT(n, dq0, 1);
+    struct aa_dvec vdq1 = AA_DVEC_INIT(n, dq1, 1);
+    aa_test_randv( -1, 1, n, dq_r );
+
+    /* One level is the same as the single-task solve */
+    {
+        size_t rows[1] = {6};
+        struct aa_dmat mJ = AA_DMAT_INIT(6, n, J, 6);
+        struct aa_dvec vdx = AA_DVEC_INIT(6, dx, 1);
+        aa_test_randv( -1, 1, 6*n, J );
+        aa_test_randv( -1, 1, 6, dx );
+        for( int mode = 0; mode < 3; mode ++ ) {
+            wk->s2min = (0 == mode) ? 1e-2 : 0;
+            wk->k_dls = (1 == mode) ? 1e-2 : 0;
+            struct aa_rx_wk_prio_cx *cx = aa_rx_wk_prio_create( wk, n, 1, rows );
+            aa_rx_wk_jdx2dq( wk, &mJ, &vdx, &vdq_r, &vdq0 );
+            test( "prio np", 0 == aa_rx_wk_jdx2dq_prio( cx, &mJ, &vdx, &vdq_r, &vdq1 ) );
+            aveq( "prio np", n, dq0, dq1, 1e-6 );
+            aa_rx_wk_jdx2dq( wk, &mJ, &vdx, NULL, &vdq0 );
+            aa_rx_wk_jdx2dq_prio( cx, &mJ, &vdx, NULL, &vdq1 );
+            aveq( "prio single", n, dq0, dq1, 1e-6 );
+            aa_rx_wk_prio_destroy( cx );
+        }
+    }
+
+    /* Levels in conflict: the first is exact, the second is least
+     * squares within the first's null space, and the posture does not
+     * disturb either */
+    wk->s2min = 0;
+    wk->k_dls = 0;
+    for( size_t t = 0; t < 2; t ++ ) {
+        size_t rows[2] = {3, t ? 5 : 2};
+        size_t m = rows[0] + rows[1];
+        struct aa_dmat mJ = AA_DMAT_INIT(m, n, J, m);
+        struct aa_dvec vdx = AA_DVEC_INIT(m, dx, 1);
+        aa_test_randv( -1, 1, m*n, J );
+        aa_test_randv( -1, 1, m, dx );
+        struct aa_rx_wk_prio_cx *cx = aa_rx_wk_prio_create( wk, n, 2, rows );
+        aa_rx_wk_jdx2dq_prio( cx, &mJ, &vdx, NULL, &vdq0 );
+        aa_rx_wk_jdx2dq_prio( cx, &mJ, &vdx, &vdq_r, &vdq1 );
+
+        struct aa_dmat J1, J2;
+        aa_dmat_view_block( &J1, &mJ, 0, 0, rows[0], n );
+        aa_dmat_view_block( &J2, &mJ, rows[0], 0, rows[1], n );
+        double y[m];
+        struct aa_dvec vy1 = AA_DVEC_INIT(rows[0], y, 1);
+        struct aa_dvec vy2 = AA_DVEC_INIT(rows[1], y+rows[0], 1);
+        aa_dmat_gemv( CblasNoTrans, 1, &J1, &vdq1, 0, &vy1 );
+        aveq( "prio first", rows[0], dx, y, 1e-6 );
+        aa_dmat_gemv( CblasNoTrans, 1, &J2, &vdq1, 0, &vy2 );
+        aa_dmat_gemv( CblasNoTrans, 1, &J2, &vdq0, -1, &vy2 );
+        test_flt( "prio posture", aa_dvec_nrm2(&vy2), 1e-6, 0 );
+        if( 0 == t ) {
+            aa_dmat_gemv( CblasNoTrans, 1, &J2, &vdq0, 0, &vy2 );
+            aveq( "prio second", rows[1], dx+rows[0], y+rows[0], 1e-6 );
+        } else {
+            /* residual is orthogonal to J2*N1 */
+            double Js[n*rows[0]], N[n*n], JN[rows[1]*n], g[n];
+            struct aa_dmat mJs = AA_DMAT_INIT(n, rows[0], Js, n);
+            struct aa_dmat mN = AA_DMAT_INIT(n, n, N, n);
+            struct aa_dmat mJN = AA_DMAT_INIT(rows[1], n, JN, rows[1]);
+            struct aa_dvec vg = AA_DVEC_INIT(n, g, 1);
+            aa_dmat_pinv( &J1, -1, &mJs );
+            aa_dmat_gemm( CblasNoTrans, CblasNoTrans, -1, &mJs, &J1, 0, &mN );
+            for( size_t i = 0; i < n; i ++ ) N[i*(n+1)] += 1;
+            aa_dmat_gemm( CblasNoTrans, CblasNoTrans, 1, &J2, &mN, 0, &mJN );
+            aa_dmat_gemv( CblasNoTrans, 1, &J2, &vdq0, 0, &vy2 );
+            for( size_t i = 0; i < rows[1]; i ++ ) y[rows[0]+i] -= dx[rows[0]+i];
+            aa_dmat_gemv( CblasTrans, 1, &mJN, &vy2, 0, &vg );
+            test_flt( "prio second lsq", aa_dvec_nrm2(&vg), 1e-6, 0 );
+        }
+        aa_rx_wk_prio_destroy( cx );
+    }
+
+    aa_rx_wk_opts_destroy(wk);
+}
+
+/* Batch IK along a joint-space path, warm started on several threads */
+static void check_ik_batch( void )
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    double q_ident[4] = AA_TF_QUAT_IDENT_INITIALIZER;
+    double v[3] = {0, 0, .3};
+    const double *axes[3] = {aa_tf_vec_z, aa_tf_vec_y, aa_tf_vec_x};
+    char parent[32] = "", name[32];
+    for( size_t i = 0; i < 6; i ++ ) {
+        snprintf(name, sizeof(name), "j%lu", (unsigned long)i);
+        aa_rx_sg_add_frame_revolute( sg, parent, name, q_ident, v, NULL, axes[i%3], 0 );
+        strcpy(parent, name);
+    }
+    aa_rx_sg_add_frame_fixed( sg, parent, "ee", q_ident, v );
+    aa_rx_sg_init(sg);
+
+    aa_rx_frame_id ee = aa_rx_sg_frame_id(sg, "ee");
+    struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, ee );
+    struct aa_rx_ik_parm *parm = aa_rx_ik_parm_create();
+    aa_rx_ik_parm_set_algo( parm, AA_RX_IK_JPINV );
+    aa_rx_ik_parm_set_tol_dq( parm, 1e-3 );
+    struct aa_rx_ik_cx *cx = aa_rx_ik_cx_create( ssg, parm );
+
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    const size_t n = 24;
+    double q0[n_q], dq[n_q], TF[7*n], Q[n_q*n];
+    int status[n];
+    aa_test_randv( -1, 1, n_q, q0 );
+    aa_test_randv( -.05, .05, n_q, dq );
+
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    for( size_t i = 0; i < n; i ++ ) {
+        double q[n_q];
+        for( size_t j = 0; j < n_q; j ++ ) q[j] = q0[j] + (double)i*dq[j];
+        struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+        aa_rx_fk_sub( fk, ssg, &vq );
+        aa_rx_fk_get_abs_qutr( fk, ee, TF + 7*i );
+    }
+
+    struct aa_dvec vq0 = AA_DVEC_INIT(n_q, q0, 1);
+    aa_rx_ik_set_seed( cx, &vq0 );
+    aa_rx_ik_set_threads( cx, 3 );
+    aa_rx_ik_set_warm_start( cx, 1 );
+
+    struct aa_dmat mTF = AA_DMAT_INIT(7, n, TF, 7);
+    struct aa_dmat mQ = AA_DMAT_INIT(n_q, n, Q, n_q);
+    test( "ik batch", 0 == aa_rx_ik_solve_batch( cx, n, &mTF, &mQ, status ) );
+    for( size_t i = 0; i < n; i ++ ) {
+        struct aa_dmat TF_i = AA_DMAT_INIT(7, 1, TF + 7*i, 7);
+        struct aa_dvec q_i = AA_DVEC_INIT(n_q, Q + n_q*i, 1);
+        test( "ik batch status", 0 == status[i] );
+        test( "ik batch check", 0 == aa_rx_ik_check( cx, &TF_i, &q_i ) );
+    }
+    struct aa_dmat mQ1 = AA_DMAT_INIT(n_q, n-1, Q, n_q);
+    test( "ik batch size", AA_RX_INVALID_PARAMETER ==
+          aa_rx_ik_solve_batch( cx, n, &mTF, &mQ1, status ) );
+
+    /* Concurrent starts for the first target */
+    {
+        struct aa_dmat TF_0 = AA_DMAT_INIT(7, 1, TF, 7);
+        double q[n_q], Qa[4*n_q], q_start[n_q];
+        struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+        struct aa_dmat mQa = AA_DMAT_INIT(n_q, 4, Qa, n_q);
+        aa_rx_ik_set_seed_center( cx );
+        aa_rx_ik_set_restart_time( cx, .5 );
+        test( "ik race", 0 == aa_rx_ik_solve_race( cx, &TF_0, &vq ) );
+        test( "ik race check", 0 == aa_rx_ik_check( cx, &TF_0, &vq ) );
+
+        aa_rx_ik_set_threads( cx, 2 );
+        aa_rx_ik_set_restart_time( cx, .1 );
+        size_t n_sol = aa_rx_ik_solve_all( cx, &TF_0, &mQa );
+        test( "ik all", n_sol > 0 && n_sol <= 4 );
+        AA_MEM_ZERO( q_start, n_q );
+        double d_prev = 0;
+        for( size_t j = 0; j < n_sol; j ++ ) {
+            struct aa_dvec q_j = AA_DVEC_INIT(n_q, Qa + n_q*j, 1);
+            struct aa_dvec v_start = AA_DVEC_INIT(n_q, q_start, 1);
+            double d = aa_dvec_ssd( &v_start, &q_j );
+            test( "ik all check", 0 == aa_rx_ik_check( cx, &TF_0, &q_j ) );
+            test( "ik all order", d >= d_prev );
+            d_prev = d;
+        }
+    }
+
+    /* Levenberg-Marquardt from perturbed seeds */
+    {
+        aa_rx_ik_parm_set_algo( parm, AA_RX_IK_LMA );
+        aa_rx_ik_set_threads( cx, 1 );
+        aa_rx_ik_set_warm_start( cx, 0 );
+        aa_rx_ik_set_restart_time( cx, 0 );
+        for( size_t i = 0; i < n; i ++ ) {
+            struct aa_dmat TF_i = AA_DMAT_INIT(7, 1, TF + 7*i, 7);
+            double q[n_q];
+            struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+            for( size_t j = 0; j < n_q; j ++ ) {
+                q[j] = q0[j] + (double)i*dq[j] + aa_frand_minmax(-.2, .2);
+            }
+            aa_rx_ik_set_seed( cx, &vq );
+            test( "ik lma", 0 == aa_rx_ik_solve( cx, &TF_i, &vq ) );
+            test( "ik lma check", 0 == aa_rx_ik_check( cx, &TF_i, &vq ) );
+        }
+    }
+
+    /* Real-time steps with a budget resume from the previous iterate */
+    {
+        aa_rx_ik_set_seed( cx, &vq0 );
+        struct aa_rx_ik_rt *rt = aa_rx_ik_rt_create( cx );
+        aa_rx_ik_rt_set_budget( rt, 1, 0 );
+        struct aa_dmat TF_0 = AA_DMAT_INIT(7, 1, TF + 7*(n-1), 7);
+        double q[n_q], res = DBL_MAX, res_prev = DBL_MAX;
+        struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+        int r = -1;
+        for( size_t i = 0; r && i < 100; i ++ ) {
+            r = aa_rx_ik_rt_step( rt, &TF_0, &vq, &res );
+            test( "ik rt monotone", res <= res_prev );
+            res_prev = res;
+        }
+        test( "ik rt converge", 0 == r );
+        test( "ik rt check", 0 == aa_rx_ik_check( cx, &TF_0, &vq ) );
+
+        /* track the path backwards within a time budget */
+        aa_rx_ik_rt_set_budget( rt, 100, 1e-2 );
+        for( size_t i = n; i > 0; i -- ) {
+            struct aa_dmat TF_i = AA_DMAT_INIT(7, 1, TF + 7*(i-1), 7);
+            test( "ik rt track", 0 == aa_rx_ik_rt_step( rt, &TF_i, &vq, NULL ) );
+            test( "ik rt track check", 0 == aa_rx_ik_check( cx, &TF_i, &vq ) );
+        }
+        aa_rx_ik_rt_destroy( rt );
+    }
+
+    /* Solution cache */
+    {
+        const char *file = "sg_test_ik_cache.bin";
+        struct aa_rx_ik_cache *cache = aa_rx_ik_cache_create( n_q, 1, 8, .05 );
+        struct aa_rx_ik_cache *bad = aa_rx_ik_cache_create( n_q, 2, 8, .05 );
+        test( "ik cache create", NULL == aa_rx_ik_cache_create( n_q, 1, 0, .05 ) );
+        test( "ik cache mismatch", AA_RX_INVALID_PARAMETER == aa_rx_ik_set_cache( cx, bad ) );
+        test( "ik cache set", 0 == aa_rx_ik_set_cache( cx, cache ) );
+        aa_rx_ik_set_seed( cx, &vq0 );
+        for( int pass = 0; pass < 2; pass ++ ) {
+            for( size_t i = n - 8; i < n; i ++ ) {
+                struct aa_dmat TF_i = AA_DMAT_INIT(7, 1, TF + 7*i, 7);
+                double q[n_q];
+                struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+                test( "ik cache solve", 0 == aa_rx_ik_solve( cx, &TF_i, &vq ) );
+                test( "ik cache check", 0 == aa_rx_ik_check( cx, &TF_i, &vq ) );
+            }
+        }
+        struct aa_rx_ik_cache_stats stats;
+        aa_rx_ik_cache_get_stats( cache, &stats );
+        test( "ik cache lookups", 16 == stats.lookups );
+        test( "ik cache hits", stats.hits >= 8 );
+        test( "ik cache size", 8 == aa_rx_ik_cache_size(cache) );
+
+        /* a smaller cache keeps the most recent entries */
+        test( "ik cache save", 0 == aa_rx_ik_cache_save( cache, file ) );
+        struct aa_rx_ik_cache *small = aa_rx_ik_cache_create( n_q, 1, 4, .05 );
+        test( "ik cache load", 0 == aa_rx_ik_cache_load( small, file ) );
+        test( "ik cache load bad", 0 != aa_rx_ik_cache_load( bad, file ) );
+        test( "ik cache load size", 4 == aa_rx_ik_cache_size(small) );
+        aa_rx_ik_cache_get_stats( small, &stats );
+        test( "ik cache evict", 4 == stats.evictions );
+        {
+            struct aa_dmat TF_i = AA_DMAT_INIT(7, 1, TF + 7*(n-1), 7);
+            double q[n_q];
+            struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+            test( "ik cache load hit", aa_rx_ik_cache_seed( small, &TF_i, &vq ) );
+            test( "ik cache load seed", 0 == aa_rx_ik_check( cx, &TF_i, &vq ) );
+        }
+        remove(file);
+
+        aa_rx_ik_set_cache( cx, NULL );
+        aa_rx_ik_cache_destroy( small );
+        aa_rx_ik_cache_destroy( bad );
+        aa_rx_ik_cache_destroy( cache );
+    }
+
+    aa_rx_fk_destroy(fk);
+    aa_rx_ik_cx_destroy(cx);
+    aa_rx_ik_parm_destroy(parm);
+    aa_rx_sg_sub_destroy(ssg);
+    aa_rx_sg_destroy(sg);
+}
+
+/* Closed-form solutions contain the configuration that produced the target */
+/* Joint-angle forms of the planar closed-form IK */
+static void check_kin_planar( void )
+{
+    double l[3] = {1, .7, .3}, q[3] = {.4, -1.1, .6}, qa[3], qb[3];
+    double p[3] = {l[0]*cos(q[0]) + l[1]*cos(q[0]+q[1]),
+                   l[0]*sin(q[0]) + l[1]*sin(q[0]+q[1]),
+                   q[0]+q[1]+q[2]};
+    test( "planar2_ik", 0 == aa_kin_planar2_ik( l, p, qa, qb ) );
+    aveq( "planar2_ik", 2, q, qb, 1e-9 );
+
+    double far[3] = {2.2, 2, 0};
+    test( "planar2_ik unreachable", 0 != aa_kin_planar2_ik( l, far, qa, qb ) );
+
+    p[0] += l[2]*cos(p[2]);
+    p[1] += l[2]*sin(p[2]);
+    test( "planar3_ik", 0 == aa_kin_planar3_ik( l, p, qa, qb ) );
+    aveq( "planar3_ik", 3, q, qb, 1e-9 );
+}
+
+static void check_ik_analytic_chain( struct aa_rx_sg *sg, const char *name )
+{
+    aa_rx_sg_init(sg);
+    aa_rx_frame_id ee = aa_rx_sg_frame_id(sg, "ee");
+    struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, ee );
+    struct aa_rx_ik_parm *parm = aa_rx_ik_parm_create();
+    aa_rx_ik_parm_set_algo( parm, AA_RX_IK_LMA );
+    struct aa_rx_ik_cx *cx = aa_rx_ik_cx_create( ssg, parm );
+    const char *detected = aa_rx_ik_get_analytic(cx);
+    test( "ik analytic detect", detected && 0 == strcmp(name, detected) );
+
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    for( size_t t = 0; t < 20; t ++ ) {
+        double q[n_q], E[7], Qd[8*n_q];
+        aa_test_randv( -3, 3, n_q, q );
+        struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+        aa_rx_fk_sub( fk, ssg, &vq );
+        aa_rx_fk_get_abs_qutr( fk, ee, E );
+        struct aa_dmat TF = AA_DMAT_INIT(7, 1, E, 7);
+        struct aa_dmat Q = AA_DMAT_INIT(n_q, 8, Qd, n_q);
+
+        size_t n = aa_rx_ik_solve_analytic( cx, &TF, &Q );
+        int found = 0;
+        for( size_t j = 0; j < n; j ++ ) {
+            struct aa_dvec q_j = AA_DVEC_INIT(n_q, Qd + n_q*j, 1);
+            test( "ik analytic check", 0 == aa_rx_ik_check(cx, &TF, &q_j) );
+            double d = 0;
+            for( size_t i = 0; i < n_q; i ++ ) d += fabs(aa_ang_delta(q[i], Qd[n_q*j+i]));
+            found |= d < 1e-6;
+        }
+        test( "ik analytic branch", found );
+
+        /* the solve returns the branch nearest the seed */
+        double q_s[n_q], q_r[n_q];
+        for( size_t i = 0; i < n_q; i ++ ) q_s[i] = aa_ang_norm_pi(q[i]) + 1e-3;
+        struct aa_dvec vq_s = AA_DVEC_INIT(n_q, q_s, 1);
+        struct aa_dvec vq_r = AA_DVEC_INIT(n_q, q_r, 1);
+        aa_rx_ik_set_seed( cx, &vq_s );
+        test( "ik analytic solve", 0 == aa_rx_ik_solve(cx, &TF, &vq_r) );
+        aveq( "ik analytic nearest", n_q, q_s, q_r, 1e-2 );
+    }
+
+    aa_rx_ik_set_analytic( cx, 0 );
+    test( "ik analytic disable", NULL == aa_rx_ik_get_analytic(cx) );
+
+    aa_rx_fk_destroy(fk);
+    aa_rx_ik_cx_destroy(cx);
+    aa_rx_ik_parm_destroy(parm);
+    aa_rx_sg_sub_destroy(ssg);
+    aa_rx_sg_destroy(sg);
+}
+
+static void check_ik_analytic( void )
+{
+    double q_ident[4] = AA_TF_QUAT_IDENT_INITIALIZER;
+    double z_neg[3] = {0, 0, -1};
+
+    check_kin_planar();
+
+    /* 6R with a shoulder offset and a spherical wrist */
+    {
+        struct aa_rx_sg *sg = aa_rx_sg_create();
+        double v0[3] = {0, 0, 0}, v1[3] = {0, 0, .4}, v2[3] = {.05, .1, .4};
+        double v3[3] = {.4, 0, .02}, v_ee[3] = {.1, 0, .05};
+        aa_rx_sg_add_frame_revolute( sg, "", "j0", q_ident, v0, NULL, aa_tf_vec_z, 0 );
+        aa_rx_sg_add_frame_revolute( sg, "j0", "j1", q_ident, v1, NULL, aa_tf_vec_y, 0 );
+        aa_rx_sg_add_frame_revolute( sg, "j1", "j2", q_ident, v2, NULL, aa_tf_vec_y, 0 );
+        aa_rx_sg_add_frame_revolute( sg, "j2", "j3", q_ident, v3, NULL, aa_tf_vec_x, 0 );
+        aa_rx_sg_add_frame_revolute( sg, "j3", "j4", q_ident, v0, NULL, aa_tf_vec_y, 0 );
+        aa_rx_sg_add_frame_revolute( sg, "j4", "j5", q_ident, v0, NULL, aa_tf_vec_x, 0 );
+        aa_rx_sg_add_frame_fixed( sg, "j5", "ee", q_ident, v_ee );
+        check_ik_analytic_chain( sg, "6r-spherical-wrist" );
+    }
+
+    /* planar arms, with an antiparallel axis and offsets off the plane */
+    {
+        struct aa_rx_sg *sg = aa_rx_sg_create();
+        double v0[3] = {0, 0, 0}, v1[3] = {.5, .1, 0}, v2[3] = {.4, 0, .1};
+        double v_ee[3] = {.2, .05, 0};
+        aa_rx_sg_add_frame_revolute( sg, "", "j0", q_ident, v0, NULL, aa_tf_vec_z, 0 );
+        aa_rx_sg_add_frame_revolute( sg, "j0", "j1", q_ident, v1, NULL, aa_tf_vec_z, 0 );
+        aa_rx_sg_add_frame_revolute( sg, "j1", "j2", q_ident, v2, NULL, z_neg, 0 );
+        aa_rx_sg_add_frame_fixed( sg, "j2", "ee", q_ident, v_ee );
+        check_ik_analytic_chain( sg, "planar-3r" );
+    }
+    {
+        struct aa_rx_sg *sg = aa_rx_sg_create();
+        double v0[3] = {0, 0, 0}, v1[3] = {.5, .1, 0}, v_ee[3] = {.4, 0, .1};
+        aa_rx_sg_add_frame_revolute( sg, "", "j0", q_ident, v0, NULL, aa_tf_vec_z, 0 );
+        aa_rx_sg_add_frame_revolute( sg, "j0", "j1", q_ident, v1, NULL, z_neg, 0 );
+        aa_rx_sg_add_frame_fixed( sg, "j1", "ee", q_ident, v_ee );
+        check_ik_analytic_chain( sg, "planar-2r" );
+    }
+}
+
+#ifdef HAVE_NLOPT
+/* A user objective composed from the library objectives */
+static double obj_composed( void *cx, const double *q, double *dq )
+{
+    size_t n = aa_rx_sg_sub_config_count(((struct kin_solve_cx*)cx)->ssg);
+    double g[n];
+    double r = aa_rx_ik_opt_err_qlnpv( cx, q, dq );
+    r += .1 * aa_rx_ik_opt_err_jcenter( cx, q, dq ? g : NULL );
+    if( dq ) for( size_t i = 0; i < n; i ++ ) dq[i] += .1 * g[i];
+    return r;
+}
+
+/* Analytic gradients of the SQP objectives match finite differences */
+static void check_ik_grad( void )
+{
+    aa_rx_ik_opt_fun *funs[] = { aa_rx_ik_opt_err_dqln,
+                                 aa_rx_ik_opt_err_qlnpv,
+                                 aa_rx_ik_opt_err_trans,
+                                 aa_rx_ik_opt_err_jcenter,
+                                 aa_rx_ik_opt_err_dqln_fd,
+                                 aa_rx_ik_opt_err_qlnpv_fd,
+                                 aa_rx_ik_opt_err_trans_fd,
+                                 obj_composed };
+    const size_t n_funs = sizeof(funs) / sizeof(funs[0]);
+
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    double q_ident[4] = AA_TF_QUAT_IDENT_INITIALIZER;
+    double v[3] = {.1, .2, .3};
+    aa_rx_sg_add_frame_revolute( sg, "", "t0", q_ident, v, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "t0", "t1", q_ident, v, NULL, aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "t1", "l0", q_ident, v, NULL, aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "l0", "l1", q_ident, v, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "l1", "l_ee", q_ident, v );
+    aa_rx_sg_add_frame_prismatic( sg, "t1", "r0", q_ident, v, NULL, aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "r0", "r1", q_ident, v, NULL, aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "r1", "r_ee", q_ident, v );
+    aa_rx_sg_init(sg);
+
+    aa_rx_frame_id tips[2] = { aa_rx_sg_frame_id(sg, "l_ee"),
+                               aa_rx_sg_frame_id(sg, "r_ee") };
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    for( size_t n_tips = 1; n_tips <= 2; n_tips ++ ) {
+        struct aa_rx_sg_sub *ssg =
+            aa_rx_sg_multiple_chain_create( sg, AA_RX_FRAME_ROOT, n_tips, tips );
+        struct aa_rx_ik_parm *parm = aa_rx_ik_parm_create();
+        struct aa_rx_ik_cx *cx = aa_rx_ik_cx_create( ssg, parm );
+        double w[2] = {1, 2};
+        if( 2 == n_tips ) aa_rx_ik_set_weights( cx, 2, w );
+
+        size_t n_q = aa_rx_sg_sub_config_count(ssg);
+        double q[n_q], E[7*n_tips];
+        struct aa_dvec vq = AA_DVEC_INIT(n_q, q, 1);
+        struct aa_dmat TF = AA_DMAT_INIT(7, n_tips, E, 7);
+        double err;
+        for( size_t t = 0; t < 8; t ++ ) {
+            aa_test_randv( -M_PI, M_PI, n_q, q );
+            aa_rx_sg_sub_fk_jac_vel_ees( ssg, fk, &vq, E, 7, NULL );
+            for( size_t i = 0; i < n_q; i ++ ) q[i] += aa_frand_minmax(-1, 1);
+            for( size_t f = 0; f < n_funs; f ++ ) {
+                test( "ik grad", 0 == aa_rx_ik_opt_check_grad( cx, funs[f], &TF, &vq,
+                                                               0, &err ) );
+                test( "ik grad err", err < 1e-5 );
+            }
+        }
+        struct aa_dmat TF1 = AA_DMAT_INIT(7, 3-n_tips, E, 7);
+        test( "ik grad size", AA_RX_INVALID_PARAMETER ==
+              aa_rx_ik_opt_check_grad( cx, funs[0], &TF1, &vq, 0, &err ) );
+
+        aa_rx_ik_cx_destroy(cx);
+        aa_rx_ik_parm_destroy(parm);
+        aa_rx_sg_sub_destroy(ssg);
+    }
+    aa_rx_fk_destroy(fk);
+    aa_rx_sg_destroy(sg);
+}
+
+struct elbow_ct {
+    aa_rx_frame_id frame;
+    double y_max;
+};
+
+/* Keep the first elbow of a planar arm below y_max, c = y - y_max */
+static void ineqct_elbow( void *data, const struct aa_rx_sg_sub *ssg,
+                          const struct aa_rx_fk *fk,
+                          struct aa_dvec *c, struct aa_dmat *dc )
+{
+    struct elbow_ct *ct = (struct elbow_ct*)data;
+    const double *v = aa_rx_fk_ref(fk, ct->frame) + AA_TF_QUTR_V;
+    AA_DVEC_REF(c,0) = v[1] - ct->y_max;
+    if( dc ) {
+        /* only the base joint moves the elbow */
+        for( size_t j = 0; j < aa_rx_sg_sub_config_count(ssg); j ++ ) {
+            AA_DMAT_REF(dc,j,0) = (0 == j) ? v[0] : 0;
+        }
+    }
+}
+
+/* Inequality constraints move SQP solutions within the null space */
+static void check_ik_ineqct( void )
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    double q_ident[4] = AA_TF_QUAT_IDENT_INITIALIZER;
+    double v0[3] = {0, 0, 0}, v[3] = {.5, 0, 0};
+    aa_rx_sg_add_frame_revolute( sg, "", "j0", q_ident, v0, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j0", "j1", q_ident, v, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j1", "j2", q_ident, v, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j2", "j3", q_ident, v, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "j3", "ee", q_ident, v );
+    aa_rx_sg_init(sg);
+
+    aa_rx_frame_id ee = aa_rx_sg_frame_id(sg, "ee");
+    struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, ee );
+    struct aa_rx_ik_parm *parm = aa_rx_ik_parm_create();
+    aa_rx_ik_parm_set_algo( parm, AA_RX_IK_SQP );
+    struct aa_rx_ik_cx *cx = aa_rx_ik_cx_create( ssg, parm );
+
+    double q[4] = {.6, 1, 1, 1}, E[7];
+    struct aa_dvec vq = AA_DVEC_INIT(4, q, 1);
+    struct aa_dmat TF = AA_DMAT_INIT(7, 1, E, 7);
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    aa_rx_fk_sub( fk, ssg, &vq );
+    aa_rx_fk_get_abs_qutr( fk, ee, E );
+
+    struct elbow_ct ct = { aa_rx_sg_frame_id(sg, "j1"), .2 };
+    aa_rx_ik_set_ineqct( cx, 1, ineqct_elbow, &ct, 1e-6 );
+    aa_rx_ik_set_seed( cx, &vq );
+    test( "ik ineqct", 0 == aa_rx_ik_solve( cx, &TF, &vq ) );
+    test( "ik ineqct check", 0 == aa_rx_ik_check( cx, &TF, &vq ) );
+    aa_rx_fk_sub( fk, ssg, &vq );
+    const double *v_ee = aa_rx_fk_ref(fk, ee) + AA_TF_QUTR_V;
+    const double *v_el = aa_rx_fk_ref(fk, ct.frame) + AA_TF_QUTR_V;
+    test( "ik ineqct feasible", v_el[1] <= ct.y_max + 1e-6 );
+    aveq( "ik ineqct target", 3, v_ee, E + AA_TF_QUTR_V, 1e-3 );
+
+    /* Infeasible constraints reject the solution */
+    ct.y_max = -1;
+    test( "ik ineqct infeasible", 0 != aa_rx_ik_solve( cx, &TF, &vq ) );
+
+    /* ... also for the algorithms that ignore them while solving */
+    enum aa_rx_ik_algo algos[2] = {AA_RX_IK_LMA, AA_RX_IK_JPINV};
+    for( size_t a = 0; a < 2; a ++ ) {
+        aa_rx_ik_parm_set_algo( parm, algos[a] );
+        test( "ik ineqct infeasible unconstrained",
+              0 != aa_rx_ik_solve( cx, &TF, &vq ) );
+    }
+    struct aa_rx_ik_rt *rt = aa_rx_ik_rt_create( cx );
+    test( "ik ineqct infeasible rt", 0 != aa_rx_ik_rt_step( rt, &TF, &vq, NULL ) );
+    aa_rx_ik_rt_destroy( rt );
+
+    aa_rx_ik_set_ineqct( cx, 0, NULL, NULL, 0 );
+    aa_rx_fk_destroy(fk);
+    aa_rx_ik_cx_destroy(cx);
+    aa_rx_ik_parm_destroy(parm);
+    aa_rx_sg_sub_destroy(ssg);
+    aa_rx_sg_destroy(sg);
+}
+#else /*HAVE_NLOPT*/
+static void check_ik_grad( void ) { }
+static void check_ik_ineqct( void ) { }
+#endif /*HAVE_NLOPT*/
@@ -1,3 +1,4 @@
+#include "config.h"
 #include "amino.h"
 #include "amino/rx/scene_fcl.h"
 
@@ -6,6 +7,9 @@
 #include "amino/rx/scenegraph.h"
 #include "amino/rx/scene_geom.h"
 #include "amino/rx/scene_collision.h"
+#include "amino/rx/scene_fk.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/scene_ik.h"
 
 
 static void test_box()
@@ -143,6 +147,342 @@ void test_cylinder()
     }
 }
 
+static void test_threads()
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    struct aa_rx_geom_opt *opt_cl = aa_rx_geom_opt_create();
+    aa_rx_geom_opt_set_collision(opt_cl, 1);
+
+    /* a row of boxes, every third one separated from its neighbor */
+    double d[3] = {.1, .1, .1};
+    double x = 0;
+    for( size_t i = 0; i < 12; i ++ ) {
+        char name[16];
+        double v[3] = {x, 0, 0};
+        snprintf(name, sizeof(name), "f%lu", (unsigned long)i);
+        aa_rx_sg_add_frame_fixed( sg, "", name, aa_tf_quat_ident, v );
+        aa_rx_geom_attach( sg, name, aa_rx_geom_box(opt_cl, d) );
+        x += (i % 3 == 2) ? .5 : .05;
+    }
+
+    aa_rx_sg_init(sg);
+    aa_rx_sg_cl_init(sg);
+
+    size_t n = aa_rx_sg_frame_count(sg);
+    double TF_rel[7*n];
+    double TF_abs[7*n];
+    aa_rx_sg_tf(sg, 0, NULL,
+                n,
+                TF_rel, 7,
+                TF_abs, 7 );
+
+    struct aa_rx_cl *cl = aa_rx_cl_create(sg);
+    struct aa_rx_cl_set *set1 = aa_rx_cl_set_create(sg);
+    struct aa_rx_cl_set *set3 = aa_rx_cl_set_create(sg);
+
+    int r1 = aa_rx_cl_check( cl, n, TF_abs, 7, set1 );
+    aa_rx_cl_set_threads( cl, 3 );
+    int r3 = aa_rx_cl_check( cl, n, TF_abs, 7, set3 );
+    assert( r1 && r3 );
+    assert( aa_rx_cl_check( cl, n, TF_abs, 7, NULL ) );
+
+    for( aa_rx_frame_id i = 0; i < (aa_rx_frame_id)n; i ++ ) {
+        for( aa_rx_frame_id j = 0; j < (aa_rx_frame_id)n; j ++ ) {
+            assert( aa_rx_cl_set_get(set1, i, j) == aa_rx_cl_set_get(set3, i, j) );
+        }
+    }
+
+    /* the workers serve repeated checks and follow thread count changes */
+    for( size_t t = 0; t < 4; t ++ ) {
+        aa_rx_cl_set_threads( cl, 1 + t % 3 );
+        for( size_t k = 0; k < 8; k ++ ) {
+            aa_rx_cl_set_clear(set3);
+            assert( aa_rx_cl_check( cl, n, TF_abs, 7, set3 ) );
+            assert( aa_rx_cl_check( cl, n, TF_abs, 7, NULL ) );
+            for( aa_rx_frame_id i = 0; i < (aa_rx_frame_id)n; i ++ ) {
+                for( aa_rx_frame_id j = 0; j < (aa_rx_frame_id)n; j ++ ) {
+                    assert( aa_rx_cl_set_get(set1, i, j) == aa_rx_cl_set_get(set3, i, j) );
+                }
+            }
+        }
+    }
+
+    /* allowed pairs are still skipped */
+    aa_rx_cl_allow_set( cl, set1 );
+    assert( 0 == aa_rx_cl_check( cl, n, TF_abs, 7, NULL ) );
+
+    aa_rx_cl_set_destroy(set1);
+    aa_rx_cl_set_destroy(set3);
+    aa_rx_cl_destroy(cl);
+    aa_rx_sg_destroy(sg);
+}
+
+static void test_batch()
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    struct aa_rx_geom_opt *opt_cl = aa_rx_geom_opt_create();
+    aa_rx_geom_opt_set_collision(opt_cl, 1);
+
+    double axis[3] = {1,0,0};
+    aa_rx_sg_add_frame_fixed( sg, "", "a",
+                              aa_tf_quat_ident, aa_tf_vec_ident );
+    aa_rx_sg_add_frame_prismatic( sg, "", "b",
+                                  aa_tf_quat_ident, aa_tf_vec_ident,
+                                  "x", axis, 0 );
+
+    double d[3] = {.1, .1, .1};
+    aa_rx_geom_attach( sg, "a", aa_rx_geom_box(opt_cl, d) );
+    aa_rx_geom_attach( sg, "b", aa_rx_geom_box(opt_cl, d) );
+
+    aa_rx_sg_init(sg);
+    aa_rx_sg_cl_init(sg);
+
+    /* b approaches a, colliding at the last two configurations */
+    size_t n = 12;
+    struct aa_dmat *Q = aa_dmat_malloc( 1, n );
+    for( size_t i = 0; i < n; i ++ ) {
+        AA_DMAT_REF(Q,0,i) = 1.05 - .1*(double)i;
+    }
+
+    struct aa_rx_cl *cl = aa_rx_cl_create(sg);
+    for( size_t t = 1; t <= 3; t += 2 ) {
+        int results[n];
+        aa_rx_cl_set_threads( cl, t );
+        assert( 11 == aa_rx_cl_check_batch(cl, n, Q, NULL) );
+        assert( 11 == aa_rx_cl_check_batch(cl, n, Q, results) );
+        for( size_t i = 0; i < n; i ++ ) {
+            assert( (i >= 10) == (0 != results[i]) );
+        }
+        assert( aa_rx_cl_check_batch(cl, 10, Q, NULL) < 0 );
+    }
+
+    /* the kept batch contexts follow later changes to allowed pairs */
+    aa_rx_cl_allow_name( cl, "a", "b", 1 );
+    assert( 0 == aa_rx_cl_check_batch(cl, n, Q, NULL) );
+    aa_rx_cl_allow_name( cl, "a", "b", 0 );
+    assert( 11 == aa_rx_cl_check_batch(cl, n, Q, NULL) );
+    aa_rx_cl_set_threads( cl, 2 );
+    assert( 11 == aa_rx_cl_check_batch(cl, n, Q, NULL) );
+
+    free( Q );
+    aa_rx_cl_destroy(cl);
+    aa_rx_sg_destroy(sg);
+}
+
+static void test_motion()
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    struct aa_rx_geom_opt *opt_cl = aa_rx_geom_opt_create();
+    aa_rx_geom_opt_set_collision(opt_cl, 1);
+
+    double axis[3] = {1,0,0};
+    aa_rx_sg_add_frame_fixed( sg, "", "a",
+                              aa_tf_quat_ident, aa_tf_vec_ident );
+    aa_rx_sg_add_frame_prismatic( sg, "", "b",
+                                  aa_tf_quat_ident, aa_tf_vec_ident,
+                                  "x", axis, 0 );
+
+    double d[3] = {.1, .1, .1};
+    aa_rx_geom_attach( sg, "a", aa_rx_geom_box(opt_cl, d) );
+    aa_rx_geom_attach( sg, "b", aa_rx_geom_box(opt_cl, d) );
+
+    aa_rx_sg_init(sg);
+    aa_rx_sg_cl_init(sg);
+
+    struct aa_rx_cl *cl = aa_rx_cl_create(sg);
+    double x0 = 1, x1 = -1, x2 = .5;
+    struct aa_dvec q0 = AA_DVEC_INIT(1, &x0, 1);
+    struct aa_dvec q1 = AA_DVEC_INIT(1, &x1, 1);
+    struct aa_dvec q2 = AA_DVEC_INIT(1, &x2, 1);
+
+    /* b passes through a, though both endpoints are free; contact
+     * starts when the faces meet at x = .1 */
+    double t = -1;
+    assert( 1 == aa_rx_cl_check_motion(cl, &q0, &q1, &t) );
+    assert( t > .449 && t <= .45 );
+
+    t = -1;
+    assert( 0 == aa_rx_cl_check_motion(cl, &q0, &q2, &t) );
+    assert( -1 == t );
+
+    aa_rx_cl_destroy(cl);
+    aa_rx_sg_destroy(sg);
+}
+
+static void test_static()
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    struct aa_rx_geom_opt *opt_cl = aa_rx_geom_opt_create();
+    aa_rx_geom_opt_set_collision(opt_cl, 1);
+
+    /* a and c are fixed and overlap; b slides past them */
+    double axis[3] = {1,0,0};
+    double vc[3] = {0,.05,0};
+    aa_rx_sg_add_frame_fixed( sg, "", "a",
+                              aa_tf_quat_ident, aa_tf_vec_ident );
+    aa_rx_sg_add_frame_fixed( sg, "a", "c",
+                              aa_tf_quat_ident, vc );
+    aa_rx_sg_add_frame_prismatic( sg, "", "b",
+                                  aa_tf_quat_ident, aa_tf_vec_ident,
+                                  "x", axis, 0 );
+
+    double d[3] = {.1, .1, .1};
+    aa_rx_geom_attach( sg, "a", aa_rx_geom_box(opt_cl, d) );
+    aa_rx_geom_attach( sg, "b", aa_rx_geom_box(opt_cl, d) );
+    aa_rx_geom_attach( sg, "c", aa_rx_geom_box(opt_cl, d) );
+
+    aa_rx_sg_init(sg);
+    aa_rx_sg_cl_init(sg);
+
+    aa_rx_frame_id a = aa_rx_sg_frame_id(sg, "a");
+    aa_rx_frame_id b = aa_rx_sg_frame_id(sg, "b");
+    aa_rx_frame_id c = aa_rx_sg_frame_id(sg, "c");
+
+    struct aa_rx_cl *cl = aa_rx_cl_create(sg);
+    struct aa_rx_cl_set *set = aa_rx_cl_set_create(sg);
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+    double x = 1;
+    struct aa_dvec q = AA_DVEC_INIT(1, &x, 1);
+
+    aa_rx_fk_all(fk, &q);
+    assert( aa_rx_cl_check_fk(cl, fk, set) );
+    assert( aa_rx_cl_set_get(set, a, c) );
+    assert( ! aa_rx_cl_set_get(set, a, b) );
+
+    /* allowing the static pair takes effect on the next check */
+    aa_rx_cl_allow( cl, a, c, 1 );
+    assert( 0 == aa_rx_cl_check_fk(cl, fk, NULL) );
+
+    /* only b moves, into and back out of a and c */
+    x = 0;
+    aa_rx_fk_all(fk, &q);
+    aa_rx_cl_set_clear(set);
+    assert( aa_rx_cl_check_fk(cl, fk, set) );
+    assert( aa_rx_cl_set_get(set, a, b) );
+    assert( aa_rx_cl_set_get(set, c, b) );
+    assert( ! aa_rx_cl_set_get(set, a, c) );
+
+    x = -1;
+    aa_rx_fk_all(fk, &q);
+    assert( 0 == aa_rx_cl_check_fk(cl, fk, NULL) );
+
+    /* the same motion through the sub-scenegraph of b */
+    struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, b );
+    x = 0;
+    aa_rx_fk_sub(fk, ssg, &q);
+    aa_rx_cl_set_clear(set);
+    assert( aa_rx_cl_check_sub(cl, ssg, fk, set) );
+    assert( aa_rx_cl_set_get(set, a, b) );
+    assert( aa_rx_cl_set_get(set, c, b) );
+    x = 1;
+    aa_rx_fk_sub(fk, ssg, &q);
+    assert( 0 == aa_rx_cl_check_sub(cl, ssg, fk, NULL) );
+
+    /* a first sub-scenegraph check also places the static objects */
+    struct aa_rx_cl *cl1 = aa_rx_cl_create(sg);
+    x = 0;
+    aa_rx_fk_sub(fk, ssg, &q);
+    aa_rx_cl_set_clear(set);
+    assert( aa_rx_cl_check_sub(cl1, ssg, fk, set) );
+    assert( aa_rx_cl_set_get(set, a, b) );
+    assert( aa_rx_cl_set_get(set, a, c) );
+
+    /* caller transforms still move static objects */
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    double *TF = AA_NEW_AR(double, 7*n_f);
+    for( size_t i = 0; i < n_f; i ++ ) {
+        aa_rx_fk_get_abs_qutr(fk, (aa_rx_frame_id)i, TF + 7*i);
+    }
+    TF[7*c + AA_TF_QUTR_T + 2] = 10;
+    aa_rx_cl_set_clear(set);
+    assert( aa_rx_cl_check(cl1, n_f, TF, 7, set) );
+    assert( aa_rx_cl_set_get(set, a, b) );
+    assert( ! aa_rx_cl_set_get(set, a, c) );
+
+    /* and the next FK check places them back */
+    aa_rx_cl_set_clear(set);
+    assert( aa_rx_cl_check_fk(cl1, fk, set) );
+    assert( aa_rx_cl_set_get(set, a, c) );
+    free(TF);
+    aa_rx_cl_destroy(cl1);
+    aa_rx_sg_sub_destroy(ssg);
+
+    aa_rx_fk_destroy(fk);
+    aa_rx_cl_set_destroy(set);
+    aa_rx_cl_destroy(cl);
+    aa_rx_sg_destroy(sg);
+}
+
+#ifdef HAVE_NLOPT
+void test_ik_separation()
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    struct aa_rx_geom_opt *opt_cl = aa_rx_geom_opt_create();
+    aa_rx_geom_opt_set_collision(opt_cl, 1);
+
+    /* Planar arm with an obstacle beside the second link */
+    double q[4] = {.6, 1, 1, 1};
+    double v0[3] = {0, 0, 0}, v[3] = {.5, 0, 0};
+    double vo[3] = { .5*cos(q[0]) + .5*cos(q[0]+q[1]) + .12,
+                     .5*sin(q[0]) + .5*sin(q[0]+q[1]) - .05,
+                     0 };
+    aa_rx_sg_add_frame_revolute( sg, "", "j0", aa_tf_quat_ident, v0, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j0", "j1", aa_tf_quat_ident, v, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j1", "j2", aa_tf_quat_ident, v, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j2", "j3", aa_tf_quat_ident, v, NULL, aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "j3", "ee", aa_tf_quat_ident, v );
+    aa_rx_sg_add_frame_fixed( sg, "", "obs", aa_tf_quat_ident, vo );
+    aa_rx_geom_attach( sg, "j1", aa_rx_geom_sphere(opt_cl, .05) );
+    aa_rx_geom_attach( sg, "j2", aa_rx_geom_sphere(opt_cl, .05) );
+    aa_rx_geom_attach( sg, "j3", aa_rx_geom_sphere(opt_cl, .05) );
+    aa_rx_geom_attach( sg, "obs", aa_rx_geom_sphere(opt_cl, .1) );
+    aa_rx_sg_init(sg);
+    aa_rx_sg_cl_init(sg);
+
+    aa_rx_frame_id ee = aa_rx_sg_frame_id(sg, "ee");
+    struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, ee );
+    struct aa_rx_cl *cl = aa_rx_cl_create(sg);
+    struct aa_rx_fk *fk = aa_rx_fk_malloc(sg);
+
+    double E[7];
+    struct aa_dvec vq = AA_DVEC_INIT(4, q, 1);
+    struct aa_dmat TF = AA_DMAT_INIT(7, 1, E, 7);
+    aa_rx_fk_sub( fk, ssg, &vq );
+    aa_rx_fk_get_abs_qutr( fk, ee, E );
+    assert( aa_rx_cl_check_fk(cl, fk, NULL) );
+
+    assert( NULL == aa_rx_cl_ik_create(cl, ssg, 0, .02, .1) );
+    struct aa_rx_cl_ik *clik = aa_rx_cl_ik_create(cl, ssg, 2, .02, .1);
+    struct aa_rx_ik_parm *parm = aa_rx_ik_parm_create();
+    aa_rx_ik_parm_set_algo( parm, AA_RX_IK_SQP );
+    struct aa_rx_ik_cx *cx = aa_rx_ik_cx_create( ssg, parm );
+    aa_rx_cl_ik_attach( cx, clik, 1e-6 );
+
+    /* The solution reaches the target without touching the obstacle */
+    aa_rx_ik_set_seed( cx, &vq );
+    assert( 0 == aa_rx_ik_solve( cx, &TF, &vq ) );
+    assert( 0 == aa_rx_ik_check( cx, &TF, &vq ) );
+    aa_rx_fk_sub( fk, ssg, &vq );
+    assert( 0 == aa_rx_cl_check_fk(cl, fk, NULL) );
+
+    struct aa_rx_cl_dist *dist = aa_rx_cl_dist_create(cl);
+    aa_rx_cl_dist_check( dist, fk );
+    assert( aa_rx_cl_dist_get_dist(dist, aa_rx_sg_frame_id(sg, "j2"),
+                                   aa_rx_sg_frame_id(sg, "obs")) >= .02 - 1e-4 );
+
+    aa_rx_cl_ik_attach( cx, NULL, 0 );
+    aa_rx_cl_dist_destroy(dist);
+    aa_rx_ik_cx_destroy(cx);
+    aa_rx_ik_parm_destroy(parm);
+    aa_rx_cl_ik_destroy(clik);
+    aa_rx_fk_destroy(fk);
+    aa_rx_cl_destroy(cl);
+    aa_rx_sg_sub_destroy(ssg);
+    aa_rx_sg_destroy(sg);
+}
+#else /*HAVE_NLOPT*/
+void test_ik_separation() { }
+#endif /*HAVE_NLOPT*/
 
 int main( int argc, char **argv)
 {
@@ -150,6 +490,11 @@ int main( int argc, char **argv)
     aa_rx_cl_init();
     test_box();
     test_cylinder();
+    test_threads();
+    test_batch();
+    test_motion();
+    test_static();
+    test_ik_separation();
 
     return 0;
 }
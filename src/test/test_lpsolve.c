@@ -184,6 +184,89 @@ void helper2( const char *name, aa_opt_gmcreate_fun fun) {
            1e-3 );
 }
 
+/* Re-solve after changing the constraint bounds and objective */
+void helper3( const char *name, aa_opt_gmcreate_fun fun) {
+
+    double A[] = {1, 1};
+
+    double b_u[] = {DBL_MAX};
+    double b_l[] = {20};
+    double c[] = {4, 2};
+
+    double x_l[] = {0, 0};
+    double x_u[] = {20, 10};
+
+    double x[2];
+
+    struct aa_opt_cx *cx = fun( 1, 2,
+                                A, 1,
+                                b_l, b_u,
+                                c,
+                                x_l, x_u );
+    aa_opt_set_direction(cx, AA_OPT_MINIMIZE );
+    aa_opt_solve(cx,2,x);
+    aafeq( name, 60, cblas_ddot( 2, x, 1, c, 1 ), 1e-3 );
+
+    b_l[0] = 25;
+    aa_opt_set_cstr_bnd( cx, 1, b_l, b_u );
+    aa_opt_solve(cx,2,x);
+    aafeq( name, 80, cblas_ddot( 2, x, 1, c, 1 ), 1e-3 );
+
+    c[0] = 1;
+    aa_opt_set_obj( cx, 2, c );
+    aa_opt_solve(cx,2,x);
+    aafeq( name, 30, cblas_ddot( 2, x, 1, c, 1 ), 1e-3 );
+
+    aa_opt_destroy(cx);
+}
+
+/* Warm-started re-solves match solving each LP from scratch */
+void helper4( const char *name, aa_opt_gmcreate_fun fun) {
+
+    double A[] = {120, 110, 1,  210, 30, 1};
+    double b_u[] = {15000, 4000, 75};
+    double b_l[] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+    double c[] = {1, 1};
+
+    double x_l[] = {0,0};
+    double x_u[] = {1000,1000};
+
+    double x[2], x0[2];
+
+    struct aa_opt_cx *cx = fun( 3, 2, A, 3, b_l, b_u, c, x_l, x_u );
+    aa_opt_set_direction( cx, AA_OPT_MAXIMIZE );
+    test( name, 0 == aa_opt_solve(cx,2,x) );
+
+    for( size_t k = 1; k < 12; k ++ ) {
+        /* bounds every tick, objective and matrix every few */
+        b_u[0] = 15000 - 400.0*(double)k;
+        b_u[1] = 4000 + 100.0*(double)(k % 3);
+        if( aa_opt_set_cstr_bnd( cx, 3, b_l, b_u ) ) {
+            aa_opt_set_cstr_gm( cx, 3, 2, A, 3, b_l, b_u );
+        }
+        if( 0 == k % 2 ) {
+            c[0] = 1 + .1*(double)k;
+            aa_opt_set_obj( cx, 2, c );
+        }
+        if( 0 == k % 3 ) {
+            A[3] = 210 - 5.0*(double)k;
+            aa_opt_set_cstr_gm( cx, 3, 2, A, 3, b_l, b_u );
+        }
+        test( name, 0 == aa_opt_solve(cx,2,x) );
+
+        struct aa_opt_cx *cx0 = fun( 3, 2, A, 3, b_l, b_u, c, x_l, x_u );
+        aa_opt_set_direction( cx0, AA_OPT_MAXIMIZE );
+        test( name, 0 == aa_opt_solve(cx0,2,x0) );
+        aafeq( name,
+               cblas_ddot( 2, x0, 1, c, 1 ),
+               cblas_ddot( 2, x, 1, c, 1 ),
+               1e-3 );
+        aa_opt_destroy(cx0);
+    }
+
+    aa_opt_destroy(cx);
+}
+
 int main( int argc, char **argv ) {
     (void) argc; (void) argv;
 
@@ -192,18 +275,24 @@ int main( int argc, char **argv ) {
     helper0("LP Solve", aa_opt_lpsolve_gmcreate);
     helper1("LP Solve", aa_opt_lpsolve_gmcreate);
     helper2("LP Solve", aa_opt_lpsolve_gmcreate);
+    helper3("LP Solve", aa_opt_lpsolve_gmcreate);
+    helper4("LP Solve", aa_opt_lpsolve_gmcreate);
 #endif
 
 #ifdef HAVE_GLPK
     helper0("GLPK", aa_opt_glpk_gmcreate);
     helper1("GLPK", aa_opt_glpk_gmcreate);
     helper2("GLPK", aa_opt_glpk_gmcreate);
+    helper3("GLPK", aa_opt_glpk_gmcreate);
+    helper4("GLPK", aa_opt_glpk_gmcreate);
 #endif
 
 #ifdef HAVE_CLP
     helper0("CLP", aa_opt_clp_gmcreate);
     helper1("CLP", aa_opt_clp_gmcreate);
     helper2("CLP", aa_opt_clp_gmcreate);
+    helper3("CLP", aa_opt_clp_gmcreate);
+    helper4("CLP", aa_opt_clp_gmcreate);
 #endif
 
 }